@@ -0,0 +1,6 @@
+#pragma once
+
+// Number of calls to global operator new since the program started. The count is kept by
+// replacement operator new/delete in AllocationCounter.cpp, so it covers every heap allocation
+// made through the C++ runtime, including those inside std::vector.
+long long AllocationCount();
@@ -0,0 +1,336 @@
+#include "Benchmark.h"
+#include "AllocationCounter.h"
+#include "BspTree.h"
+#include "MemoryRenderer.h"
+#include "Random.h"
+
+#include <SDL_timer.h>
+#include <functional>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+static const int BENCH_WIDTH = 1080;
+static const int BENCH_HEIGHT = 1080;
+static const int BENCH_FRAMES = 3;
+
+class BenchResult
+{
+  public:
+    std::string name;
+    double primitivesPerSecond;
+    double pixelsPerSecond;
+    double allocationsPerFrame;
+};
+
+class Workload
+{
+  public:
+    std::string name;
+    std::vector<Vector3> filled;
+    std::vector<Vertex> shaded;
+    std::vector<Vector2> lineStarts, lineEnds;
+    std::function<void(Renderer &)> draw; // for workloads that are not plain primitive lists
+    int primitives;
+    double pixels; // covered pixels per frame, from triangle areas and line lengths
+};
+
+static float TriangleArea(float x0, float y0, float x1, float y1, float x2, float y2)
+{
+    return fabsf((x1 - x0) * (y2 - y0) - (x2 - x0) * (y1 - y0)) * 0.5f;
+}
+
+// count triangles whose legs are about size pixels, scattered over the canvas.
+static Workload Triangles(const char *name, int count, float size, bool shaded)
+{
+    Workload w;
+    w.name = name;
+    w.primitives = count;
+    w.pixels = 0;
+    Random random;
+    const float hw = BENCH_WIDTH / 2 - size - 1, hh = BENCH_HEIGHT / 2 - size - 1;
+    for (int i = 0; i < count; i++) {
+        const float x = random.Next(-hw, hw), y = random.Next(-hh, hh);
+        const float x1 = x + size * random.Next(0.8f, 1.2f), y2 = y + size * random.Next(0.8f, 1.2f);
+        w.pixels += TriangleArea(x, y, x1, y, x, y2);
+        if (shaded) {
+            w.shaded.push_back(Vertex(x, y, 1.f));
+            w.shaded.push_back(Vertex(x1, y, 0.5f));
+            w.shaded.push_back(Vertex(x, y2, 0.1f));
+        } else {
+            w.filled.push_back(Vector3(x, y, 0));
+            w.filled.push_back(Vector3(x1, y, 0));
+            w.filled.push_back(Vector3(x, y2, 0));
+        }
+    }
+    return w;
+}
+
+// layers full-screen quads, two triangles each, drawn on top of each other.
+static Workload Overdraw(const char *name, int layers)
+{
+    Workload w;
+    w.name = name;
+    w.primitives = 2 * layers;
+    w.pixels = static_cast<double>(layers) * BENCH_WIDTH * BENCH_HEIGHT;
+    const float hw = BENCH_WIDTH / 2, hh = BENCH_HEIGHT / 2;
+    for (int i = 0; i < layers; i++) {
+        const Vector3 quad[] = { { -hw, -hh, 0 }, { hw, -hh, 0 }, { hw, hh, 0 }, { -hw, -hh, 0 }, { hw, hh, 0 }, { -hw, hh, 0 } };
+        w.filled.insert(w.filled.end(), quad, quad + 6);
+    }
+    return w;
+}
+
+static Workload Lines(const char *name, int count, float length)
+{
+    Workload w;
+    w.name = name;
+    w.primitives = count;
+    w.pixels = 0;
+    Random random;
+    const float hw = BENCH_WIDTH / 2 - 1, hh = BENCH_HEIGHT / 2 - 1;
+    for (int i = 0; i < count; i++) {
+        const float x = random.Next(-hw, hw), y = random.Next(-hh, hh);
+        const float angle = random.Next(0, 6.2831853f);
+        const float x1 = SDL_clamp(x + length * cosf(angle), -hw, hw);
+        const float y1 = SDL_clamp(y + length * sinf(angle), -hh, hh);
+        w.lineStarts.push_back(Vector2(x, y));
+        w.lineEnds.push_back(Vector2(x1, y1));
+        w.pixels += SDL_max(fabsf(x1 - x), fabsf(y1 - y)) + 1;
+    }
+    return w;
+}
+
+// Three overlapping translucent spheres, drawn back to front through a BSP tree or as an opaque
+// depth-buffered mesh.
+static Workload Spheres(const char *name, bool bsp)
+{
+    static Mesh mesh;
+    static BspTree tree;
+    if (mesh.triangles.empty()) {
+        const Vector3 offsets[] = { { -0.6f, 0, 0 }, { 0.6f, 0, 0 }, { 0, 0.6f, 0.3f } };
+        for (const Vector3 &offset : offsets) {
+            const Mesh sphere = Mesh::Sphere(24, Color(0, 128, 255, 128));
+            const int base = static_cast<int>(mesh.vertices.size());
+            for (const Vector3 &v : sphere.vertices) {
+                mesh.vertices.push_back(v + offset);
+            }
+            for (Triangle t : sphere.triangles) {
+                t.v0 += base;
+                t.v1 += base;
+                t.v2 += base;
+                mesh.triangles.push_back(t);
+            }
+        }
+        tree.Build(mesh);
+    }
+
+    const float scale = static_cast<float>(BENCH_WIDTH);
+    const Matrix4 cameraToCanvas = Matrix4(scale, 0, 0, 0, 0, scale, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1) * Matrix4::Perspective(1);
+    const Matrix4 modelToCamera = Matrix4::Translation(Vector3(0, 0, 4)) * Matrix4::RotationY(30);
+
+    Workload w;
+    w.name = name;
+    w.primitives = static_cast<int>(bsp ? tree.triangles.size() : mesh.triangles.size());
+    w.pixels = 0;
+    const Matrix4 modelToCanvas = cameraToCanvas * modelToCamera;
+    for (const Triangle &t : tree.triangles) {
+        const Vector3 a = modelToCanvas.TransformPoint(tree.vertices[t.v0]);
+        const Vector3 b = modelToCanvas.TransformPoint(tree.vertices[t.v1]);
+        const Vector3 c = modelToCanvas.TransformPoint(tree.vertices[t.v2]);
+        w.pixels += TriangleArea(a.x / a.z, a.y / a.z, b.x / b.z, b.y / b.z, c.x / c.z, c.y / c.z);
+    }
+    if (bsp)
+        w.draw = [=](Renderer &renderer) { DrawBspTree(renderer, tree, modelToCamera, cameraToCanvas); };
+    else
+        w.draw = [=](Renderer &renderer) { renderer.DrawMesh(mesh, modelToCanvas); };
+    return w;
+}
+
+static void DrawWorkload(Renderer &renderer, const Workload &w)
+{
+    if (w.draw)
+        w.draw(renderer);
+    if (!w.filled.empty())
+        renderer.DrawFilledTriangles(w.filled.data(), static_cast<int>(w.filled.size() / 3), Color(0, 128, 255));
+    if (!w.shaded.empty())
+        renderer.DrawShadedTriangles(w.shaded.data(), static_cast<int>(w.shaded.size() / 3), Color(0, 255, 0));
+    if (!w.lineStarts.empty())
+        renderer.DrawLines(w.lineStarts.data(), w.lineEnds.data(), static_cast<int>(w.lineStarts.size()), Color(255, 0, 0));
+}
+
+// Blends a jittered, tessellated quad at half alpha over white and counts the pixels that come out
+// drawn more than once, plus the holes: pixels inside the quad that were never drawn. The quad's
+// outline sits off the pixel grid, so exactly the pixels inside it should be drawn, each once.
+static void CheckCoverage(SoftwareRenderer &renderer, int &overdrawn, int &holes)
+{
+    const int cells = 32;
+    const float half = 300.3f, cell = 2 * half / cells;
+    std::vector<Vector3> grid((cells + 1) * (cells + 1));
+    Random random;
+    for (int j = 0; j <= cells; j++) {
+        for (int i = 0; i <= cells; i++) {
+            // Interior vertices move little enough that every cell stays convex.
+            const bool border = i == 0 || j == 0 || i == cells || j == cells;
+            const float jitter = border ? 0.f : 0.2f * cell;
+            grid[j * (cells + 1) + i] = Vector3(-half + i * cell + random.Next(-jitter, jitter), -half + j * cell + random.Next(-jitter, jitter), 0);
+        }
+    }
+
+    // Diagonals and winding alternate from cell to cell.
+    std::vector<Vector3> triangles;
+    std::vector<PackedColor> colors;
+    for (int j = 0; j < cells; j++) {
+        for (int i = 0; i < cells; i++) {
+            const Vector3 &a = grid[j * (cells + 1) + i], &b = grid[j * (cells + 1) + i + 1];
+            const Vector3 &c = grid[(j + 1) * (cells + 1) + i + 1], &d = grid[(j + 1) * (cells + 1) + i];
+            const Vector3 quad[] = { a, b, c, a, c, d };
+            const Vector3 flipped[] = { b, a, d, b, d, c };
+            const Vector3 *cellTriangles = (i + j) % 2 ? flipped : quad;
+            triangles.insert(triangles.end(), cellTriangles, cellTriangles + 6);
+            colors.push_back(PackedColor(Color(0, 0, 0, 128)));
+            colors.push_back(PackedColor(Color(0, 0, 0, 128)));
+        }
+    }
+
+    renderer.Clear(Color(255, 255, 255));
+    renderer.DrawBlendedTriangles(triangles.data(), colors.data(), static_cast<int>(colors.size()));
+
+    // White darkens to about 127 under one layer and 63 under two.
+    overdrawn = holes = 0;
+    const int w = renderer.Width(), h = renderer.Height();
+    const Uint32 *pixels = renderer.Pixels();
+    for (int sy = 0; sy < h; sy++) {
+        for (int sx = 0; sx < w; sx++) {
+            const int red = pixels[sy * w + sx] & 0xff;
+            const float x = static_cast<float>(sx - w / 2), y = static_cast<float>(h / 2 - sy);
+            const bool inside = fabsf(x) < half && fabsf(y) < half;
+            overdrawn += red < 96;
+            holes += inside && red > 191;
+        }
+    }
+}
+
+static BenchResult Run(Renderer &renderer, const Workload &w)
+{
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+
+    // One untimed frame so buffers reach their steady-state size.
+    renderer.Clear(Color(255, 255, 255));
+    DrawWorkload(renderer, w);
+    renderer.Present();
+
+    double seconds = 0;
+    long long allocations = 0;
+    for (int frame = 0; frame < BENCH_FRAMES; frame++) {
+        const long long allocationsBefore = AllocationCount();
+        const Uint64 start = SDL_GetPerformanceCounter();
+        renderer.Clear(Color(255, 255, 255));
+        DrawWorkload(renderer, w);
+        renderer.Present();
+        seconds += static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+        allocations += AllocationCount() - allocationsBefore;
+    }
+
+    BenchResult result;
+    result.name = w.name;
+    result.primitivesPerSecond = w.primitives * BENCH_FRAMES / seconds;
+    result.pixelsPerSecond = w.pixels * BENCH_FRAMES / seconds;
+    result.allocationsPerFrame = static_cast<double>(allocations) / BENCH_FRAMES;
+    return result;
+}
+
+static std::vector<BenchResult> LoadBaseline(const char *path)
+{
+    std::vector<BenchResult> baseline;
+    FILE *f = path ? fopen(path, "r") : nullptr;
+    if (!f)
+        return baseline;
+
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+        char name[128];
+        BenchResult r;
+        if (line[0] != '#' && sscanf(line, "%127s %lf %lf %lf", name, &r.primitivesPerSecond, &r.pixelsPerSecond, &r.allocationsPerFrame) == 4) {
+            r.name = name;
+            baseline.push_back(r);
+        }
+    }
+    fclose(f);
+    return baseline;
+}
+
+static bool SaveBaseline(const char *path, const std::vector<BenchResult> &results)
+{
+    FILE *f = fopen(path, "w");
+    if (!f)
+        return false;
+    fprintf(f, "# workload primitives/s pixels/s allocations/frame\n");
+    for (const BenchResult &r : results) {
+        fprintf(f, "%s %.0f %.0f %.1f\n", r.name.c_str(), r.primitivesPerSecond, r.pixelsPerSecond, r.allocationsPerFrame);
+    }
+    fclose(f);
+    return true;
+}
+
+int RunRasterBenchmarks(const char *baselinePath, bool save)
+{
+    std::vector<Workload> workloads;
+    workloads.push_back(Triangles("tri_1px_flat", 1000000, 1.5f, false));
+    workloads.push_back(Triangles("tri_10px_flat", 1000000, 4.5f, false));
+    workloads.push_back(Triangles("tri_10px_shaded", 1000000, 4.5f, true));
+    workloads.push_back(Triangles("tri_screen_flat", 100, static_cast<float>(BENCH_WIDTH) - 4, false));
+    workloads.push_back(Triangles("tri_screen_shaded", 100, static_cast<float>(BENCH_WIDTH) - 4, true));
+    workloads.push_back(Overdraw("overdraw_64_layers", 64));
+    workloads.push_back(Lines("line_long", 10000, 1000));
+    workloads.push_back(Lines("line_short", 1000000, 8));
+    workloads.push_back(Spheres("spheres_bsp_blended", true));
+    workloads.push_back(Spheres("spheres_depth_buffer", false));
+
+    MemoryRenderer renderer(BENCH_WIDTH, BENCH_HEIGHT);
+    const std::vector<BenchResult> baseline = save ? std::vector<BenchResult>() : LoadBaseline(baselinePath);
+
+    std::vector<BenchResult> results;
+    int allocatingWorkloads = 0;
+    printf("%-20s %14s %14s %12s %10s\n", "workload", "prims/s", "pixels/s", "allocs/frame", "vs base");
+    for (const Workload &w : workloads) {
+        const BenchResult r = Run(renderer, w);
+        results.push_back(r);
+
+        char delta[32] = "";
+        for (const BenchResult &b : baseline) {
+            if (b.name == r.name && b.pixelsPerSecond > 0)
+                SDL_snprintf(delta, sizeof(delta), "%+.1f%%", 100.0 * (r.pixelsPerSecond / b.pixelsPerSecond - 1.0));
+        }
+        printf("%-20s %14.0f %14.0f %12.1f %10s\n", r.name.c_str(), r.primitivesPerSecond, r.pixelsPerSecond, r.allocationsPerFrame, delta);
+        if (r.allocationsPerFrame > 0)
+            allocatingWorkloads++;
+    }
+
+    if (save) {
+        if (!SaveBaseline(baselinePath, results)) {
+            printf("Could not write %s\n", baselinePath);
+            return 1;
+        }
+        printf("Baseline written to %s\n", baselinePath);
+    }
+
+    int overdrawn, holes;
+    CheckCoverage(renderer, overdrawn, holes);
+    printf("Tessellated quad: %d pixels drawn more than once, %d missed\n", overdrawn, holes);
+
+    // Per-frame temporaries come from the frame arena, so a steady-state frame must not touch the heap.
+    int status = 0;
+    if (allocatingWorkloads > 0) {
+        printf("FAILED: %d workloads allocate in steady-state frames\n", allocatingWorkloads);
+        status = 1;
+    }
+    // The fill rule hands every pixel on a shared edge to exactly one triangle.
+    if (overdrawn > 0 || holes > 0) {
+        printf("FAILED: triangles sharing edges overdraw or leave gaps\n");
+        status = 1;
+    }
+    return status;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+// Renders synthetic rasterizer workloads into an off-screen MemoryRenderer and prints
+// triangles (or lines) per second, pixels per second and heap allocations per frame.
+// When baselinePath names an existing file the results are diffed against it; when save is set
+// the results are written there instead. Returns a process exit code, which is non-zero when
+// any workload allocates from the heap in a steady-state frame, or when the triangles of a
+// tessellated quad overdraw or miss pixels along their shared edges.
+int RunRasterBenchmarks(const char *baselinePath, bool save);
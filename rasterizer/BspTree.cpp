@@ -0,0 +1,329 @@
+#include "BspTree.h"
+#include "VertexBatch.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Points closer to a plane than this count as lying in it.
+static const float BSP_EPSILON = 1e-4f;
+
+// Weight of a split against one triangle of imbalance when scoring splitters.
+static const int BSP_SPLIT_COST = 8;
+
+static const char BSP_MAGIC[4] = { 'B', 'S', 'P', '1' };
+
+static bool TrianglePlane(const Vector3 &a, const Vector3 &b, const Vector3 &c, Vector3 &normal, float &d)
+{
+    normal = (b - a).Cross(c - a);
+    const float length = normal.Length();
+    if (length == 0.f)
+        return false;
+    normal *= 1.f / length;
+    d = normal.Dot(a);
+    return true;
+}
+
+// -1 behind, 0 in the plane, 1 in front, 2 straddling.
+static int Classify(const Vector3 *corners, const Vector3 &normal, float d)
+{
+    bool front = false, back = false;
+    for (int k = 0; k < 3; k++) {
+        const float distance = normal.Dot(corners[k]) - d;
+        front |= distance > BSP_EPSILON;
+        back |= distance < -BSP_EPSILON;
+    }
+    return front && back ? 2 : front ? 1 : back ? -1 : 0;
+}
+
+void BspTree::Build(const Mesh &mesh, int candidates)
+{
+    vertices = mesh.vertices;
+    triangles = mesh.triangles;
+    nodes.clear();
+    order.clear();
+    splits = 0;
+
+    if (triangles.empty())
+        return;
+
+    // Depth first with an explicit stack, front sides first, so nodes are numbered as a recursive
+    // build would number them without its depth: trees over convex meshes degenerate into chains
+    // as long as the mesh has triangles.
+    std::vector<BuildTask> stack(1);
+    stack[0].indices.resize(triangles.size());
+    for (size_t i = 0; i < triangles.size(); i++) {
+        stack[0].indices[i] = static_cast<int>(i);
+    }
+    stack[0].parent = -1;
+    stack[0].front = false;
+    while (!stack.empty()) {
+        BuildTask task = std::move(stack.back());
+        stack.pop_back();
+        std::vector<int> front, back;
+        const int index = BuildNode(task.indices, candidates, front, back);
+        if (task.parent >= 0) {
+            BspNode &parent = nodes[task.parent];
+            (task.front ? parent.front : parent.back) = index;
+        }
+
+        BuildTask child;
+        child.parent = index;
+        if (!back.empty()) {
+            child.indices.swap(back);
+            child.front = false;
+            stack.push_back(std::move(child));
+        }
+        if (!front.empty()) {
+            child.indices.swap(front);
+            child.front = true;
+            stack.push_back(std::move(child));
+        }
+    }
+}
+
+int BspTree::BuildNode(std::vector<int> &indices, int candidates, std::vector<int> &front, std::vector<int> &back)
+{
+    // Try an evenly spread sample of the triangles' planes; fewest splits first, then balance.
+    const int count = static_cast<int>(indices.size());
+    const int step = SDL_max(count / SDL_max(candidates, 1), 1);
+    Vector3 normal(0, 0, 0);
+    float d = 0;
+    int bestScore = -1;
+    for (int k = 0; k < count; k += step) {
+        const Triangle &candidate = triangles[indices[k]];
+        Vector3 n;
+        float pd;
+        if (!TrianglePlane(vertices[candidate.v0], vertices[candidate.v1], vertices[candidate.v2], n, pd))
+            continue;
+        int front = 0, back = 0, split = 0;
+        for (int i : indices) {
+            const Triangle &t = triangles[i];
+            const Vector3 corners[] = { vertices[t.v0], vertices[t.v1], vertices[t.v2] };
+            const int side = Classify(corners, n, pd);
+            front += side == 1;
+            back += side == -1;
+            split += side == 2;
+        }
+        const int score = BSP_SPLIT_COST * split + abs(front - back);
+        if (bestScore < 0 || score < bestScore) {
+            bestScore = score;
+            normal = n;
+            d = pd;
+        }
+    }
+
+    // With only degenerate triangles left the zero plane keeps them all in this node.
+    BspNode node;
+    node.normal = normal;
+    node.d = d;
+    node.first = static_cast<int>(order.size());
+    for (int i : indices) {
+        const Triangle &t = triangles[i];
+        const Vector3 corners[] = { vertices[t.v0], vertices[t.v1], vertices[t.v2] };
+        switch (Classify(corners, normal, d)) {
+        case 0:
+            order.push_back(i);
+            break;
+        case 1:
+            front.push_back(i);
+            break;
+        case -1:
+            back.push_back(i);
+            break;
+        default:
+            SplitTriangle(i, normal, d, front, back);
+            break;
+        }
+    }
+    node.count = static_cast<int>(order.size()) - node.first;
+    node.front = node.back = -1;
+
+    nodes.push_back(node);
+    std::vector<int>().swap(indices);
+    return static_cast<int>(nodes.size()) - 1;
+}
+
+// Cuts a straddling triangle along the plane into a polygon on each side, and fans those back into
+// triangles. The first piece reuses the original triangle's slot.
+void BspTree::SplitTriangle(int index, const Vector3 &normal, float d, std::vector<int> &front, std::vector<int> &back)
+{
+    const Triangle original = triangles[index];
+    const int corners[] = { original.v0, original.v1, original.v2 };
+    int frontPolygon[4], backPolygon[4];
+    int frontCount = 0, backCount = 0;
+
+    for (int k = 0; k < 3; k++) {
+        const int a = corners[k], b = corners[(k + 1) % 3];
+        const float da = normal.Dot(vertices[a]) - d, db = normal.Dot(vertices[b]) - d;
+        if (da >= -BSP_EPSILON)
+            frontPolygon[frontCount++] = a;
+        if (da <= BSP_EPSILON)
+            backPolygon[backCount++] = a;
+        if ((da > BSP_EPSILON && db < -BSP_EPSILON) || (da < -BSP_EPSILON && db > BSP_EPSILON)) {
+            const Vector3 p = vertices[a] + (vertices[b] - vertices[a]) * (da / (da - db));
+            vertices.push_back(p);
+            frontPolygon[frontCount++] = backPolygon[backCount++] = static_cast<int>(vertices.size()) - 1;
+        }
+    }
+
+    bool reused = false;
+    auto emit = [&](const int *polygon, int n, std::vector<int> &side) {
+        for (int k = 2; k < n; k++) {
+            Triangle piece = original;
+            piece.v0 = polygon[0];
+            piece.v1 = polygon[k - 1];
+            piece.v2 = polygon[k];
+            if (!reused) {
+                triangles[index] = piece;
+                side.push_back(index);
+                reused = true;
+            } else {
+                triangles.push_back(piece);
+                side.push_back(static_cast<int>(triangles.size()) - 1);
+            }
+        }
+    };
+    emit(frontPolygon, frontCount, front);
+    emit(backPolygon, backCount, back);
+    splits++;
+}
+
+// The file is the four arrays in native byte order after a magic number and their sizes.
+bool BspTree::Save(const char *path) const
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    const Sint32 counts[] = { static_cast<Sint32>(vertices.size()), static_cast<Sint32>(triangles.size()),
+                              static_cast<Sint32>(nodes.size()), static_cast<Sint32>(order.size()), splits };
+    bool ok = fwrite(BSP_MAGIC, sizeof(BSP_MAGIC), 1, f) == 1;
+    ok = ok && fwrite(counts, sizeof(counts), 1, f) == 1;
+    ok = ok && fwrite(vertices.data(), sizeof(Vector3), vertices.size(), f) == vertices.size();
+    ok = ok && fwrite(triangles.data(), sizeof(Triangle), triangles.size(), f) == triangles.size();
+    ok = ok && fwrite(nodes.data(), sizeof(BspNode), nodes.size(), f) == nodes.size();
+    ok = ok && fwrite(order.data(), sizeof(int), order.size(), f) == order.size();
+    fclose(f);
+    return ok;
+}
+
+bool BspTree::Load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    long length = -1;
+    if (fseek(f, 0, SEEK_END) == 0) {
+        length = ftell(f);
+        rewind(f);
+    }
+
+    char magic[4];
+    Sint32 counts[5];
+    bool ok = fread(magic, sizeof(magic), 1, f) == 1 && memcmp(magic, BSP_MAGIC, sizeof(magic)) == 0;
+    ok = ok && fread(counts, sizeof(counts), 1, f) == 1;
+    ok = ok && counts[0] >= 0 && counts[1] >= 0 && counts[2] >= 0 && counts[3] >= 0;
+    // A corrupt header must not size the arrays past what the file holds.
+    if (ok) {
+        const Uint64 bytes = sizeof(BSP_MAGIC) + sizeof(counts) + static_cast<Uint64>(counts[0]) * sizeof(Vector3) +
+                             static_cast<Uint64>(counts[1]) * sizeof(Triangle) + static_cast<Uint64>(counts[2]) * sizeof(BspNode) +
+                             static_cast<Uint64>(counts[3]) * sizeof(int);
+        ok = length >= 0 && bytes == static_cast<Uint64>(length);
+    }
+    if (ok) {
+        vertices.resize(counts[0]);
+        triangles.resize(counts[1]);
+        nodes.resize(counts[2]);
+        order.resize(counts[3]);
+        splits = counts[4];
+        ok = fread(vertices.data(), sizeof(Vector3), vertices.size(), f) == vertices.size();
+        ok = ok && fread(triangles.data(), sizeof(Triangle), triangles.size(), f) == triangles.size();
+        ok = ok && fread(nodes.data(), sizeof(BspNode), nodes.size(), f) == nodes.size();
+        ok = ok && fread(order.data(), sizeof(int), order.size(), f) == order.size();
+    }
+    fclose(f);
+    ok = ok && Valid();
+
+    if (!ok) {
+        vertices.clear();
+        triangles.clear();
+        nodes.clear();
+        order.clear();
+    }
+    return ok;
+}
+
+bool BspTree::Valid() const
+{
+    const int vertexCount = static_cast<int>(vertices.size()), triangleCount = static_cast<int>(triangles.size());
+    const int nodeCount = static_cast<int>(nodes.size()), orderCount = static_cast<int>(order.size());
+    for (const Triangle &t : triangles) {
+        if (t.v0 < 0 || t.v0 >= vertexCount || t.v1 < 0 || t.v1 >= vertexCount || t.v2 < 0 || t.v2 >= vertexCount)
+            return false;
+    }
+    // Every triangle is in order exactly once, so a walk visits at most triangles.size() of them,
+    // which is what DrawBspTree sizes its buffers by.
+    if (orderCount != triangleCount)
+        return false;
+    std::vector<bool> ordered(triangles.size(), false);
+    for (int i : order) {
+        if (i < 0 || i >= triangleCount || ordered[i])
+            return false;
+        ordered[i] = true;
+    }
+
+    // Children come after their parent, as Build numbers them, and no node has two parents, so the
+    // nodes form a tree and BackToFront's stack bound holds. Nodes own consecutive ranges of order
+    // in node order, again as Build lays them out, so no triangle is visited twice.
+    std::vector<bool> hasParent(nodes.size(), false);
+    int next = 0;
+    for (int n = 0; n < nodeCount; n++) {
+        const BspNode &node = nodes[n];
+        if (node.first != next || node.count < 0 || node.count > orderCount - next)
+            return false;
+        next += node.count;
+        for (int child : { node.front, node.back }) {
+            if (child == -1)
+                continue;
+            if (child <= n || child >= nodeCount || hasParent[child])
+                return false;
+            hasParent[child] = true;
+        }
+    }
+    return next == orderCount;
+}
+
+void DrawBspTree(Renderer &renderer, const BspTree &tree, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas)
+{
+    FrameArena &arena = FrameArena::ForThread();
+    const ArenaScope scope(arena);
+
+    const int n = static_cast<int>(tree.vertices.size());
+    float *xs = arena.Allocate<float>(n), *ys = arena.Allocate<float>(n), *zs = arena.Allocate<float>(n);
+    float *outX = arena.Allocate<float>(n), *outY = arena.Allocate<float>(n), *outInvZ = arena.Allocate<float>(n);
+    for (int i = 0; i < n; i++) {
+        xs[i] = tree.vertices[i].x;
+        ys[i] = tree.vertices[i].y;
+        zs[i] = tree.vertices[i].z;
+    }
+    TransformProjectVertices(cameraToCanvas * modelToCamera, ViewportMapping(), xs, ys, zs, n, outX, outY, outInvZ);
+
+    // The camera sits at the origin of camera space.
+    const Vector3 eye = modelToCamera.AffineInverse().TransformPoint(Vector3(0, 0, 0));
+    Vector3 *projected = arena.Allocate<Vector3>(3 * tree.triangles.size());
+    PackedColor *colors = arena.Allocate<PackedColor>(tree.triangles.size());
+    int count = 0;
+    tree.BackToFront(eye, [&](int t) {
+        const Triangle &triangle = tree.triangles[t];
+        const int idx[] = { triangle.v0, triangle.v1, triangle.v2 };
+        if (outInvZ[idx[0]] <= 0 || outInvZ[idx[1]] <= 0 || outInvZ[idx[2]] <= 0)
+            return;
+        for (int k = 0; k < 3; k++) {
+            projected[3 * count + k] = Vector3(outX[idx[k]], outY[idx[k]], 0);
+        }
+        colors[count++] = PackedColor(triangle.color);
+    });
+    renderer.DrawBlendedTriangles(projected, colors, count);
+}
@@ -0,0 +1,104 @@
+#pragma once
+
+#include "FrameArena.h"
+#include "Mesh.h"
+#include "Renderer.h"
+
+#include <vector>
+
+// Splitting plane N . p = d, with the triangles lying in it.
+class BspNode
+{
+  public:
+    Vector3 normal;
+    float d;
+    int front, back; // child nodes, -1 when empty
+    int first, count; // range of coplanar triangles in the tree's order array
+};
+
+// Binary space partition of a mesh's triangles, for back-to-front drawing without a depth buffer.
+// Building splits triangles that straddle a plane, so the tree owns its own vertices and triangles.
+// Trees are meant to be built once offline and loaded from disk at run time.
+class BspTree
+{
+  public:
+    BspTree() : splits(0) {}
+
+    // candidates is how many triangles are tried as the splitter at every node; the one that
+    // splits the fewest triangles (then balances best) wins.
+    void Build(const Mesh &mesh, int candidates = 16);
+
+    bool Save(const char *path) const;
+    bool Load(const char *path);
+
+    // Calls visit(triangleIndex) for every triangle, from the farthest from eye to the nearest.
+    // eye is in the mesh's model space.
+    template <typename Visit>
+    void BackToFront(const Vector3 &eye, Visit &&visit) const;
+
+    // Triangles created by splitting during Build.
+    int Splits() const { return splits; }
+
+    std::vector<Vector3> vertices;
+    std::vector<Triangle> triangles;
+    std::vector<BspNode> nodes;
+    std::vector<int> order;
+
+  private:
+    // Triangles still to be built into a subtree, and where to hang it.
+    class BuildTask
+    {
+      public:
+        std::vector<int> indices;
+        int parent; // -1 for the root
+        bool front;
+    };
+
+    // Makes the node for a non-empty set of triangles, sorting those not in its plane into front
+    // and back. Returns the node's index.
+    int BuildNode(std::vector<int> &indices, int candidates, std::vector<int> &front, std::vector<int> &back);
+    // Whether the arrays form a tree that BackToFront and DrawBspTree can walk safely.
+    bool Valid() const;
+    void SplitTriangle(int index, const Vector3 &normal, float d, std::vector<int> &front, std::vector<int> &back);
+
+    int splits;
+};
+
+template <typename Visit>
+void BspTree::BackToFront(const Vector3 &eye, Visit &&visit) const
+{
+    if (nodes.empty())
+        return;
+
+    // In-order walk with an explicit stack, since trees over convex meshes degenerate into long
+    // chains. A negative entry -1 - n means node n's far side is done: draw it, then its near side.
+    // Every pop pushes at most two entries, one of them a finished marker, so the stack never
+    // holds more than two per node.
+    FrameArena &arena = FrameArena::ForThread();
+    const ArenaScope scope(arena);
+    int *stack = arena.Allocate<int>(2 * nodes.size() + 1);
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0) {
+        const int entry = stack[--top];
+        const BspNode &node = nodes[entry >= 0 ? entry : -1 - entry];
+        const bool eyeInFront = node.normal.Dot(eye) >= node.d;
+        const int farSide = eyeInFront ? node.back : node.front;
+        const int nearSide = eyeInFront ? node.front : node.back;
+        if (entry >= 0) {
+            stack[top++] = -1 - entry;
+            if (farSide >= 0)
+                stack[top++] = farSide;
+            continue;
+        }
+        for (int i = node.first; i < node.first + node.count; i++) {
+            visit(order[i]);
+        }
+        if (nearSide >= 0)
+            stack[top++] = nearSide;
+    }
+}
+
+// Draws tree's triangles back to front with DrawBlendedTriangles, using each triangle color's
+// alpha. Triangles reaching behind the camera are skipped.
+void DrawBspTree(Renderer &renderer, const BspTree &tree, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas);
@@ -0,0 +1,277 @@
+#include "Bvh.h"
+
+#include <SDL_assert.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+static const int BVH_LEAF_SIZE = 4;
+static const int SAH_BINS = 16;
+// Deeper than this, nodes split at the median. Each median split halves a node, so fewer than 2^31
+// items get down to leaves of BVH_LEAF_SIZE within 29 more levels, and no leaf lies deeper than
+// Bvh::MAX_DEPTH.
+static const int MAX_SAH_DEPTH = 32;
+static_assert(MAX_SAH_DEPTH + 29 <= Bvh::MAX_DEPTH, "median splits below MAX_SAH_DEPTH must end within Bvh::MAX_DEPTH");
+// Below these sizes a thread costs more than it saves.
+static const int PARALLEL_BUILD_ITEMS = 16384;
+static const int PARALLEL_REFIT_NODES = 16384;
+
+static float Axis(const Vector3 &v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Levels of the tree over which work forks in two, enough to give every hardware thread a subtree.
+static int ParallelDepth()
+{
+    const int threads = static_cast<int>(std::thread::hardware_concurrency());
+    int depth = 0;
+    while ((1 << depth) < threads) {
+        depth++;
+    }
+    return depth;
+}
+
+static double MsSince(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+class BuildInput
+{
+  public:
+    const Aabb *itemBounds;
+    const Vector3 *centers;
+    int *items;
+};
+
+// Sets the node's bounds and, unless it should stay a leaf, reorders its items so that the split
+// falls at mid. The split minimises the surface area heuristic over SAH_BINS buckets per axis.
+static bool PartitionNode(BvhNode &node, const BuildInput &in, int depth, int &mid)
+{
+    SDL_assert(depth <= Bvh::MAX_DEPTH);
+    const int first = node.first, count = node.count;
+    Aabb bounds, centerBounds;
+    for (int i = first; i < first + count; i++) {
+        bounds.Grow(in.itemBounds[in.items[i]]);
+        centerBounds.Grow(in.centers[in.items[i]]);
+    }
+    node.bounds = bounds;
+    if (count <= BVH_LEAF_SIZE)
+        return false;
+
+    int bestAxis = -1, bestBin = 0;
+    float bestCost = FLT_MAX;
+    for (int axis = 0; axis < 3 && depth < MAX_SAH_DEPTH; axis++) {
+        const float lo = Axis(centerBounds.min, axis), extent = Axis(centerBounds.max, axis) - lo;
+        if (extent <= 0)
+            continue;
+        const float scale = SAH_BINS / extent;
+        Aabb bins[SAH_BINS];
+        int counts[SAH_BINS] = {};
+        for (int i = first; i < first + count; i++) {
+            const int b = SDL_min(static_cast<int>((Axis(in.centers[in.items[i]], axis) - lo) * scale), SAH_BINS - 1);
+            counts[b]++;
+            bins[b].Grow(in.itemBounds[in.items[i]]);
+        }
+
+        // Split k puts bins 0..k on the left.
+        float rightArea[SAH_BINS];
+        int rightCount[SAH_BINS];
+        Aabb right;
+        int n = 0;
+        for (int k = SAH_BINS - 1; k > 0; k--) {
+            if (counts[k] > 0)
+                right.Grow(bins[k]);
+            n += counts[k];
+            rightArea[k - 1] = right.SurfaceArea();
+            rightCount[k - 1] = n;
+        }
+        Aabb left;
+        n = 0;
+        for (int k = 0; k < SAH_BINS - 1; k++) {
+            if (counts[k] > 0)
+                left.Grow(bins[k]);
+            n += counts[k];
+            if (n == 0 || rightCount[k] == 0)
+                continue;
+            const float cost = static_cast<float>(n) * left.SurfaceArea() + static_cast<float>(rightCount[k]) * rightArea[k];
+            if (cost < bestCost) {
+                bestCost = cost;
+                bestAxis = axis;
+                bestBin = k;
+            }
+        }
+    }
+
+    int *begin = in.items + first, *end = in.items + first + count;
+    if (bestAxis >= 0) {
+        const float lo = Axis(centerBounds.min, bestAxis);
+        const float scale = SAH_BINS / (Axis(centerBounds.max, bestAxis) - lo);
+        mid = static_cast<int>(std::partition(begin, end, [&](int item) {
+                  return SDL_min(static_cast<int>((Axis(in.centers[item], bestAxis) - lo) * scale), SAH_BINS - 1) <= bestBin;
+              }) - in.items);
+        return true;
+    }
+
+    // Every centre in one spot, or too deep: median along the longest axis.
+    const Vector3 extent = centerBounds.max - centerBounds.min;
+    const int axis = extent.x >= extent.y && extent.x >= extent.z ? 0 : extent.y >= extent.z ? 1 : 2;
+    mid = first + count / 2;
+    std::nth_element(begin, in.items + mid, end, [&](int a, int b) { return Axis(in.centers[a], axis) < Axis(in.centers[b], axis); });
+    return true;
+}
+
+static void SplitNode(std::vector<BvhNode> &nodes, int nodeIndex, const BuildInput &in, int depth)
+{
+    int mid;
+    if (!PartitionNode(nodes[nodeIndex], in, depth, mid))
+        return;
+
+    const int first = nodes[nodeIndex].first, count = nodes[nodeIndex].count;
+    const int left = static_cast<int>(nodes.size());
+    BvhNode child;
+    child.first = first;
+    child.count = mid - first;
+    nodes.push_back(child);
+    child.first = mid;
+    child.count = first + count - mid;
+    nodes.push_back(child);
+    // push_back may have moved the node array.
+    nodes[nodeIndex].first = left;
+    nodes[nodeIndex].count = 0;
+
+    SplitNode(nodes, left, in, depth + 1);
+    SplitNode(nodes, left + 1, in, depth + 1);
+}
+
+// Copies a subtree built on its own into nodes: its root into slot, the rest onto the end.
+static void Attach(std::vector<BvhNode> &nodes, const std::vector<BvhNode> &subtree, int slot)
+{
+    // Subtree node j > 0 lands at base + j.
+    const int base = static_cast<int>(nodes.size()) - 1;
+    for (size_t j = 0; j < subtree.size(); j++) {
+        BvhNode node = subtree[j];
+        if (node.count == 0)
+            node.first += base;
+        if (j == 0)
+            nodes[slot] = node;
+        else
+            nodes.push_back(node);
+    }
+}
+
+// Builds the tree over items[first .. first + count) into the empty nodes, root first. The top
+// parallelDepth levels build their two halves on two threads.
+static void BuildSubtree(std::vector<BvhNode> &nodes, int first, int count, const BuildInput &in, int depth, int parallelDepth)
+{
+    BvhNode root;
+    root.first = first;
+    root.count = count;
+    nodes.push_back(root);
+    if (parallelDepth <= 0 || count < PARALLEL_BUILD_ITEMS) {
+        nodes.reserve(2 * count);
+        SplitNode(nodes, 0, in, depth);
+        return;
+    }
+
+    int mid;
+    if (!PartitionNode(nodes[0], in, depth, mid))
+        return;
+    std::vector<BvhNode> left, right;
+    std::thread leftBuilder([&] { BuildSubtree(left, first, mid - first, in, depth + 1, parallelDepth - 1); });
+    BuildSubtree(right, mid, first + count - mid, in, depth + 1, parallelDepth - 1);
+    leftBuilder.join();
+
+    nodes.reserve(1 + left.size() + right.size());
+    nodes[0].first = 1;
+    nodes[0].count = 0;
+    nodes.resize(3);
+    Attach(nodes, left, 1);
+    Attach(nodes, right, 2);
+}
+
+void Bvh::Build(const Aabb *itemBounds, int count)
+{
+    nodes.clear();
+    items.resize(count);
+    std::vector<Vector3> centers(count);
+    for (int i = 0; i < count; i++) {
+        items[i] = i;
+        centers[i] = itemBounds[i].Center();
+    }
+    builtCost = 0;
+    if (count == 0)
+        return;
+
+    BuildInput in;
+    in.itemBounds = itemBounds;
+    in.centers = centers.data();
+    in.items = items.data();
+    BuildSubtree(nodes, 0, count, in, 0, ParallelDepth());
+    builtCost = SahCost();
+}
+
+Aabb Bvh::RefitNode(int index, const Aabb *itemBounds, int parallelDepth)
+{
+    BvhNode &node = nodes[index];
+    Aabb bounds;
+    if (node.count > 0) {
+        for (int i = node.first; i < node.first + node.count; i++) {
+            bounds.Grow(itemBounds[items[i]]);
+        }
+    } else if (parallelDepth > 0) {
+        Aabb left;
+        std::thread leftRefit([&] { left = RefitNode(node.first, itemBounds, parallelDepth - 1); });
+        bounds = RefitNode(node.first + 1, itemBounds, parallelDepth - 1);
+        leftRefit.join();
+        bounds.Grow(left);
+    } else {
+        bounds = RefitNode(node.first, itemBounds, 0);
+        bounds.Grow(RefitNode(node.first + 1, itemBounds, 0));
+    }
+    node.bounds = bounds;
+    return bounds;
+}
+
+void Bvh::Refit(const Aabb *itemBounds)
+{
+    if (!nodes.empty())
+        RefitNode(0, itemBounds, static_cast<int>(nodes.size()) >= PARALLEL_REFIT_NODES ? ParallelDepth() : 0);
+}
+
+float Bvh::SahCost() const
+{
+    if (nodes.empty())
+        return 0.f;
+    float cost = 0;
+    for (const BvhNode &node : nodes) {
+        cost += node.bounds.SurfaceArea() * (node.count > 0 ? static_cast<float>(node.count) : 1.f);
+    }
+    const float rootArea = nodes[0].bounds.SurfaceArea();
+    return rootArea > 0 ? cost / rootArea : static_cast<float>(items.size());
+}
+
+const BvhUpdateStats &Bvh::Update(const Aabb *itemBounds, int count, float rebuildThreshold)
+{
+    lastUpdate = BvhUpdateStats();
+    if (count != static_cast<int>(items.size()) || nodes.empty()) {
+        const auto start = std::chrono::steady_clock::now();
+        Build(itemBounds, count);
+        lastUpdate.rebuilt = true;
+        lastUpdate.buildMs = MsSince(start);
+        return lastUpdate;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    Refit(itemBounds);
+    lastUpdate.costRatio = builtCost > 0 ? SahCost() / builtCost : 1.f;
+    lastUpdate.refitMs = MsSince(start);
+    if (lastUpdate.costRatio > rebuildThreshold) {
+        start = std::chrono::steady_clock::now();
+        Build(itemBounds, count);
+        lastUpdate.rebuilt = true;
+        lastUpdate.buildMs = MsSince(start);
+    }
+    return lastUpdate;
+}
@@ -0,0 +1,168 @@
+#pragma once
+
+#include "Vector.h"
+
+#include <SDL_stdinc.h>
+#include <cfloat>
+#include <vector>
+
+class Aabb
+{
+  public:
+    Aabb() : min(FLT_MAX, FLT_MAX, FLT_MAX), max(-FLT_MAX, -FLT_MAX, -FLT_MAX) {}
+    Aabb(const Vector3 &lo, const Vector3 &hi) : min(lo), max(hi) {}
+
+    static Aabb OfSphere(const Vector3 &center, float radius)
+    {
+        return Aabb(center - Vector3(radius, radius, radius), center + Vector3(radius, radius, radius));
+    }
+
+    void Grow(const Vector3 &p)
+    {
+        min = Vector3(SDL_min(min.x, p.x), SDL_min(min.y, p.y), SDL_min(min.z, p.z));
+        max = Vector3(SDL_max(max.x, p.x), SDL_max(max.y, p.y), SDL_max(max.z, p.z));
+    }
+
+    void Grow(const Aabb &b)
+    {
+        Grow(b.min);
+        Grow(b.max);
+    }
+
+    Vector3 Center() const { return (min + max) * 0.5f; }
+
+    float SurfaceArea() const
+    {
+        const Vector3 d = max - min;
+        return d.x < 0 ? 0.f : 2.f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
+    // Box around the eight transformed corners.
+    Aabb Transformed(const Matrix4 &transform) const
+    {
+        Aabb r;
+        for (int i = 0; i < 8; i++) {
+            r.Grow(transform.TransformPoint(Vector3(i & 1 ? max.x : min.x, i & 2 ? max.y : min.y, i & 4 ? max.z : min.z)));
+        }
+        return r;
+    }
+
+    // Slab test of the ray O + t D, with invD = 1 / D per component, against [tmin, tmax].
+    bool IntersectRay(const Vector3 &O, const Vector3 &invD, float tmin, float tmax) const
+    {
+        for (int axis = 0; axis < 3; axis++) {
+            const float o = axis == 0 ? O.x : axis == 1 ? O.y : O.z;
+            const float inv = axis == 0 ? invD.x : axis == 1 ? invD.y : invD.z;
+            const float lo = axis == 0 ? min.x : axis == 1 ? min.y : min.z;
+            const float hi = axis == 0 ? max.x : axis == 1 ? max.y : max.z;
+            float t0 = (lo - o) * inv, t1 = (hi - o) * inv;
+            if (t0 > t1) {
+                const float t = t0;
+                t0 = t1;
+                t1 = t;
+            }
+            tmin = SDL_max(tmin, t0);
+            tmax = SDL_min(tmax, t1);
+            if (tmin > tmax)
+                return false;
+        }
+        return true;
+    }
+
+    Vector3 min, max;
+};
+
+// Interior nodes have count == 0 and their children at first and first + 1; leaves own
+// items[first .. first + count).
+class BvhNode
+{
+  public:
+    Aabb bounds;
+    int first;
+    int count;
+};
+
+// What the last Bvh::Update did, and how long it took.
+class BvhUpdateStats
+{
+  public:
+    BvhUpdateStats() : rebuilt(false), refitMs(0), buildMs(0), costRatio(1) {}
+
+    bool rebuilt;
+    double refitMs, buildMs;
+    float costRatio; // SahCost() after the refit over its value straight after the last build
+};
+
+// Binary bounding volume hierarchy over items given only by their boxes. The same structure serves
+// as the bottom level over a sphere set and as the top level over instances.
+//
+// Build splits with a binned surface area heuristic and, for large inputs, builds the subtrees on
+// separate threads. For items that move, Update refits the existing tree, which is far cheaper, and
+// only rebuilds once the refitted boxes have grown loose enough to slow traversal noticeably.
+class Bvh
+{
+  public:
+    // Deepest level Build puts a leaf at, the root being level 0. Traverse's stack and WideBvh's
+    // are sized from it.
+    static const int MAX_DEPTH = 61;
+
+    Bvh() : builtCost(0) {}
+
+    void Build(const Aabb *itemBounds, int count);
+
+    // Recomputes every node's box bottom-up from the items' new boxes, keeping the tree's shape.
+    // Large trees are refitted on several threads.
+    void Refit(const Aabb *itemBounds);
+
+    // For items that have moved: refits, then rebuilds if that left SahCost more than
+    // rebuildThreshold times what it was after the last build. A different count always rebuilds.
+    const BvhUpdateStats &Update(const Aabb *itemBounds, int count, float rebuildThreshold = 1.5f);
+    const BvhUpdateStats &LastUpdate() const { return lastUpdate; }
+
+    // Expected cost of a ray that hits the root: node visits plus item tests, each weighted by the
+    // chance of reaching it, which is its box's surface area over the root's.
+    float SahCost() const;
+
+    // Calls hit(item, tmax) for every item in a leaf the ray O + t D reaches within [tmin, tmax],
+    // nearer child first. hit may shrink tmax to prune the rest of the walk.
+    template <typename Hit>
+    void Traverse(const Vector3 &O, const Vector3 &D, float tmin, float &tmax, Hit &&hit) const
+    {
+        if (nodes.empty())
+            return;
+        const Vector3 invD(1.f / D.x, 1.f / D.y, 1.f / D.z);
+        // A node at level d leaves at most one sibling per level above it on the stack.
+        int stack[MAX_DEPTH + 1];
+        int top = 0;
+        stack[top++] = 0;
+        while (top > 0) {
+            const BvhNode &node = nodes[stack[--top]];
+            if (!node.bounds.IntersectRay(O, invD, tmin, tmax))
+                continue;
+            if (node.count > 0) {
+                for (int i = node.first; i < node.first + node.count; i++) {
+                    hit(items[i], tmax);
+                }
+                continue;
+            }
+            // Push the far child first so the near one is visited first and shrinks tmax sooner.
+            const BvhNode &left = nodes[node.first];
+            const BvhNode &right = nodes[node.first + 1];
+            const bool leftNear = (left.bounds.Center() - O).Dot(D) <= (right.bounds.Center() - O).Dot(D);
+            stack[top++] = leftNear ? node.first + 1 : node.first;
+            stack[top++] = leftNear ? node.first : node.first + 1;
+        }
+    }
+
+    size_t MemoryBytes() const { return nodes.size() * sizeof(BvhNode) + items.size() * sizeof(int); }
+    const std::vector<BvhNode> &Nodes() const { return nodes; }
+    const std::vector<int> &Items() const { return items; }
+
+  private:
+    Aabb RefitNode(int index, const Aabb *itemBounds, int parallelDepth);
+
+    std::vector<BvhNode> nodes;
+    std::vector<int> items;
+    float builtCost;
+    BvhUpdateStats lastUpdate;
+};
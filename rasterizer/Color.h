@@ -1,4 +1,7 @@
 #pragma once
+
+#include <SDL_stdinc.h>
+
 class Color
 {
   public:
@@ -16,5 +19,56 @@ class Color
         return { r + color.r, g + color.g, b + color.b, a + color.a };
     }
 
+    bool operator==(const Color &color) const
+    {
+        return r == color.r && g == color.g && b == color.b && a == color.a;
+    }
+
     int r, g, b, a;
 };
+
+// Color stored as four bytes with red in the lowest one, the layout of SDL_PIXELFORMAT_ABGR8888
+// and of the software framebuffer. Channels saturate at 0 and 255 instead of wrapping.
+class PackedColor
+{
+  public:
+    PackedColor() : value(0) {}
+    explicit PackedColor(Uint32 v) : value(v) {}
+    PackedColor(int red, int green, int blue) : PackedColor(Color(red, green, blue)) {}
+    PackedColor(int red, int green, int blue, int alpha) : PackedColor(Color(red, green, blue, alpha)) {}
+    PackedColor(const Color &color)
+        : value(Clamp(color.r) | (Clamp(color.g) << 8) | (Clamp(color.b) << 16) | (Clamp(color.a) << 24))
+    {
+    }
+
+    int R() const { return value & 0xff; }
+    int G() const { return (value >> 8) & 0xff; }
+    int B() const { return (value >> 16) & 0xff; }
+    int A() const { return value >> 24; }
+
+    Color ToColor() const { return { R(), G(), B(), A() }; }
+
+    // Alpha is left untouched.
+    PackedColor Scaled(float f) const
+    {
+        return PackedColor((Clamp(static_cast<int>(f * static_cast<float>(R()))) | (Clamp(static_cast<int>(f * static_cast<float>(G()))) << 8) |
+                            (Clamp(static_cast<int>(f * static_cast<float>(B()))) << 16) | (value & 0xff000000u)));
+    }
+
+    // this * (1 - t) + c * t, all four channels at once: red/blue and green/alpha are blended as
+    // two pairs of 16-bit lanes inside one 32-bit word.
+    PackedColor Lerp(PackedColor c, float t) const
+    {
+        const Uint32 w = static_cast<Uint32>(SDL_clamp(t, 0.f, 1.f) * 256.f);
+        const Uint32 rb = ((value & 0x00ff00ffu) * (256 - w) + (c.value & 0x00ff00ffu) * w) >> 8;
+        const Uint32 ga = (((value >> 8) & 0x00ff00ffu) * (256 - w) + ((c.value >> 8) & 0x00ff00ffu) * w) >> 8;
+        return PackedColor((rb & 0x00ff00ffu) | ((ga & 0x00ff00ffu) << 8));
+    }
+
+    bool operator==(const PackedColor &c) const { return value == c.value; }
+
+    Uint32 value;
+
+  private:
+    static Uint32 Clamp(int c) { return static_cast<Uint32>(c < 0 ? 0 : (c > 255 ? 255 : c)); }
+};
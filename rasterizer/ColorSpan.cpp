@@ -0,0 +1,25 @@
+#include "ColorSpan.h"
+#include "Simd.h"
+
+void ScaleSpan(PackedColor color, const float *factors, Uint32 *dst, int count)
+{
+    int i = 0;
+#if defined(RENDER_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32(static_cast<int>(0xff000000u));
+    // The color's four channels as floats, scaled by one factor per pixel.
+    const __m128 channels = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_unpacklo_epi8(_mm_cvtsi32_si128(static_cast<int>(color.value)), zero), zero));
+    for (; i + 4 <= count; i += 4) {
+        const __m128 f = _mm_loadu_ps(factors + i);
+        const __m128i p0 = _mm_cvttps_epi32(_mm_mul_ps(channels, _mm_shuffle_ps(f, f, _MM_SHUFFLE(0, 0, 0, 0))));
+        const __m128i p1 = _mm_cvttps_epi32(_mm_mul_ps(channels, _mm_shuffle_ps(f, f, _MM_SHUFFLE(1, 1, 1, 1))));
+        const __m128i p2 = _mm_cvttps_epi32(_mm_mul_ps(channels, _mm_shuffle_ps(f, f, _MM_SHUFFLE(2, 2, 2, 2))));
+        const __m128i p3 = _mm_cvttps_epi32(_mm_mul_ps(channels, _mm_shuffle_ps(f, f, _MM_SHUFFLE(3, 3, 3, 3))));
+        const __m128i packed = _mm_packus_epi16(_mm_packs_epi32(p0, p1), _mm_packs_epi32(p2, p3));
+        _mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_or_si128(packed, opaque));
+    }
+#endif
+    for (; i < count; i++) {
+        dst[i] = color.Scaled(factors[i]).value | 0xff000000u;
+    }
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "Color.h"
+
+// Span kernels over packed pixels, vectorized with SSE2 when available. Results saturate per
+// channel.
+
+// dst[i] = color * factors[i], with the alpha channel forced opaque.
+void ScaleSpan(PackedColor color, const float *factors, Uint32 *dst, int count);
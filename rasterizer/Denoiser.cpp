@@ -0,0 +1,182 @@
+#include "Denoiser.h"
+#include "Simd.h"
+
+#include <SDL_stdinc.h>
+#include <functional>
+#include <math.h>
+#include <thread>
+
+// B3-spline taps, the same along x and y.
+static const float KERNEL[5] = { 1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f };
+
+// One pass's tap spacing and the reciprocals of its squared sigmas.
+class PassSettings
+{
+  public:
+    int step;
+    float color, normal, plane, albedo;
+};
+
+static void FilterPixel(const HdrImage &in, HdrImage &out, const GBuffer &g, const PassSettings &pass, int x, int y)
+{
+    const int w = in.width, i = y * w + x;
+    const float cr = in.red[i], cg = in.green[i], cb = in.blue[i];
+    const float nx = g.normalX[i], ny = g.normalY[i], nz = g.normalZ[i];
+    const float px = g.positionX[i], py = g.positionY[i], pz = g.positionZ[i];
+    const float ar = g.albedoR[i], ag = g.albedoG[i], ab = g.albedoB[i];
+    const float plane = pass.plane / SDL_max(pz * pz, 1e-6f);
+
+    float sr = 0, sg = 0, sb = 0, sw = 0;
+    for (int ky = -2; ky <= 2; ky++) {
+        const int qy = y + ky * pass.step;
+        if (qy < 0 || qy >= in.height)
+            continue;
+        for (int kx = -2; kx <= 2; kx++) {
+            const int qx = x + kx * pass.step;
+            if (qx < 0 || qx >= w)
+                continue;
+            const int q = qy * w + qx;
+            const float dr = in.red[q] - cr, dg = in.green[q] - cg, db = in.blue[q] - cb;
+            const float dnx = g.normalX[q] - nx, dny = g.normalY[q] - ny, dnz = g.normalZ[q] - nz;
+            const float off = nx * (g.positionX[q] - px) + ny * (g.positionY[q] - py) + nz * (g.positionZ[q] - pz);
+            const float dar = g.albedoR[q] - ar, dag = g.albedoG[q] - ag, dab = g.albedoB[q] - ab;
+            const float e = (dr * dr + dg * dg + db * db) * pass.color + (dnx * dnx + dny * dny + dnz * dnz) * pass.normal +
+                            off * off * plane + (dar * dar + dag * dag + dab * dab) * pass.albedo;
+            const float weight = KERNEL[ky + 2] * KERNEL[kx + 2] * expf(-e);
+            sr += weight * in.red[q];
+            sg += weight * in.green[q];
+            sb += weight * in.blue[q];
+            sw += weight;
+        }
+    }
+    // The centre tap always has weight, so sw > 0.
+    out.red[i] = sr / sw;
+    out.green[i] = sg / sw;
+    out.blue[i] = sb / sw;
+}
+
+#if defined(RENDER_SSE2)
+// e^x for x <= 0: 2^(x log2 e) split into an exponent and a degree 5 polynomial on [0, 1), good to
+// about 1e-4, which is plenty for a weight.
+static inline __m128 ExpNegative(__m128 x)
+{
+    const __m128 t = _mm_mul_ps(_mm_max_ps(x, _mm_set1_ps(-80.f)), _mm_set1_ps(1.44269504f));
+    __m128 whole = _mm_cvtepi32_ps(_mm_cvttps_epi32(t));
+    whole = _mm_sub_ps(whole, _mm_and_ps(_mm_cmpgt_ps(whole, t), _mm_set1_ps(1.f)));
+    const __m128 f = _mm_sub_ps(t, whole);
+    __m128 p = _mm_set1_ps(1.3333558e-3f);
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(9.6181291e-3f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(5.5504109e-2f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(2.4022651e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(6.9314718e-1f));
+    p = _mm_add_ps(_mm_mul_ps(p, f), _mm_set1_ps(1.f));
+    const __m128i exponent = _mm_slli_epi32(_mm_add_epi32(_mm_cvttps_epi32(whole), _mm_set1_epi32(127)), 23);
+    return _mm_mul_ps(p, _mm_castsi128_ps(exponent));
+}
+
+static inline __m128 SquaredDistance(__m128 ax, __m128 ay, __m128 az, __m128 bx, __m128 by, __m128 bz)
+{
+    const __m128 dx = _mm_sub_ps(ax, bx), dy = _mm_sub_ps(ay, by), dz = _mm_sub_ps(az, bz);
+    return _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+}
+
+// FilterPixel for pixels x to x + 3, whose taps must all lie inside the row.
+static void FilterQuad(const HdrImage &in, HdrImage &out, const GBuffer &g, const PassSettings &pass, int x, int y)
+{
+    const int w = in.width, i = y * w + x;
+    const float *red = in.red.data(), *green = in.green.data(), *blue = in.blue.data();
+    const float *nX = g.normalX.data(), *nY = g.normalY.data(), *nZ = g.normalZ.data();
+    const float *pX = g.positionX.data(), *pY = g.positionY.data(), *pZ = g.positionZ.data();
+    const float *aR = g.albedoR.data(), *aG = g.albedoG.data(), *aB = g.albedoB.data();
+
+    const __m128 cr = _mm_loadu_ps(red + i), cg = _mm_loadu_ps(green + i), cb = _mm_loadu_ps(blue + i);
+    const __m128 nx = _mm_loadu_ps(nX + i), ny = _mm_loadu_ps(nY + i), nz = _mm_loadu_ps(nZ + i);
+    const __m128 px = _mm_loadu_ps(pX + i), py = _mm_loadu_ps(pY + i), pz = _mm_loadu_ps(pZ + i);
+    const __m128 ar = _mm_loadu_ps(aR + i), ag = _mm_loadu_ps(aG + i), ab = _mm_loadu_ps(aB + i);
+    const __m128 color = _mm_set1_ps(pass.color), normal = _mm_set1_ps(pass.normal), albedo = _mm_set1_ps(pass.albedo);
+    const __m128 plane = _mm_div_ps(_mm_set1_ps(pass.plane), _mm_max_ps(_mm_mul_ps(pz, pz), _mm_set1_ps(1e-6f)));
+
+    __m128 sr = _mm_setzero_ps(), sg = _mm_setzero_ps(), sb = _mm_setzero_ps(), sw = _mm_setzero_ps();
+    for (int ky = -2; ky <= 2; ky++) {
+        const int qy = y + ky * pass.step;
+        if (qy < 0 || qy >= in.height)
+            continue;
+        for (int kx = -2; kx <= 2; kx++) {
+            const int q = qy * w + x + kx * pass.step;
+            const __m128 qr = _mm_loadu_ps(red + q), qg = _mm_loadu_ps(green + q), qb = _mm_loadu_ps(blue + q);
+            const __m128 dc = SquaredDistance(qr, qg, qb, cr, cg, cb);
+            const __m128 dn = SquaredDistance(_mm_loadu_ps(nX + q), _mm_loadu_ps(nY + q), _mm_loadu_ps(nZ + q), nx, ny, nz);
+            const __m128 off = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, _mm_sub_ps(_mm_loadu_ps(pX + q), px)),
+                                                     _mm_mul_ps(ny, _mm_sub_ps(_mm_loadu_ps(pY + q), py))),
+                                          _mm_mul_ps(nz, _mm_sub_ps(_mm_loadu_ps(pZ + q), pz)));
+            const __m128 da = SquaredDistance(_mm_loadu_ps(aR + q), _mm_loadu_ps(aG + q), _mm_loadu_ps(aB + q), ar, ag, ab);
+            const __m128 e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dc, color), _mm_mul_ps(dn, normal)),
+                                        _mm_add_ps(_mm_mul_ps(_mm_mul_ps(off, off), plane), _mm_mul_ps(da, albedo)));
+            const __m128 weight = _mm_mul_ps(_mm_set1_ps(KERNEL[ky + 2] * KERNEL[kx + 2]), ExpNegative(_mm_sub_ps(_mm_setzero_ps(), e)));
+            sr = _mm_add_ps(sr, _mm_mul_ps(weight, qr));
+            sg = _mm_add_ps(sg, _mm_mul_ps(weight, qg));
+            sb = _mm_add_ps(sb, _mm_mul_ps(weight, qb));
+            sw = _mm_add_ps(sw, weight);
+        }
+    }
+    _mm_storeu_ps(out.red.data() + i, _mm_div_ps(sr, sw));
+    _mm_storeu_ps(out.green.data() + i, _mm_div_ps(sg, sw));
+    _mm_storeu_ps(out.blue.data() + i, _mm_div_ps(sb, sw));
+}
+#endif
+
+static void FilterRows(const HdrImage &in, HdrImage &out, const GBuffer &g, const PassSettings &pass, int firstRow, int endRow)
+{
+    const int w = in.width, reach = 2 * pass.step;
+    for (int y = firstRow; y < endRow; y++) {
+        int x = 0;
+#if defined(RENDER_SSE2)
+        // Near the left and right edges some taps fall outside the row; those pixels go scalar.
+        for (; x < w && x < reach; x++) {
+            FilterPixel(in, out, g, pass, x, y);
+        }
+        for (; x + 3 + reach < w; x += 4) {
+            FilterQuad(in, out, g, pass, x, y);
+        }
+#endif
+        for (; x < w; x++) {
+            FilterPixel(in, out, g, pass, x, y);
+        }
+    }
+}
+
+void Denoiser::Filter(const HdrImage &noisy, const GBuffer &guides, HdrImage &out) const
+{
+    if (passes <= 0) {
+        out = noisy;
+        return;
+    }
+
+    // Passes alternate between out and scratch, arranged so that the last one writes out.
+    HdrImage scratch(noisy.width, noisy.height);
+    const int threadCount = SDL_max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    const int rowsPerThread = (noisy.height + threadCount - 1) / threadCount;
+    const HdrImage *source = &noisy;
+    for (int p = 0; p < passes; p++) {
+        HdrImage &target = (passes - 1 - p) % 2 == 0 ? out : scratch;
+        const float sigma = sigmaColor / static_cast<float>(1 << p);
+        PassSettings pass;
+        pass.step = 1 << p;
+        pass.color = 1.f / (sigma * sigma);
+        pass.normal = 1.f / (sigmaNormal * sigmaNormal);
+        pass.plane = 1.f / (sigmaPlane * sigmaPlane);
+        pass.albedo = 1.f / (sigmaAlbedo * sigmaAlbedo);
+
+        std::vector<std::thread> threads;
+        for (int t = 1; t < threadCount; t++) {
+            const int first = t * rowsPerThread;
+            if (first < noisy.height)
+                threads.emplace_back(FilterRows, std::cref(*source), std::ref(target), std::cref(guides), std::cref(pass), first, SDL_min(first + rowsPerThread, noisy.height));
+        }
+        FilterRows(*source, target, guides, pass, 0, SDL_min(rowsPerThread, noisy.height));
+        for (std::thread &t : threads) {
+            t.join();
+        }
+        source = &target;
+    }
+}
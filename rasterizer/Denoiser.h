@@ -0,0 +1,55 @@
+#pragma once
+
+#include <vector>
+
+// A float RGB image stored as one plane per channel, top row first. Unlike PackedColor it keeps the
+// unrounded, unclamped averages of a supersampled render.
+class HdrImage
+{
+  public:
+    HdrImage(int w, int h) : width(w), height(h), red(w * h), green(w * h), blue(w * h) {}
+
+    int width, height;
+    std::vector<float> red, green, blue;
+};
+
+// Where each pixel's primary ray landed, in planes like HdrImage: the unit surface normal (zero where
+// the ray missed), the camera-space hit point, whose z is the pixel's depth, and the surface albedo
+// in the same units as the image.
+class GBuffer
+{
+  public:
+    GBuffer(int w, int h)
+        : width(w), height(h), normalX(w * h), normalY(w * h), normalZ(w * h), positionX(w * h), positionY(w * h),
+          positionZ(w * h), albedoR(w * h), albedoG(w * h), albedoB(w * h)
+    {
+    }
+
+    int width, height;
+    std::vector<float> normalX, normalY, normalZ;
+    std::vector<float> positionX, positionY, positionZ;
+    std::vector<float> albedoR, albedoG, albedoB;
+};
+
+// Edge-avoiding a-trous wavelet filter (Dammertz et al. 2010) for renders with few samples per pixel.
+// Each pass blurs with a 5x5 B-spline kernel whose taps are 2^pass pixels apart, and weights every tap
+// by how closely it matches the centre pixel in colour, normal, plane and albedo, so noise is averaged
+// within a surface but not across its edges. Two passes reach 6 pixels out at 25 taps a pixel each.
+//
+// The sigmas are the differences at which a tap's weight has fallen to 1/e. sigmaColor is in the
+// image's units and halves every pass as the image gets smoother; sigmaPlane is the distance from the
+// centre pixel's tangent plane, relative to its depth. The defaults were tuned on the soft-shadowed
+// spheres: wider or more passes only smear the shadows. What error remains is mostly at silhouettes,
+// where jittered samples straddle surfaces that the guides, from one ray per pixel, cannot see.
+class Denoiser
+{
+  public:
+    Denoiser() : passes(2), sigmaColor(64.f), sigmaNormal(0.05f), sigmaPlane(0.005f), sigmaAlbedo(24.f) {}
+
+    // Filters noisy into out, which must be the same size as it and guides. Rows are split across
+    // every hardware thread.
+    void Filter(const HdrImage &noisy, const GBuffer &guides, HdrImage &out) const;
+
+    int passes;
+    float sigmaColor, sigmaNormal, sigmaPlane, sigmaAlbedo;
+};
@@ -0,0 +1,62 @@
+#include "FrameArena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+FrameArena::FrameArena(size_t blockSize) : current(0), offset(0), blockSize(blockSize)
+{
+}
+
+FrameArena::~FrameArena()
+{
+    for (const Block &b : blocks) {
+        free(b.data);
+    }
+}
+
+void *FrameArena::AllocateBytes(size_t bytes, size_t alignment)
+{
+    // Try the current block, then any later block left over from a bigger frame, and only then
+    // grow. Skipped blocks are simply unused until the next rewind or reset.
+    for (; current < blocks.size(); current++, offset = 0) {
+        const Block &b = blocks[current];
+        const uintptr_t base = reinterpret_cast<uintptr_t>(b.data);
+        const size_t aligned = ((base + offset + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1)) - base;
+        if (aligned + bytes <= b.size) {
+            offset = aligned + bytes;
+            return b.data + aligned;
+        }
+    }
+
+    Block b;
+    b.size = bytes + alignment > blockSize ? bytes + alignment : blockSize;
+    b.data = static_cast<char *>(malloc(b.size));
+    blocks.push_back(b);
+    current = blocks.size() - 1;
+    offset = 0;
+    return AllocateBytes(bytes, alignment);
+}
+
+size_t FrameArena::BytesInUse() const
+{
+    size_t used = offset;
+    for (size_t i = 0; i < current && i < blocks.size(); i++) {
+        used += blocks[i].size;
+    }
+    return used;
+}
+
+size_t FrameArena::Capacity() const
+{
+    size_t capacity = 0;
+    for (const Block &b : blocks) {
+        capacity += b.size;
+    }
+    return capacity;
+}
+
+FrameArena &FrameArena::ForThread()
+{
+    static thread_local FrameArena arena;
+    return arena;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// Bump allocator for per-frame temporaries (edge tables, scanline buffers, ray queues, tile bins).
+// Allocation is a pointer bump and nothing is freed individually: Reset() drops the whole frame in
+// O(1), and ArenaScope hands back whatever a block of code used. Memory comes in blocks that are
+// kept across frames, so once the arena has grown to a frame's peak it never touches the heap.
+class FrameArena
+{
+  public:
+    explicit FrameArena(size_t blockSize = 256 * 1024);
+    ~FrameArena();
+
+    FrameArena(const FrameArena &) = delete;
+    FrameArena &operator=(const FrameArena &) = delete;
+
+    // Uninitialized room for count objects; only meant for trivially destructible types.
+    template <typename T>
+    T *Allocate(size_t count)
+    {
+        return static_cast<T *>(AllocateBytes(count * sizeof(T), alignof(T)));
+    }
+
+    void *AllocateBytes(size_t bytes, size_t alignment);
+
+    // A position to rewind to, releasing everything allocated after it.
+    class Marker
+    {
+      public:
+        size_t block, offset;
+    };
+
+    Marker Mark() const
+    {
+        Marker m = { current, offset };
+        return m;
+    }
+
+    void Rewind(const Marker &m)
+    {
+        current = m.block;
+        offset = m.offset;
+    }
+
+    void Reset() { current = offset = 0; }
+
+    size_t BytesInUse() const;
+    size_t Capacity() const;
+
+    // The calling thread's arena. Renderers reset it when they present a frame, so anything
+    // allocated from it must not be kept past Present().
+    static FrameArena &ForThread();
+
+  private:
+    class Block
+    {
+      public:
+        char *data;
+        size_t size;
+    };
+
+    std::vector<Block> blocks;
+    size_t current, offset;
+    size_t blockSize;
+};
+
+// Rewinds the arena to where it was when the scope was entered.
+class ArenaScope
+{
+  public:
+    explicit ArenaScope(FrameArena &a) : arena(a), mark(a.Mark()) {}
+    ~ArenaScope() { arena.Rewind(mark); }
+
+    ArenaScope(const ArenaScope &) = delete;
+    ArenaScope &operator=(const ArenaScope &) = delete;
+
+  private:
+    FrameArena &arena;
+    FrameArena::Marker mark;
+};
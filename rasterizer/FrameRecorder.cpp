@@ -0,0 +1,213 @@
+#define MSF_GIF_IMPL
+#include "FrameRecorder.h"
+
+#include <string.h>
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+static size_t WriteToFile(const void *buffer, size_t size, size_t count, void *stream)
+{
+    return fwrite(buffer, size, count, static_cast<FILE *>(stream));
+}
+
+static bool EndsWith(const char *s, const char *suffix)
+{
+    const size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+FrameRecorder::FrameRecorder(int w, int h)
+    : width(w), height(h), format(rgb), file(nullptr), centisecondsPerFrame(4), writeFailed(false), quit(false),
+      encoded(0), peakQueued(0)
+{
+    memset(&gifState, 0, sizeof(gifState));
+}
+
+FrameRecorder::~FrameRecorder()
+{
+    Close();
+}
+
+bool FrameRecorder::Open(const char *path, int framesPerSecond)
+{
+    Close();
+
+    format = EndsWith(path, ".gif") ? gif : EndsWith(path, ".y4m") ? y4m : rgb;
+    if (strcmp(path, "-") == 0) {
+#ifdef _WIN32
+        _setmode(_fileno(stdout), _O_BINARY);
+#endif
+        file = stdout;
+    } else {
+        file = fopen(path, "wb");
+    }
+    if (!file)
+        return false;
+
+    framesPerSecond = SDL_max(framesPerSecond, 1);
+    // GIF delays are whole hundredths of a second.
+    centisecondsPerFrame = SDL_max(100 / framesPerSecond, 1);
+    encoded = 0;
+    peakQueued = 0;
+    writeFailed = false;
+    quit = false;
+
+    if (format == gif) {
+        writeFailed = !msf_gif_begin_to_file(&gifState, width, height, WriteToFile, file);
+    } else if (format == y4m) {
+        // Chroma sited between each 2x2 block of luma samples, as the averaging below produces.
+        writeFailed = fprintf(file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg\n", width, height, framesPerSecond) < 0;
+    }
+
+    thread = std::thread(&FrameRecorder::Run, this);
+    return !writeFailed;
+}
+
+void FrameRecorder::Submit(const Uint32 *pixels)
+{
+    if (!file)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::vector<Uint32> frame;
+        if (!spare.empty()) {
+            frame.swap(spare.back());
+            spare.pop_back();
+        }
+        frame.resize(static_cast<size_t>(width) * height);
+        memcpy(frame.data(), pixels, frame.size() * sizeof(Uint32));
+        queued.push_back(std::move(frame));
+        peakQueued = SDL_max(peakQueued, static_cast<int>(queued.size()));
+    }
+    wake.notify_all();
+}
+
+void FrameRecorder::Close()
+{
+    if (!file)
+        return;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+    }
+    wake.notify_all();
+    thread.join();
+
+    if (format == gif)
+        writeFailed |= !msf_gif_end_to_file(&gifState);
+    if (file == stdout) {
+        fflush(stdout);
+    } else {
+        fclose(file);
+    }
+    file = nullptr;
+    if (writeFailed)
+        fprintf(stderr, "Recording: write failed after %d frames\n", encoded);
+}
+
+int FrameRecorder::FramesEncoded() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return encoded;
+}
+
+int FrameRecorder::PeakQueued() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return peakQueued;
+}
+
+void FrameRecorder::Run()
+{
+    while (true) {
+        std::vector<Uint32> frame;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [this] { return !queued.empty() || quit; });
+            // Quitting still drains the queue, so Close() never loses submitted frames.
+            if (queued.empty())
+                break;
+            frame.swap(queued.front());
+            queued.pop_front();
+        }
+
+        // Encoding happens without the lock, while the next frames are being rendered.
+        Encode(frame);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        spare.push_back(std::move(frame));
+        encoded++;
+    }
+}
+
+void FrameRecorder::Encode(const std::vector<Uint32> &frame)
+{
+    if (writeFailed)
+        return;
+
+    switch (format) {
+    case gif:
+        // ABGR8888 pixels are R, G, B, A bytes in memory on little-endian machines, the order
+        // msf_gif expects.
+        writeFailed = !msf_gif_frame_to_file(&gifState, reinterpret_cast<uint8_t *>(const_cast<Uint32 *>(frame.data())),
+                                             centisecondsPerFrame, 16, width * static_cast<int>(sizeof(Uint32)));
+        break;
+    case y4m:
+        WriteY4mFrame(frame.data());
+        break;
+    default:
+        WriteRgbFrame(frame.data());
+        break;
+    }
+}
+
+// BT.601 studio-range conversion, with chroma averaged over each 2x2 block.
+void FrameRecorder::WriteY4mFrame(const Uint32 *pixels)
+{
+    const int cw = (width + 1) / 2, ch = (height + 1) / 2;
+    scratch.resize(static_cast<size_t>(width) * height + 2 * static_cast<size_t>(cw) * ch);
+    Uint8 *Y = scratch.data();
+    Uint8 *U = Y + static_cast<size_t>(width) * height;
+    Uint8 *V = U + static_cast<size_t>(cw) * ch;
+
+    for (int i = 0; i < width * height; i++) {
+        const int r = pixels[i] & 0xff, g = (pixels[i] >> 8) & 0xff, b = (pixels[i] >> 16) & 0xff;
+        Y[i] = static_cast<Uint8>(16 + ((66 * r + 129 * g + 25 * b + 128) >> 8));
+    }
+    for (int cy = 0; cy < ch; cy++) {
+        const int y0 = 2 * cy, y1 = SDL_min(y0 + 1, height - 1);
+        for (int cx = 0; cx < cw; cx++) {
+            const int x0 = 2 * cx, x1 = SDL_min(x0 + 1, width - 1);
+            const Uint32 block[] = { pixels[y0 * width + x0], pixels[y0 * width + x1], pixels[y1 * width + x0], pixels[y1 * width + x1] };
+            int r = 0, g = 0, b = 0;
+            for (Uint32 p : block) {
+                r += p & 0xff;
+                g += (p >> 8) & 0xff;
+                b += (p >> 16) & 0xff;
+            }
+            r = (r + 2) / 4;
+            g = (g + 2) / 4;
+            b = (b + 2) / 4;
+            U[cy * cw + cx] = static_cast<Uint8>(128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8));
+            V[cy * cw + cx] = static_cast<Uint8>(128 + ((112 * r - 94 * g - 18 * b + 128) >> 8));
+        }
+    }
+
+    writeFailed = fputs("FRAME\n", file) < 0 || fwrite(scratch.data(), 1, scratch.size(), file) != scratch.size();
+}
+
+void FrameRecorder::WriteRgbFrame(const Uint32 *pixels)
+{
+    scratch.resize(3 * static_cast<size_t>(width) * height);
+    Uint8 *out = scratch.data();
+    for (int i = 0; i < width * height; i++) {
+        *out++ = static_cast<Uint8>(pixels[i]);
+        *out++ = static_cast<Uint8>(pixels[i] >> 8);
+        *out++ = static_cast<Uint8>(pixels[i] >> 16);
+    }
+    writeFailed = fwrite(scratch.data(), 1, scratch.size(), file) != scratch.size();
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include "raylib-master/src/external/msf_gif.h"
+
+#include <SDL_stdinc.h>
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <stdio.h>
+#include <thread>
+#include <vector>
+
+// Streams presented frames to a file from a dedicated encoder thread. Submit() copies the frame
+// into a spare buffer and queues it; it never waits for the encoder. When the encoder falls behind,
+// the queue grows instead of dropping frames, so a recording is always complete.
+//
+// The format follows the path's extension: ".gif" is an animated GIF, ".y4m" is YUV4MPEG2 with
+// 4:2:0 chroma, and anything else, including "-" for stdout, is raw interleaved 8-bit RGB that
+// can be piped into an encoder such as ffmpeg -f rawvideo -pix_fmt rgb24.
+class FrameRecorder
+{
+  public:
+    enum Format {gif, y4m, rgb};
+
+    FrameRecorder(int w, int h);
+    ~FrameRecorder();
+
+    // path "-" writes to stdout.
+    bool Open(const char *path, int framesPerSecond);
+
+    // pixels is a framebuffer of SoftwareRenderer::Pixels() layout.
+    void Submit(const Uint32 *pixels);
+
+    // Encodes everything still queued and finishes the file.
+    void Close();
+
+    bool IsOpen() const { return file != nullptr; }
+    int FramesEncoded() const;
+    // Most frames ever waiting for the encoder at once.
+    int PeakQueued() const;
+
+  private:
+    void Run();
+    void Encode(const std::vector<Uint32> &frame);
+    void WriteY4mFrame(const Uint32 *pixels);
+    void WriteRgbFrame(const Uint32 *pixels);
+
+    int width, height;
+    Format format;
+    FILE *file;
+    int centisecondsPerFrame;
+    bool writeFailed;
+
+    std::deque<std::vector<Uint32>> queued;
+    std::vector<std::vector<Uint32>> spare;
+    std::vector<Uint8> scratch;
+    bool quit;
+    int encoded;
+    int peakQueued;
+    MsfGifState gifState;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+    std::thread thread;
+};
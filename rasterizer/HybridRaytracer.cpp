@@ -0,0 +1,177 @@
+#include "HybridRaytracer.h"
+
+#include <cfloat>
+#include <math.h>
+
+// Range of x/z covered by a circle centred at (cx, cz), from its two tangents through the origin.
+// Only valid for circles entirely in front of the origin (cz > r).
+static void TangentSlopes(float cx, float cz, float r, float &lo, float &hi)
+{
+    const float root = r * sqrtf(cx * cx + cz * cz - r * r);
+    const float invDenominator = 1.f / (cz * cz - r * r);
+    lo = (cx * cz - root) * invDenominator;
+    hi = (cx * cz + root) * invDenominator;
+}
+
+bool SphereCanvasBounds(const Sphere &sphere, const RayCamera &camera, int canvasWidth, int canvasHeight, int &x0, int &y0, int &x1, int &y1)
+{
+    const int minX = -canvasWidth / 2, maxX = canvasWidth - 1 - canvasWidth / 2;
+    const int minY = -canvasHeight / 2, maxY = canvasHeight - 1 - canvasHeight / 2;
+    const Vector3 c = sphere.center - camera.origin;
+
+    if (c.z <= sphere.radius) {
+        x0 = minX;
+        x1 = maxX;
+        y0 = minY;
+        y1 = maxY;
+        return true;
+    }
+
+    float xLo, xHi, yLo, yHi;
+    TangentSlopes(c.x, c.z, sphere.radius, xLo, xHi);
+    TangentSlopes(c.y, c.z, sphere.radius, yLo, yHi);
+
+    // A slope s lands on canvas coordinate s * viewportDist * canvas size / viewport size.
+    const float scaleX = camera.viewportDist * static_cast<float>(canvasWidth) / camera.viewportWidth;
+    const float scaleY = camera.viewportDist * static_cast<float>(canvasHeight) / camera.viewportHeight;
+    x0 = SDL_max(static_cast<int>(floorf(xLo * scaleX)) - 1, minX);
+    x1 = SDL_min(static_cast<int>(ceilf(xHi * scaleX)) + 1, maxX);
+    y0 = SDL_max(static_cast<int>(floorf(yLo * scaleY)) - 1, minY);
+    y1 = SDL_min(static_cast<int>(ceilf(yHi * scaleY)) + 1, maxY);
+    return x0 <= x1 && y0 <= y1;
+}
+
+// Nearest of the ray's hits on sphere within [t_min, t_max], tested as ClosestIntersection does.
+static bool NearestHit(Vector3 &O, Vector3 &D, const Sphere &sphere, float t_min, float t_max, float &t)
+{
+    float t1, t2;
+    IntersectRaySphere(O, D, &sphere, t1, t2);
+    bool hit = false;
+    if (t1 >= t_min && t1 <= t_max && t1 < t) {
+        t = t1;
+        hit = true;
+    }
+    if (t2 >= t_min && t2 <= t_max && t2 < t) {
+        t = t2;
+        hit = true;
+    }
+    return hit;
+}
+
+// Pixels around the line where two spheres meet that are traced in full. Four is enough for the
+// meshes HybridRaytracer draws unless spheres cut through each other at a grazing angle.
+static const int ID_BORDER = 4;
+
+// Whether another sphere was drawn within ID_BORDER pixels of framebuffer pixel (x, y). The meshes' depths
+// only approximate their spheres', so where two spheres meet the nearer mesh need not be the nearer
+// sphere.
+static bool BordersOtherSphere(const Uint32 *ids, int w, int h, int x, int y)
+{
+    const Uint32 id = ids[y * w + x] & 0xffffffu;
+    for (int dy = -ID_BORDER; dy <= ID_BORDER; dy++) {
+        for (int dx = -ID_BORDER; dx <= ID_BORDER; dx++) {
+            const int nx = x + dx, ny = y + dy;
+            if (nx < 0 || ny < 0 || nx >= w || ny >= h)
+                continue;
+            const Uint32 other = ids[ny * w + nx] & 0xffffffu;
+            if (other != 0 && other != id)
+                return true;
+        }
+    }
+    return false;
+}
+
+HybridRaytracer::HybridRaytracer() : sphereMesh(Mesh::Sphere(MESH_DIVS, Color())), hullRadius(1), ids(0, 0), primaryTests(0), fallbacks(0)
+{
+    // The mesh's faces are flat polygons with their corners on the unit sphere, so they cut into it.
+    // Pushing every face plane out to distance 1 or more makes the mesh contain the sphere.
+    float nearest = 1.f;
+    for (const Triangle &t : sphereMesh.triangles) {
+        const Vector3 &a = sphereMesh.vertices[t.v0];
+        const Vector3 n = (sphereMesh.vertices[t.v1] - a).Cross(sphereMesh.vertices[t.v2] - a);
+        if (n.Length() > 1e-6f)
+            nearest = SDL_min(nearest, fabsf(n.Dot(a)) / n.Length());
+    }
+    hullRadius = 1.f / nearest;
+    for (Vector3 &v : sphereMesh.vertices) {
+        v = v * hullRadius;
+    }
+}
+
+void HybridRaytracer::Render(Renderer &renderer, const RayCamera &camera, float t_min, float t_max, int recursion_depth)
+{
+    const int w = renderer.Width(), h = renderer.Height();
+    const int left = -w / 2;
+    if (ids.Width() != w || ids.Height() != h)
+        ids = MemoryRenderer(w, h);
+    row.resize(w);
+    unrasterized.clear();
+    primaryTests = 0;
+    fallbacks = 0;
+
+    // Primary visibility: rasterize every sphere's mesh, colored with its index, into ids.
+    const float canvasPerViewportX = static_cast<float>(w) / camera.viewportWidth;
+    const Matrix4 cameraToCanvas = Matrix4(canvasPerViewportX, 0, 0, 0,
+                                           0, static_cast<float>(h) / camera.viewportHeight, 0, 0,
+                                           0, 0, 1, 0,
+                                           0, 0, 0, 1) * Matrix4::Perspective(camera.viewportDist);
+    ids.Clear(Color(0, 0, 0));
+    for (int s = 0; s < static_cast<int>(spheres.size()); s++) {
+        const Sphere &sphere = spheres[s];
+        const Vector3 c = sphere.center - camera.origin;
+        // Another pixel of padding at the sphere's distance, so that tiny spheres whose silhouette
+        // falls between pixel centres still cover the pixels their rays hit.
+        const float radius = sphere.radius + 1.5f * c.z / (camera.viewportDist * canvasPerViewportX);
+        if (c.z <= 1.01f * hullRadius * radius) {
+            unrasterized.push_back(s);
+            continue;
+        }
+        const Color id((s + 1) & 255, ((s + 1) >> 8) & 255, ((s + 1) >> 16) & 255);
+        for (Triangle &t : sphereMesh.triangles) {
+            t.color = id;
+        }
+        ids.DrawMesh(sphereMesh, cameraToCanvas * Matrix4::Translation(c) * Matrix4::Scale(radius));
+    }
+
+    // Reconstruct each pixel's hit point from the sphere drawn there, then trace secondary rays
+    // from the visible surfaces only.
+    Vector3 O = camera.origin;
+    for (int sy = 0; sy < h; sy++) {
+        const int y = h / 2 - sy;
+        const Uint32 *idRow = ids.Pixels() + sy * w;
+        for (int i = 0; i < w; i++) {
+            const int drawn = static_cast<int>(idRow[i] & 0xffffffu) - 1;
+            Vector3 D = camera.Direction(static_cast<float>(left + i), static_cast<float>(y), w, h);
+            const Sphere *sphere = nullptr;
+            float t = FLT_MAX;
+            // A mesh overhanging its sphere, or a pixel where another sphere may be in front, falls
+            // back to testing every sphere.
+            bool traceAll = false;
+            if (drawn >= 0) {
+                traceAll = BordersOtherSphere(ids.Pixels(), w, h, i, sy);
+                if (!traceAll) {
+                    primaryTests++;
+                    if (NearestHit(O, D, spheres[drawn], t_min, t_max, t))
+                        sphere = &spheres[drawn];
+                    else
+                        traceAll = true;
+                }
+            }
+            if (traceAll) {
+                Sphere *closest;
+                primaryTests += static_cast<long long>(spheres.size());
+                fallbacks++;
+                if (ClosestIntersection(O, D, t_min, t_max, &closest, t))
+                    sphere = closest;
+            } else {
+                for (int s : unrasterized) {
+                    primaryTests++;
+                    if (NearestHit(O, D, spheres[s], t_min, t_max, t))
+                        sphere = &spheres[s];
+                }
+            }
+            row[i] = sphere ? ShadeSurface(O + D * t, D, *sphere, recursion_depth) : BACKGROUND;
+        }
+        renderer.DrawSpan(left, y, row.data(), w);
+    }
+}
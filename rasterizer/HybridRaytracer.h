@@ -0,0 +1,49 @@
+#pragma once
+
+#include "MemoryRenderer.h"
+#include "Raytracer.h"
+#include "Renderer.h"
+
+#include <vector>
+
+// Canvas rectangle [x0, x1] x [y0, y1] (origin at the centre, y up) that holds the whole
+// projection of sphere, padded by a pixel and clipped to the canvas. Spheres reaching behind the
+// camera cover the whole canvas. Returns false when nothing is left after clipping.
+bool SphereCanvasBounds(const Sphere &sphere, const RayCamera &camera, int canvasWidth, int canvasHeight, int &x0, int &y0, int &x1, int &y1);
+
+// Renders the global spheres and lights like TraceRay does for every pixel, but resolves primary
+// visibility with the rasterizer: each sphere is drawn as a mesh, with its index as the color, into
+// a software framebuffer whose depth test keeps the nearest one per pixel. A pixel's hit point is
+// then the ray's intersection with just that sphere, and only secondary rays are traced from it.
+//
+// The meshes enclose their spheres, so they cover every pixel a sphere can reach. Where a mesh
+// overhangs its sphere the ray misses the sphere it names, and near the line where two spheres
+// meet the nearer mesh need not be the nearer sphere; those pixels fall back to a full
+// ClosestIntersection. Spheres reaching behind the camera cannot be rasterized and are tested
+// against every pixel instead.
+class HybridRaytracer
+{
+  public:
+    HybridRaytracer();
+
+    void Render(Renderer &renderer, const RayCamera &camera, float t_min, float t_max, int recursion_depth);
+
+    // Ray-sphere tests spent on primary visibility in the last Render; a full ray trace spends
+    // one per sphere per pixel.
+    long long PrimaryTests() const { return primaryTests; }
+
+    // Pixels of the last Render that fell back to testing every sphere.
+    int Fallbacks() const { return fallbacks; }
+
+  private:
+    // Triangles per band of the sphere mesh, and bands.
+    static const int MESH_DIVS = 24;
+
+    Mesh sphereMesh;  // unit sphere scaled out just enough to contain it
+    float hullRadius; // distance of sphereMesh's corners from its centre
+    MemoryRenderer ids; // sphere index + 1 per pixel, 0 where no sphere was drawn
+    std::vector<int> unrasterized;
+    std::vector<PackedColor> row;
+    long long primaryTests;
+    int fallbacks;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <math.h>
+
+// Cohen-Sutherland clip of the segment (x0,y0)-(x1,y1) against [minX,maxX] x [minY,maxY].
+// Returns false when the segment lies entirely outside; otherwise the endpoints are moved inside.
+inline bool ClipLine(float &x0, float &y0, float &x1, float &y1, float minX, float minY, float maxX, float maxY)
+{
+    enum { inside = 0, left = 1, right = 2, bottom = 4, top = 8 };
+    auto outcode = [&](float x, float y) {
+        int code = inside;
+        if (x < minX)
+            code |= left;
+        else if (x > maxX)
+            code |= right;
+        if (y < minY)
+            code |= bottom;
+        else if (y > maxY)
+            code |= top;
+        return code;
+    };
+
+    int code0 = outcode(x0, y0);
+    int code1 = outcode(x1, y1);
+    while (true) {
+        if (!(code0 | code1))
+            return true;
+        if (code0 & code1)
+            return false;
+
+        const int code = code0 ? code0 : code1;
+        float x, y;
+        if (code & top) {
+            x = x0 + (x1 - x0) * (maxY - y0) / (y1 - y0);
+            y = maxY;
+        } else if (code & bottom) {
+            x = x0 + (x1 - x0) * (minY - y0) / (y1 - y0);
+            y = minY;
+        } else if (code & right) {
+            y = y0 + (y1 - y0) * (maxX - x0) / (x1 - x0);
+            x = maxX;
+        } else {
+            y = y0 + (y1 - y0) * (minX - x0) / (x1 - x0);
+            x = minX;
+        }
+
+        if (code == code0) {
+            x0 = x;
+            y0 = y;
+            code0 = outcode(x0, y0);
+        } else {
+            x1 = x;
+            y1 = y;
+            code1 = outcode(x1, y1);
+        }
+    }
+}
+
+// Integer Bresenham walk from (x0,y0) to (x1,y1), both endpoints included, in any octant.
+// plot(x, y) is invoked once per pixel; pass a lambda so the call inlines.
+template <typename Plot>
+inline void RasterizeLine(int x0, int y0, int x1, int y1, Plot &&plot)
+{
+    const int dx = x1 > x0 ? x1 - x0 : x0 - x1;
+    const int dy = y1 > y0 ? y0 - y1 : y1 - y0;
+    const int sx = x0 < x1 ? 1 : -1;
+    const int sy = y0 < y1 ? 1 : -1;
+    int err = dx + dy;
+
+    while (true) {
+        plot(x0, y0);
+        if (x0 == x1 && y0 == y1)
+            break;
+        const int e2 = 2 * err;
+        if (e2 >= dy) {
+            err += dy;
+            x0 += sx;
+        }
+        if (e2 <= dx) {
+            err += dx;
+            y0 += sy;
+        }
+    }
+}
+
+// Clips a float segment to the given pixel rectangle and rasterizes what is left with rounded endpoints.
+template <typename Plot>
+inline void RasterizeClippedLine(float x0, float y0, float x1, float y1, int minX, int minY, int maxX, int maxY, Plot &&plot)
+{
+    if (!ClipLine(x0, y0, x1, y1, static_cast<float>(minX), static_cast<float>(minY), static_cast<float>(maxX), static_cast<float>(maxY)))
+        return;
+    RasterizeLine(static_cast<int>(floorf(x0 + 0.5f)), static_cast<int>(floorf(y0 + 0.5f)),
+                  static_cast<int>(floorf(x1 + 0.5f)), static_cast<int>(floorf(y1 + 0.5f)), plot);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "SoftwareRenderer.h"
+
+// Headless backend: frames stay in memory, which is all benchmarks and tests need.
+class MemoryRenderer : public SoftwareRenderer
+{
+  public:
+    MemoryRenderer(int w, int h) : SoftwareRenderer(w, h), frames(0) {}
+
+    void Present() override
+    {
+        FinishFrame();
+        frames++;
+    }
+
+    int FramesPresented() const { return frames; }
+
+  private:
+    int frames;
+};
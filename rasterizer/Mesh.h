@@ -0,0 +1,102 @@
+#pragma once
+
+#include "Color.h"
+#include "Vector.h"
+
+#include <SDL_stdinc.h>
+#include <vector>
+
+class Texture;
+
+class Triangle
+{
+  public:
+    Triangle() : v0(0), v1(0), v2(0) {}
+    Triangle(int i0, int i1, int i2, Color c) : v0(i0), v1(i1), v2(i2), color(c) {}
+    int v0, v1, v2;
+    Color color;
+};
+
+// Indexed triangle mesh in model space. When texture is set, uvs holds three texture
+// coordinates per triangle and replaces the flat triangle colors. normals, when present, has one
+// entry per vertex. Bump revision after editing the mesh so cached per-vertex results are redone.
+class Mesh
+{
+  public:
+    Mesh() : texture(nullptr), revision(0) {}
+
+    static Mesh Cube()
+    {
+        Mesh cube;
+        cube.vertices = { { 1, 1, 1 }, { -1, 1, 1 }, { -1, -1, 1 }, { 1, -1, 1 },
+                          { 1, 1, -1 }, { -1, 1, -1 }, { -1, -1, -1 }, { 1, -1, -1 } };
+
+        const Color RED(255, 0, 0), GREEN(0, 255, 0), BLUE(0, 0, 255);
+        const Color YELLOW(255, 255, 0), PURPLE(255, 0, 255), CYAN(0, 255, 255);
+        cube.triangles = { { 0, 1, 2, RED }, { 0, 2, 3, RED },
+                           { 4, 0, 3, GREEN }, { 4, 3, 7, GREEN },
+                           { 5, 4, 7, BLUE }, { 5, 7, 6, BLUE },
+                           { 1, 5, 6, YELLOW }, { 1, 6, 2, YELLOW },
+                           { 4, 5, 1, PURPLE }, { 4, 1, 0, PURPLE },
+                           { 2, 6, 7, CYAN }, { 2, 7, 3, CYAN } };
+        // Each face is split as (a, b, c), (a, c, d); map it onto the whole texture.
+        for (int face = 0; face < 6; face++) {
+            cube.uvs.insert(cube.uvs.end(), { { 0, 0 }, { 1, 0 }, { 1, 1 }, { 0, 0 }, { 1, 1 }, { 0, 1 } });
+        }
+        return cube;
+    }
+
+    // Unit sphere split into divs bands of divs quads, with normals pointing outwards.
+    static Mesh Sphere(int divs, const Color &color)
+    {
+        Mesh sphere;
+        const float deltaAngle = 2.f * 3.14159265f / static_cast<float>(divs);
+        for (int d = 0; d <= divs; d++) {
+            const float y = (2.f / static_cast<float>(divs)) * (static_cast<float>(d) - static_cast<float>(divs) / 2.f);
+            const float radius = sqrtf(SDL_max(1.f - y * y, 0.f));
+            for (int i = 0; i < divs; i++) {
+                const Vector3 v(radius * cosf(deltaAngle * static_cast<float>(i)), y, radius * sinf(deltaAngle * static_cast<float>(i)));
+                sphere.vertices.push_back(v);
+                sphere.normals.push_back(v.Length() > 0 ? v * (1.f / v.Length()) : Vector3(0, y, 0));
+            }
+        }
+
+        for (int d = 0; d < divs; d++) {
+            for (int i = 0; i < divs; i++) {
+                const int i0 = d * divs + i;
+                const int i1 = (d + 1) * divs + (i + 1) % divs;
+                const int i2 = divs * d + (i + 1) % divs;
+                sphere.triangles.push_back(Triangle(i0, i1, i2, color));
+                sphere.triangles.push_back(Triangle(i0, i0 + divs, i1, color));
+            }
+        }
+        return sphere;
+    }
+
+    // Fills normals with the area-weighted average of the adjacent face normals.
+    void ComputeVertexNormals()
+    {
+        normals.assign(vertices.size(), Vector3());
+        for (const Triangle &t : triangles) {
+            const Vector3 e1 = vertices[t.v1] - vertices[t.v0];
+            const Vector3 e2 = vertices[t.v2] - vertices[t.v0];
+            const Vector3 n(e1.y * e2.z - e1.z * e2.y, e1.z * e2.x - e1.x * e2.z, e1.x * e2.y - e1.y * e2.x);
+            normals[t.v0] += n;
+            normals[t.v1] += n;
+            normals[t.v2] += n;
+        }
+        for (Vector3 &n : normals) {
+            const float length = n.Length();
+            if (length > 0)
+                n *= 1.f / length;
+        }
+        revision++;
+    }
+
+    std::vector<Vector3> vertices;
+    std::vector<Triangle> triangles;
+    std::vector<Vector2> uvs;
+    std::vector<Vector3> normals;
+    const Texture *texture;
+    int revision;
+};
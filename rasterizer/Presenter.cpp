@@ -0,0 +1,67 @@
+#include "Presenter.h"
+
+#include <chrono>
+#include <string.h>
+
+Presenter::Presenter(SDL_Window *window, int w, int h)
+    : width(w), height(h), renderer(nullptr), texture(nullptr), refreshTicks(0), lastPresent(0), back(w * h), front(w * h),
+      frameReady(false), presented(0)
+{
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, width, height);
+
+    const int display = SDL_GetWindowDisplayIndex(window);
+    SDL_DisplayMode mode;
+    int hz = 60;
+    if (display >= 0 && SDL_GetCurrentDisplayMode(display, &mode) == 0 && mode.refresh_rate > 0)
+        hz = mode.refresh_rate;
+    refreshTicks = SDL_GetPerformanceFrequency() / static_cast<Uint64>(hz);
+}
+
+Presenter::~Presenter()
+{
+    SDL_DestroyTexture(texture);
+    SDL_DestroyRenderer(renderer);
+}
+
+void Presenter::Submit(const Uint32 *pixels)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        memcpy(back.data(), pixels, back.size() * sizeof(Uint32));
+        frameReady = true;
+    }
+    wake.notify_all();
+}
+
+int Presenter::FramesPresented() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return presented;
+}
+
+bool Presenter::PresentLatest(int timeoutMs)
+{
+    // A frame presented earlier than one refresh after the last would only block on vsync.
+    const Uint64 now = SDL_GetPerformanceCounter();
+    if (presented > 0 && now - lastPresent < refreshTicks)
+        return false;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        if (!wake.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this] { return frameReady; }))
+            return false;
+        back.swap(front);
+        frameReady = false;
+    }
+
+    // Upload without the lock, so a worker can fill the back buffer meanwhile.
+    SDL_UpdateTexture(texture, nullptr, front.data(), width * static_cast<int>(sizeof(Uint32)));
+    SDL_RenderCopy(renderer, texture, nullptr, nullptr);
+    SDL_RenderPresent(renderer);
+    lastPresent = SDL_GetPerformanceCounter();
+
+    std::lock_guard<std::mutex> lock(mutex);
+    presented++;
+    return true;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <SDL.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+// Shows frames in a window with front/back buffers. Submit() copies a finished frame into the back
+// buffer and may be called from any thread, so a worker can hand frames over while the main thread
+// keeps going. PresentLatest() swaps the newest submitted frame to the front and shows it; at most
+// once per display refresh, so rendering is not held to vsync. If several frames arrive within one
+// refresh only the latest is shown.
+//
+// SDL2 requires its renderer to be used on the thread that created the window, so the constructor,
+// PresentLatest() and the destructor must all run on the main thread.
+class Presenter
+{
+  public:
+    Presenter(SDL_Window *window, int w, int h);
+    ~Presenter();
+
+    void Submit(const Uint32 *pixels);
+
+    // Waits up to timeoutMs for a submitted frame and shows it if the display is due for one.
+    // Returns whether a frame was shown; a frame that was not stays pending for the next call.
+    bool PresentLatest(int timeoutMs = 0);
+
+    // Frames shown so far, for comparing against the number submitted.
+    int FramesPresented() const;
+
+  private:
+    int width, height;
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    Uint64 refreshTicks; // performance counter ticks per display refresh
+    Uint64 lastPresent;
+
+    std::vector<Uint32> back;
+    std::vector<Uint32> front;
+    bool frameReady;
+    int presented;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake;
+};
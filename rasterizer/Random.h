@@ -0,0 +1,20 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+
+// Small deterministic generator, so benchmarks and demos draw exactly the same workload every run.
+class Random
+{
+  public:
+    Random() : state(12345u) {}
+
+    // Uniform in [lo, hi).
+    float Next(float lo = 0.f, float hi = 1.f)
+    {
+        state = state * 1664525u + 1013904223u;
+        return lo + (hi - lo) * static_cast<float>(state >> 8) / 16777216.f;
+    }
+
+  private:
+    Uint32 state;
+};
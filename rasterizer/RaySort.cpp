@@ -0,0 +1,71 @@
+#include "RaySort.h"
+
+#include <string.h>
+
+static const int RAY_GRID_BITS = 9;
+
+// Spreads the low ten bits of v out to every third bit.
+static Uint32 SpreadBits3(Uint32 v)
+{
+    v &= 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+static Uint32 GridCell(float v, float lo, float hi)
+{
+    const int cells = 1 << RAY_GRID_BITS;
+    const float scaled = hi > lo ? (v - lo) / (hi - lo) * static_cast<float>(cells) : 0.f;
+    return static_cast<Uint32>(SDL_clamp(static_cast<int>(scaled), 0, cells - 1));
+}
+
+Uint32 RaySortKey(const Vector3 &origin, const Vector3 &direction, const Aabb &bounds)
+{
+    const Uint32 octant = (direction.x < 0 ? 1u : 0u) | (direction.y < 0 ? 2u : 0u) | (direction.z < 0 ? 4u : 0u);
+    const Uint32 cell = SpreadBits3(GridCell(origin.x, bounds.min.x, bounds.max.x)) | SpreadBits3(GridCell(origin.y, bounds.min.y, bounds.max.y)) << 1 |
+                        SpreadBits3(GridCell(origin.z, bounds.min.z, bounds.max.z)) << 2;
+    return octant << (3 * RAY_GRID_BITS) | cell;
+}
+
+void SortByKey(const Uint32 *keys, int count, int *order, FrameArena &arena)
+{
+    for (int i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    if (count <= 1)
+        return;
+
+    const ArenaScope scope(arena);
+    Uint32 *fromKeys = arena.Allocate<Uint32>(count), *toKeys = arena.Allocate<Uint32>(count);
+    int *fromOrder = order, *toOrder = arena.Allocate<int>(count);
+    memcpy(fromKeys, keys, count * sizeof(Uint32));
+    for (int shift = 0; shift < 32; shift += 8) {
+        int offsets[256] = {};
+        for (int i = 0; i < count; i++) {
+            offsets[(fromKeys[i] >> shift) & 255]++;
+        }
+        if (offsets[(fromKeys[0] >> shift) & 255] == count)
+            continue;
+        for (int digit = 0, sum = 0; digit < 256; digit++) {
+            const int n = offsets[digit];
+            offsets[digit] = sum;
+            sum += n;
+        }
+        for (int i = 0; i < count; i++) {
+            const int to = offsets[(fromKeys[i] >> shift) & 255]++;
+            toKeys[to] = fromKeys[i];
+            toOrder[to] = fromOrder[i];
+        }
+        Uint32 *keySwap = fromKeys;
+        fromKeys = toKeys;
+        toKeys = keySwap;
+        int *orderSwap = fromOrder;
+        fromOrder = toOrder;
+        toOrder = orderSwap;
+    }
+    if (fromOrder != order)
+        memcpy(order, fromOrder, count * sizeof(int));
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Bvh.h"
+#include "FrameArena.h"
+
+// Sort key that brings together rays likely to walk the same part of an acceleration structure:
+// the direction's octant in bits 27-29, above the 27-bit Morton index of the origin's cell in a
+// 512^3 grid over bounds; the top two bits are zero. Origins outside bounds fall in the nearest cell.
+Uint32 RaySortKey(const Vector3 &origin, const Vector3 &direction, const Aabb &bounds);
+
+// Fills order with 0 .. count - 1 sorted by keys, equal keys in index order. An LSD radix sort of
+// eight bits a pass, which skips the passes where every key has the same digit; its buffers come
+// from arena and are handed back before it returns.
+void SortByKey(const Uint32 *keys, int count, int *order, FrameArena &arena);
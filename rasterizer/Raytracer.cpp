@@ -0,0 +1,307 @@
+#include "Raytracer.h"
+
+#include <cfloat>
+#include <math.h>
+
+const PackedColor BACKGROUND = PackedColor(Color(255, 255, 255, 255));
+
+std::vector<Sphere> spheres;
+std::vector<Light> lights;
+int sceneRevision = 0;
+
+SDL_bool IntersectRaySphere(Vector3 &O, Vector3 &D, const Sphere *sphere, float &t1, float &t2)
+{
+    float r = sphere->radius;
+    Vector3 CO = O - sphere->center;
+
+    float a = D.Dot(D);
+    float b = 2 * CO.Dot(D);
+    float c = CO.Dot(CO) - r * r;
+
+    const float discriminant = b * b - 4 * a * c;
+    if (discriminant < 0) {
+        t1 = t2 = -1;
+        return SDL_FALSE;
+    }
+
+    float d = sqrtf(discriminant);
+    t1 = (-b + d) / (2 * a);
+    t2 = (-b - d) / (2 * a);
+
+    return SDL_TRUE;
+}
+
+// The nearest hit within [t_min, t_max] among spheres[index(0)] .. spheres[index(count - 1)], taken
+// in that order, so on a tie the earlier sphere wins.
+template <typename Index>
+static inline bool ClosestAmong(Vector3 &O, Vector3 &D, float t_min, float t_max, int count, Index index, Sphere **oSphere, float &oT)
+{
+    float closest_t = FLT_MAX;
+    Sphere *closest_sphere = nullptr;
+    for (int i = 0; i < count; i++) {
+        Sphere *sphere = &spheres[index(i)];
+        float t1, t2;
+        IntersectRaySphere(O, D, sphere, t1, t2);
+        if (t1 >= t_min && t1 <= t_max && t1 < closest_t) {
+            closest_t = t1;
+            closest_sphere = sphere;
+        }
+        if (t2 >= t_min && t2 <= t_max && t2 < closest_t) {
+            closest_t = t2;
+            closest_sphere = sphere;
+        }
+    }
+
+    oT = closest_t;
+    *oSphere = closest_sphere;
+    return closest_sphere != nullptr;
+}
+
+bool ClosestIntersection(Vector3 O, Vector3 D, float t_min, float t_max, Sphere **oSphere, float &oT)
+{
+    return ClosestAmong(O, D, t_min, t_max, static_cast<int>(spheres.size()), [](int i) { return i; }, oSphere, oT);
+}
+
+bool ClosestIntersection(Vector3 O, Vector3 D, float t_min, float t_max, const int *candidates, int count, Sphere **oSphere, float &oT)
+{
+    return ClosestAmong(O, D, t_min, t_max, count, [candidates](int i) { return candidates[i]; }, oSphere, oT);
+}
+
+float RayTracedVisibility::Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const
+{
+    const float t_max = light.type == Light::Type::point ? 1.f : FLT_MAX;
+    Sphere *shadow_sphere = nullptr;
+    float shadow_t;
+    return ClosestIntersection(P, L, 0.001f, t_max, &shadow_sphere, shadow_t) ? 0.f : 1.f;
+}
+
+static const RayTracedVisibility shadowRays;
+
+const RayTracedVisibility &ShadowRays()
+{
+    return shadowRays;
+}
+
+float AreaLightVisibility::Next() const
+{
+    // xorshift32
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return static_cast<float>(state >> 8) / 8388608.f - 1.f;
+}
+
+float AreaLightVisibility::Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const
+{
+    // A uniform point in the unit ball, by rejection.
+    Vector3 offset;
+    do {
+        offset = Vector3(Next(), Next(), Next());
+    } while (offset.Dot(offset) > 1.f);
+
+    const Vector3 jittered = light.type == Light::Type::point ? L + offset * pointRadius : L + offset * (directionalSpread * L.Length());
+    return shadowRays.Visibility(light, lightIndex, P, N, jittered);
+}
+
+float ComputeLighting(Vector3 P, Vector3 N, Vector3 V, float s)
+{
+    return ComputeLighting(P, N, V, s, shadowRays);
+}
+
+enum SpecularKind {noSpecular, wholeSpecular, fractionalSpecular};
+
+// x^n for 0 <= x <= 1 by repeated squaring; whole specular exponents are the common case and powf
+// is slow.
+static inline float PowWhole(float x, unsigned n)
+{
+    float result = 1.f;
+    while (true) {
+        if (n & 1)
+            result *= x;
+        n >>= 1;
+        if (!n)
+            return result;
+        x *= x;
+        // What is left could only shrink result further, through denormals, which are slower still.
+        if (x < 1e-18f)
+            return 0.f;
+    }
+}
+
+// Diffuse and specular light from one point or directional light.
+template <SpecularKind Specular>
+static inline float LightContribution(const Light &light, int index, const Vector3 &P, const Vector3 &N, float lengthN, const Vector3 &V, float lengthV,
+                                      const Vector3 &L, float s, unsigned wholeS, const LightVisibility &visibility)
+{
+    const float lit = visibility.Visibility(light, index, P, N, L);
+    if (lit <= 0)
+        return 0.f;
+
+    float i = 0;
+    // diffuse
+    const float n_dot_l = N.Dot(L);
+    if (n_dot_l > 0) {
+        i += lit * light.intensity * n_dot_l / (lengthN * L.Length());
+    }
+
+    if (Specular != noSpecular) {
+        Vector3 R = N * 2 * N.Dot(L) - L;
+        const float r_dot_v = R.Dot(V);
+        if (r_dot_v > 0) {
+            const float cosine = r_dot_v / (R.Length() * lengthV);
+            i += lit * light.intensity * (Specular == wholeSpecular ? PowWhole(cosine, wholeS) : powf(cosine, s));
+        }
+    }
+    return i;
+}
+
+template <bool Points, bool Directionals, SpecularKind Specular>
+static float LightingKernelFor(const LightSet &set, const Vector3 &P, const Vector3 &N, const Vector3 &V, float s, const LightVisibility &visibility)
+{
+    const float lengthN = N.Length(), lengthV = V.Length();
+    const unsigned wholeS = Specular == wholeSpecular ? static_cast<unsigned>(s) : 0;
+    float i = set.ambient;
+    if (Points) {
+        for (int index : set.points) {
+            const Light &light = set.lights[index];
+            i += LightContribution<Specular>(light, index, P, N, lengthN, V, lengthV, light.position - P, s, wholeS, visibility);
+        }
+    }
+    if (Directionals) {
+        for (int index : set.directionals) {
+            const Light &light = set.lights[index];
+            i += LightContribution<Specular>(light, index, P, N, lengthN, V, lengthV, light.direction, s, wholeS, visibility);
+        }
+    }
+    return i;
+}
+
+// Indexed by [has point lights][has directional lights][SpecularKind].
+static const LightingKernel KERNELS[2][2][3] = {
+    { { LightingKernelFor<false, false, noSpecular>, LightingKernelFor<false, false, wholeSpecular>, LightingKernelFor<false, false, fractionalSpecular> },
+      { LightingKernelFor<false, true, noSpecular>, LightingKernelFor<false, true, wholeSpecular>, LightingKernelFor<false, true, fractionalSpecular> } },
+    { { LightingKernelFor<true, false, noSpecular>, LightingKernelFor<true, false, wholeSpecular>, LightingKernelFor<true, false, fractionalSpecular> },
+      { LightingKernelFor<true, true, noSpecular>, LightingKernelFor<true, true, wholeSpecular>, LightingKernelFor<true, true, fractionalSpecular> } },
+};
+
+static SpecularKind SpecularKindOf(float s)
+{
+    if (s == -1)
+        return noSpecular;
+    if (s >= 0 && s <= 65536.f && s == floorf(s))
+        return wholeSpecular;
+    return fractionalSpecular;
+}
+
+LightSet::LightSet(const std::vector<Light> &l, const std::vector<Sphere> &s) : lights(l), ambient(0), firstSphere(s.data())
+{
+    for (int index = 0; index < static_cast<int>(lights.size()); index++) {
+        switch (lights[index].type) {
+        case Light::Type::ambient:
+            ambient += lights[index].intensity;
+            break;
+        case Light::Type::point:
+            points.push_back(index);
+            break;
+        case Light::Type::directional:
+            directionals.push_back(index);
+            break;
+        }
+    }
+    for (int kind = 0; kind < 3; kind++) {
+        kernels[kind] = KERNELS[!points.empty()][!directionals.empty()][kind];
+    }
+    sphereKernels.reserve(s.size());
+    for (const Sphere &sphere : s) {
+        sphereKernels.push_back(kernels[SpecularKindOf(sphere.specular)]);
+    }
+}
+
+LightingKernel LightSet::Kernel(float s) const
+{
+    return kernels[SpecularKindOf(s)];
+}
+
+const LightSet &CurrentLightSet()
+{
+    // Called on every hit, so it only compares a revision rather than the scene.
+    static thread_local LightSet current;
+    static thread_local int builtRevision = -1;
+    if (builtRevision != sceneRevision) {
+        current = LightSet(lights, spheres);
+        builtRevision = sceneRevision;
+    }
+    return current;
+}
+
+float ComputeLighting(Vector3 P, Vector3 N, Vector3 V, float s, const LightVisibility &visibility)
+{
+    const LightSet &set = CurrentLightSet();
+    return set.Kernel(s)(set, P, N, V, s, visibility);
+}
+
+Vector3 ReflectRay(Vector3 R, Vector3 N)
+{
+    return (N * 2.f) * N.Dot(R) - R;
+}
+
+static PackedColor TraceWithLights(const LightSet &set, Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth, const LightVisibility &visibility);
+
+// ShadeSurface and TraceRay with the light set looked up once per ray, not once per bounce.
+static PackedColor ShadeWithLights(const LightSet &set, Vector3 P, Vector3 D, const Sphere &sphere, int recursion_depth, const LightVisibility &visibility)
+{
+    Vector3 N = P - sphere.center;
+    N = N * (1.f/N.Length());
+    float l = set.Kernel(sphere)(set, P, N, D * -1, sphere.specular, visibility);
+    l = SDL_clamp(l, 0, 1);
+    PackedColor color = sphere.color.Scaled(l);
+    float r = sphere.reflective;
+    if (recursion_depth <= 0 || r <= 0)
+        return color;
+
+    Vector3 R = ReflectRay(D * -1.f, N);
+    PackedColor reflectedColor = TraceWithLights(set, P, R, 0.001f, FLT_MAX, recursion_depth - 1, visibility);
+    return color.Lerp(reflectedColor, r);
+}
+
+static PackedColor TraceWithLights(const LightSet &set, Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth, const LightVisibility &visibility)
+{
+    float closest_t = 100000000.f;
+    int closestSphereIndex = -1;
+    Sphere *closestSphere = nullptr;
+
+    const bool found = ClosestIntersection(O, D, t_min, t_max, &closestSphere, closest_t);
+    if (!found)
+        return BACKGROUND;
+    else
+        return ShadeWithLights(set, O + D * closest_t, D, *closestSphere, recursion_depth, visibility);
+}
+
+PackedColor ShadeSurface(Vector3 P, Vector3 D, const Sphere &sphere, int recursion_depth)
+{
+    return ShadeSurface(P, D, sphere, recursion_depth, shadowRays);
+}
+
+PackedColor ShadeSurface(Vector3 P, Vector3 D, const Sphere &sphere, int recursion_depth, const LightVisibility &visibility)
+{
+    return ShadeWithLights(CurrentLightSet(), P, D, sphere, recursion_depth, visibility);
+}
+
+PackedColor TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth)
+{
+    return TraceRay(O, D, t_min, t_max, recursion_depth, shadowRays);
+}
+
+PackedColor TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth, const LightVisibility &visibility)
+{
+    return TraceWithLights(CurrentLightSet(), O, D, t_min, t_max, recursion_depth, visibility);
+}
+
+PackedColor TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth, const int *candidates, int count)
+{
+    float closest_t;
+    Sphere *closestSphere = nullptr;
+    if (!ClosestIntersection(O, D, t_min, t_max, candidates, count, &closestSphere, closest_t))
+        return BACKGROUND;
+    return ShadeWithLights(CurrentLightSet(), O + D * closest_t, D, *closestSphere, recursion_depth, shadowRays);
+}
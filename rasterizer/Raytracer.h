@@ -0,0 +1,161 @@
+#pragma once
+
+#include "Color.h"
+#include "Vector.h"
+
+#include <SDL_stdinc.h>
+#include <vector>
+
+class Sphere
+{
+public:
+    Sphere() : radius(0), center(0,0,0), color(0,0,0,0), specular(-1), reflective(0) {}
+    Sphere(Vector3 ctr, float rad, Color clr, float s=-1, float r=0) : radius(rad), center(ctr), color(clr), specular(s), reflective(r) {}
+
+    float radius;
+    Vector3 center;
+    PackedColor color;
+    float specular;
+    float reflective;
+
+    bool operator==(const Sphere &s) const
+    {
+        return radius == s.radius && center == s.center && color == s.color && specular == s.specular && reflective == s.reflective;
+    }
+};
+
+class Light
+{
+public:
+    enum Type {ambient, point, directional};
+
+    Light(Type t, float i, Vector3 pos, Vector3 dir) : type(t), intensity(i), position(pos), direction(dir) {}
+    Type type;
+    float intensity;
+    Vector3 position;
+    Vector3 direction;
+
+    bool operator==(const Light &l) const
+    {
+        return type == l.type && intensity == l.intensity && position == l.position && direction == l.direction;
+    }
+};
+
+// How much of a light reaches a point: 1 when nothing is in the way, 0 when fully shadowed.
+// N is the surface normal and L the unnormalized direction from P towards the light, as
+// ComputeLighting uses them.
+class LightVisibility
+{
+  public:
+    virtual ~LightVisibility() {}
+    virtual float Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const = 0;
+};
+
+// Shadow rays against the global spheres, as the ray tracer has always done.
+class RayTracedVisibility : public LightVisibility
+{
+  public:
+    float Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const override;
+};
+
+// The one RayTracedVisibility that everything without its own visibility shares.
+const RayTracedVisibility &ShadowRays();
+
+// Soft shadows from lights with an extent: one shadow ray per call towards a random point on the
+// light, so averaging many samples per pixel gives penumbrae. Point lights are balls of radius
+// pointRadius; directional lights are cones whose directions vary by directionalSpread times their
+// length. The random sequence comes from seed, so a sample traced with the same seed is repeatable.
+class AreaLightVisibility : public LightVisibility
+{
+  public:
+    AreaLightVisibility(float radius, float spread, Uint32 seed) : pointRadius(radius), directionalSpread(spread), state(seed | 1) {}
+
+    float Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const override;
+
+    float pointRadius, directionalSpread;
+
+  private:
+    // Uniform in [-1, 1).
+    float Next() const;
+
+    mutable Uint32 state;
+};
+
+class LightSet;
+
+// ComputeLighting specialised for one combination of light types and one kind of specular exponent.
+typedef float (*LightingKernel)(const LightSet &set, const Vector3 &P, const Vector3 &N, const Vector3 &V, float s, const LightVisibility &visibility);
+
+// Lights split by type, so that lighting kernels loop over each kind without branching on it, and
+// the kernels that fit them. Kernel picks one per material: exponent -1 means no specular, whole
+// exponents use repeated squaring, anything else falls back to powf. The kernels of the spheres the
+// set is built with are picked once, up front.
+class LightSet
+{
+  public:
+    LightSet() : ambient(0), kernels(), firstSphere(nullptr) {}
+    LightSet(const std::vector<Light> &l, const std::vector<Sphere> &s);
+
+    LightingKernel Kernel(float s) const;
+
+    // The kernel for sphere's material; a lookup for the spheres the set was built with.
+    LightingKernel Kernel(const Sphere &sphere) const
+    {
+        const bool known = &sphere >= firstSphere && &sphere < firstSphere + sphereKernels.size();
+        return known ? sphereKernels[&sphere - firstSphere] : Kernel(sphere.specular);
+    }
+
+    std::vector<Light> lights; // what the set was built from
+    float ambient;             // ambient intensities, summed
+    std::vector<int> points, directionals; // indices into lights
+
+  private:
+    LightingKernel kernels[3]; // for these lights, by kind of specular exponent
+    const Sphere *firstSphere;
+    std::vector<LightingKernel> sphereKernels; // by index from firstSphere
+};
+
+// The global lights and spheres as a LightSet, rebuilt when sceneRevision changes. Each thread has
+// its own copy.
+const LightSet &CurrentLightSet();
+
+// The ray tracer's pinhole camera: rays leave origin through a viewportWidth x viewportHeight
+// window viewportDist along +z, which covers the whole canvas.
+class RayCamera
+{
+  public:
+    RayCamera(Vector3 o, float w, float h, float d) : origin(o), viewportWidth(w), viewportHeight(h), viewportDist(d) {}
+
+    // Direction of the ray through a canvas point (origin at the centre, y up).
+    Vector3 Direction(float canvasX, float canvasY, int canvasWidth, int canvasHeight) const
+    {
+        return Vector3(canvasX * viewportWidth / static_cast<float>(canvasWidth), canvasY * viewportHeight / static_cast<float>(canvasHeight), viewportDist);
+    }
+
+    Vector3 origin;
+    float viewportWidth, viewportHeight, viewportDist;
+};
+
+extern const PackedColor BACKGROUND;
+extern std::vector<Sphere> spheres;
+extern std::vector<Light> lights;
+// Bump after editing spheres or lights, so the light sets built from them are redone.
+extern int sceneRevision;
+
+SDL_bool IntersectRaySphere(Vector3 &O, Vector3 &D, const Sphere *sphere, float &t1, float &t2);
+bool ClosestIntersection(Vector3 O, Vector3 D, float t_min, float t_max, Sphere **oSphere, float &oT);
+// ClosestIntersection over spheres[candidates[0 .. count)] only. With the candidates in ascending
+// order, any list holding every sphere the ray can hit gives the same result as all of them.
+bool ClosestIntersection(Vector3 O, Vector3 D, float t_min, float t_max, const int *candidates, int count, Sphere **oSphere, float &oT);
+float ComputeLighting(Vector3 P, Vector3 N, Vector3 V, float s = -1);
+float ComputeLighting(Vector3 P, Vector3 N, Vector3 V, float s, const LightVisibility &visibility);
+Vector3 ReflectRay(Vector3 R, Vector3 N);
+// Colour of a visible point P on sphere, seen along D: lighting with shadow rays, plus
+// recursion_depth levels of reflection rays.
+PackedColor ShadeSurface(Vector3 P, Vector3 D, const Sphere &sphere, int recursion_depth);
+PackedColor ShadeSurface(Vector3 P, Vector3 D, const Sphere &sphere, int recursion_depth, const LightVisibility &visibility);
+PackedColor TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth);
+PackedColor TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth, const LightVisibility &visibility);
+// TraceRay with the first hit looked for among candidates only, such as a SphereTileBins list for a
+// primary ray. Shadow and reflection rays still test every sphere.
+PackedColor TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth, const int *candidates, int count);
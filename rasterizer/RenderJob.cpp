@@ -0,0 +1,237 @@
+#include "RenderJob.h"
+#include "Denoiser.h"
+
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string.h>
+#include <thread>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+static const char JOB_MAGIC[4] = { 'J', 'O', 'B', '1' };
+
+// Cuts the file back to size bytes, dropping a torn record at its end.
+static bool TruncateFile(FILE *f, long size)
+{
+    fflush(f);
+#ifdef _WIN32
+    return _chsize_s(_fileno(f), size) == 0;
+#else
+    return ftruncate(fileno(f), size) == 0;
+#endif
+}
+
+// FNV-1a over the record's tile index and sums.
+static Uint32 RecordChecksum(Sint32 tile, const float *sums, size_t count)
+{
+    Uint32 hash = 2166136261u;
+    auto add = [&](const void *data, size_t size) {
+        const Uint8 *p = static_cast<const Uint8 *>(data);
+        for (size_t i = 0; i < size; i++) {
+            hash = (hash ^ p[i]) * 16777619u;
+        }
+    };
+    add(&tile, sizeof(tile));
+    add(sums, count * sizeof(float));
+    return hash;
+}
+
+// Uniform value in [0, 1) from a hash of the pixel and sample index.
+static float SampleJitter(int x, int y, int sample, int axis)
+{
+    Uint32 h = static_cast<Uint32>(x) * 73856093u ^ static_cast<Uint32>(y) * 19349663u ^ static_cast<Uint32>(sample) * 83492791u ^ static_cast<Uint32>(axis) * 2654435761u;
+    h ^= h >> 16;
+    h *= 0x7feb352du;
+    h ^= h >> 15;
+    h *= 0x846ca68bu;
+    h ^= h >> 16;
+    return static_cast<float>(h >> 8) / 16777216.f;
+}
+
+RenderJob::RenderJob(int canvasWidth, int canvasHeight, int samplesPerPixel, int size)
+    : width(canvasWidth), height(canvasHeight), samples(SDL_max(samplesPerPixel, 1)), tileSize(size),
+      tilesX((canvasWidth + size - 1) / size), accumulation(3 * canvasWidth * canvasHeight),
+      done(tilesX * ((canvasHeight + size - 1) / size)), resumed(0)
+{
+}
+
+void RenderJob::TileRect(int tile, int &x0, int &y0, int &w, int &h) const
+{
+    x0 = tile % tilesX * tileSize;
+    y0 = tile / tilesX * tileSize;
+    w = SDL_min(tileSize, width - x0);
+    h = SDL_min(tileSize, height - y0);
+}
+
+void RenderJob::RenderTile(int tile, SampleFunction sample, float *sums) const
+{
+    int x0, y0, w, h;
+    TileRect(tile, x0, y0, w, h);
+    for (int row = 0; row < h; row++) {
+        for (int i = 0; i < w; i++) {
+            const int sx = x0 + i, sy = y0 + row;
+            float r = 0, g = 0, b = 0;
+            for (int s = 0; s < samples; s++) {
+                // A single sample goes through the pixel's centre, like DoSpheres.
+                const float jx = samples > 1 ? SampleJitter(sx, sy, s, 0) - 0.5f : 0.f;
+                const float jy = samples > 1 ? SampleJitter(sx, sy, s, 1) - 0.5f : 0.f;
+                const PackedColor c = sample(static_cast<float>(sx - width / 2) + jx, static_cast<float>(height / 2 - sy) + jy, width, height);
+                r += static_cast<float>(c.R());
+                g += static_cast<float>(c.G());
+                b += static_cast<float>(c.B());
+            }
+            *sums++ = r;
+            *sums++ = g;
+            *sums++ = b;
+        }
+    }
+}
+
+long RenderJob::Replay(FILE *f)
+{
+    std::vector<float> sums;
+    long good = ftell(f);
+    while (true) {
+        Sint32 tile;
+        Uint32 checksum;
+        if (fread(&tile, sizeof(tile), 1, f) != 1 || fread(&checksum, sizeof(checksum), 1, f) != 1)
+            break;
+        if (tile < 0 || tile >= TileCount())
+            break;
+        int x0, y0, w, h;
+        TileRect(tile, x0, y0, w, h);
+        sums.resize(3 * w * h);
+        if (fread(sums.data(), sizeof(float), sums.size(), f) != sums.size() || RecordChecksum(tile, sums.data(), sums.size()) != checksum)
+            break;
+
+        for (int row = 0; row < h; row++) {
+            memcpy(&accumulation[3 * ((y0 + row) * width + x0)], &sums[3 * row * w], 3 * w * sizeof(float));
+        }
+        resumed += !done[tile];
+        done[tile] = 1;
+        good = ftell(f);
+    }
+    return good;
+}
+
+bool RenderJob::Run(const char *path, SampleFunction sample, int checkpointSeconds)
+{
+    const Sint32 header[] = { width, height, samples, tileSize };
+    FILE *f = nullptr;
+    bool ok = true;
+    if (path) {
+        long good = 0;
+        f = fopen(path, "r+b");
+        if (f) {
+            // Only a file shorter than the header, holding the start of this job's header, counts as
+            // torn and is rewritten; any other file that is not this job is left alone.
+            char expected[sizeof(JOB_MAGIC) + sizeof(header)], found[sizeof(expected)];
+            memcpy(expected, JOB_MAGIC, sizeof(JOB_MAGIC));
+            memcpy(expected + sizeof(JOB_MAGIC), header, sizeof(header));
+            const size_t length = fread(found, 1, sizeof(found), f);
+            const bool whole = length == sizeof(found);
+            if (whole && memcmp(found, JOB_MAGIC, sizeof(JOB_MAGIC)) == 0 && memcmp(found, expected, sizeof(expected)) != 0) {
+                Sint32 saved[4];
+                memcpy(saved, found + sizeof(JOB_MAGIC), sizeof(saved));
+                printf("%s holds a %dx%d, %d sample job; not resuming it\n", path, saved[0], saved[1], saved[2]);
+                fclose(f);
+                return false;
+            }
+            if (memcmp(found, expected, length) != 0) {
+                printf("%s does not start with this job's header; leaving it alone\n", path);
+                fclose(f);
+                return false;
+            }
+            if (whole)
+                good = Replay(f);
+        } else {
+            f = fopen(path, "w+b");
+            if (!f)
+                return false;
+        }
+
+        // Rewrite a torn header; otherwise drop whatever follows the last intact record.
+        ok = TruncateFile(f, good) && fseek(f, good, SEEK_SET) == 0;
+        if (ok && good == 0)
+            ok = fwrite(JOB_MAGIC, sizeof(JOB_MAGIC), 1, f) == 1 && fwrite(header, sizeof(header), 1, f) == 1 && fflush(f) == 0;
+        if (!ok) {
+            fclose(f);
+            return false;
+        }
+    }
+
+    std::vector<int> todo;
+    for (int t = 0; t < TileCount(); t++) {
+        if (!done[t])
+            todo.push_back(t);
+    }
+
+    std::atomic<int> next(0);
+    std::mutex mutex;
+    auto lastFlush = std::chrono::steady_clock::now();
+    auto work = [&]() {
+        std::vector<float> sums(3 * tileSize * tileSize);
+        for (int i = next++; i < static_cast<int>(todo.size()); i = next++) {
+            const int tile = todo[i];
+            RenderTile(tile, sample, sums.data());
+            int x0, y0, w, h;
+            TileRect(tile, x0, y0, w, h);
+            const size_t count = 3 * w * h;
+            const Sint32 index = tile;
+            const Uint32 checksum = RecordChecksum(index, sums.data(), count);
+
+            std::lock_guard<std::mutex> lock(mutex);
+            for (int row = 0; row < h; row++) {
+                memcpy(&accumulation[3 * ((y0 + row) * width + x0)], &sums[3 * row * w], 3 * w * sizeof(float));
+            }
+            done[tile] = 1;
+            if (!f)
+                continue;
+            ok = ok && fwrite(&index, sizeof(index), 1, f) == 1 && fwrite(&checksum, sizeof(checksum), 1, f) == 1 &&
+                 fwrite(sums.data(), sizeof(float), count, f) == count;
+            const auto now = std::chrono::steady_clock::now();
+            if (now - lastFlush >= std::chrono::seconds(checkpointSeconds)) {
+                ok = ok && fflush(f) == 0;
+                lastFlush = now;
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    const int threadCount = SDL_max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    for (int i = 1; i < threadCount; i++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+
+    if (f)
+        ok = fclose(f) == 0 && ok;
+    return ok;
+}
+
+void RenderJob::Resolve(PackedColor *out) const
+{
+    const float scale = 1.f / static_cast<float>(samples);
+    for (int i = 0; i < width * height; i++) {
+        const float *sum = &accumulation[3 * i];
+        out[i] = PackedColor(Color(static_cast<int>(sum[0] * scale + 0.5f), static_cast<int>(sum[1] * scale + 0.5f), static_cast<int>(sum[2] * scale + 0.5f)));
+    }
+}
+
+void RenderJob::Resolve(HdrImage &out) const
+{
+    const float scale = 1.f / static_cast<float>(samples);
+    for (int i = 0; i < width * height; i++) {
+        const float *sum = &accumulation[3 * i];
+        out.red[i] = sum[0] * scale;
+        out.green[i] = sum[1] * scale;
+        out.blue[i] = sum[2] * scale;
+    }
+}
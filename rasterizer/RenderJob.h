@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Color.h"
+
+#include <stdio.h>
+#include <vector>
+
+class HdrImage;
+
+// Color of one sample through canvas point (x, y), with the origin at the centre and y up.
+typedef PackedColor (*SampleFunction)(float x, float y, int canvasWidth, int canvasHeight);
+
+// A supersampled render that survives being killed. The canvas is rendered in tiles, samples jittered
+// over each pixel, on every hardware thread. Each finished tile's sample sums are appended to a
+// checkpoint file, which is flushed at least every checkpointSeconds; rerunning the job with the same
+// file replays it and only renders the tiles that are missing. A record cut short by the kill is
+// detected by its checksum and overwritten.
+//
+// The file is a header (magic, width, height, samples, tile size) followed by one record per tile
+// (index, checksum, then red, green and blue sums for each of its pixels), in native byte order.
+// Samples are seeded by pixel and index, so a resumed render equals an uninterrupted one.
+class RenderJob
+{
+  public:
+    RenderJob(int canvasWidth, int canvasHeight, int samplesPerPixel, int tileSize = 32);
+
+    // Loads what the checkpoint at path already holds, then renders the rest. Returns false, leaving
+    // the file as it was, if it belongs to a job with different settings or is not a job file at
+    // all, and false if it cannot be written. A null path renders the whole job in memory.
+    bool Run(const char *path, SampleFunction sample, int checkpointSeconds = 5);
+
+    // Average of the samples, top row first.
+    void Resolve(PackedColor *out) const;
+    // The same, unrounded, into an image of the canvas's size.
+    void Resolve(HdrImage &out) const;
+
+    int TileCount() const { return static_cast<int>(done.size()); }
+    int TilesResumed() const { return resumed; }
+
+  private:
+    void TileRect(int tile, int &x0, int &y0, int &w, int &h) const;
+    void RenderTile(int tile, SampleFunction sample, float *sums) const;
+    // Replays records from f; returns the offset just past the last intact one.
+    long Replay(FILE *f);
+
+    int width, height, samples, tileSize;
+    int tilesX;
+    std::vector<float> accumulation; // red, green and blue sums per pixel
+    std::vector<char> done;
+    int resumed;
+};
@@ -1,13 +1,93 @@
 #pragma once
 
 #include "Color.h"
+#include "Mesh.h"
+#include "Texture.h"
 #include "Vector.h"
 
+class Vertex
+{
+  public:
+    Vertex(float x0, float y0, float h0) : x(x0), y(y0), h(h0) {}
+    Vertex() : x(0), y(0), h(0) {}
+    float x, y;
+    float h;
+};
+
+// Projected vertex for texture mapping: canvas position, 1/z and texture coordinates.
+class TexturedVertex
+{
+  public:
+    TexturedVertex(float x0, float y0, float invZ0, float u0, float v0) : x(x0), y(y0), invZ(invZ0), u(u0), v(v0) {}
+    TexturedVertex() : x(0), y(0), invZ(0), u(0), v(0) {}
+    float x, y;
+    float invZ;
+    float u, v;
+};
+
+// Per-pixel lighting hook for DrawPhongMesh. The renderer calls Shade once per span with the
+// camera-space position and unit normal of every visible pixel in it.
+class SpanShader
+{
+  public:
+    virtual ~SpanShader() {}
+    virtual void Shade(const Vector3 *points, const Vector3 *normals, int count, float *intensities) = 0;
+};
+
+// Drawing interface shared by all backends. Coordinates are canvas coordinates: the origin is the
+// center of the canvas and y grows upwards. Everything except DrawPixel takes a batch, so a backend
+// pays one virtual call per span, line list, triangle list or mesh rather than one per pixel.
 class Renderer
 {
   public:
-    Renderer(int w, int h) {}
+    Renderer(int w, int h) : width(w), height(h) {}
+    virtual ~Renderer() {}
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+
+    virtual void Clear(const Color &color) = 0;
+    virtual void DrawPixel(int x, int y, PackedColor color) = 0;
+    // Draws count pixels starting at (x, y) and going right.
+    virtual void DrawSpan(int x, int y, const PackedColor *colors, int count) = 0;
+    virtual void DrawLines(const Vector2 *p0, const Vector2 *p1, int count, const Color &color) = 0;
+    // vertices holds three entries per triangle; z is ignored.
+    virtual void DrawFilledTriangles(const Vector3 *vertices, int triangleCount, const Color &color) = 0;
+    // Flat triangles composited over the framebuffer by their colors' alpha, strictly in the order
+    // given and without a depth test; callers sort them back to front. Three vertices and one color
+    // per triangle; z is ignored.
+    virtual void DrawBlendedTriangles(const Vector3 *vertices, const PackedColor *colors, int triangleCount) = 0;
+    // vertices holds three entries per triangle; each vertex scales color by its h.
+    virtual void DrawShadedTriangles(const Vertex *vertices, int triangleCount, const Color &color) = 0;
+    // Perspective-correct, mipmapped and depth-tested; vertices holds three entries per triangle.
+    virtual void DrawTexturedTriangles(const TexturedVertex *vertices, int triangleCount, const Texture &texture) = 0;
+    // Depth-tested draw of mesh. modelToCanvas maps model space to homogeneous canvas coordinates,
+    // i.e. it already contains the perspective projection and the viewport-to-canvas scale.
+    virtual void DrawMesh(const Mesh &mesh, const Matrix4 &modelToCanvas) = 0;
+    // Like DrawMesh, scaling triangle colors by per-vertex intensities interpolated across each triangle.
+    virtual void DrawGouraudMesh(const Mesh &mesh, const Matrix4 &modelToCanvas, const float *vertexIntensities) = 0;
+    // Like DrawMesh, with intensities computed per pixel by shader from interpolated normals.
+    // The mesh needs normals; cameraToCanvas must be the projection DrawMesh would take.
+    virtual void DrawPhongMesh(const Mesh &mesh, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas, SpanShader &shader) = 0;
+    virtual void Present() = 0;
+
+    void DrawLine(const Vector2 &p0, const Vector2 &p1, const Color &color)
+    {
+        DrawLines(&p0, &p1, 1, color);
+    }
+
+    void DrawFilledTriangle(const Vector3 &p0, const Vector3 &p1, const Vector3 &p2, const Color &color)
+    {
+        const Vector3 vertices[] = { p0, p1, p2 };
+        DrawFilledTriangles(vertices, 1, color);
+    }
+
+    void DrawShadedTriangle(const Vertex &p0, const Vertex &p1, const Vertex &p2, const Color &color)
+    {
+        const Vertex vertices[] = { p0, p1, p2 };
+        DrawShadedTriangles(vertices, 1, color);
+    }
 
-    virtual void DrawPixel(int x, int y, Color color) = 0;
-    virtual void DrawLine(const Vector3& p0, const Vector3& p1, const Color& color) = 0
+  protected:
+    int width, height;
 };
@@ -0,0 +1,12 @@
+#include "SDLRenderer.h"
+
+SDLRenderer::SDLRenderer(SDL_Window *window, int w, int h) : SoftwareRenderer(w, h), presenter(window, w, h)
+{
+}
+
+void SDLRenderer::Present()
+{
+    presenter.Submit(Pixels());
+    presenter.PresentLatest();
+    FinishFrame();
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include "Presenter.h"
+#include "SoftwareRenderer.h"
+
+#include <SDL.h>
+
+// Presents the software framebuffer in an SDL window. Present() hands the frame to a Presenter,
+// which shows it unless the display already got a frame this refresh; such a frame is shown by the
+// next Present() or ShowPending(). Both must be called on the main thread.
+class SDLRenderer : public SoftwareRenderer
+{
+  public:
+    SDLRenderer(SDL_Window *window, int w, int h);
+
+    void Present() override;
+
+    // Shows a presented frame still waiting for its refresh, if any.
+    void ShowPending() { presenter.PresentLatest(); }
+
+  private:
+    Presenter presenter;
+};
@@ -0,0 +1,364 @@
+#include "Scene.h"
+#include "FrameArena.h"
+#include "RaySort.h"
+
+#include <cfloat>
+#include <math.h>
+
+void SphereSet::ComputeBounds()
+{
+    sphereBounds.resize(spheres.size());
+    bounds = Aabb();
+    for (size_t i = 0; i < spheres.size(); i++) {
+        sphereBounds[i] = Aabb::OfSphere(spheres[i].center, spheres[i].radius);
+        bounds.Grow(sphereBounds[i]);
+    }
+}
+
+void SphereSet::Build()
+{
+    ComputeBounds();
+    bvh.Build(sphereBounds.data(), static_cast<int>(sphereBounds.size()));
+    if (layout == wide)
+        wideBvh.Build(bvh);
+}
+
+const BvhUpdateStats &SphereSet::Update()
+{
+    ComputeBounds();
+    const BvhUpdateStats &stats = bvh.Update(sphereBounds.data(), static_cast<int>(sphereBounds.size()));
+    if (layout == wide)
+        wideBvh.Build(bvh);
+    return stats;
+}
+
+bool SphereSet::ClosestIntersection(Vector3 O, Vector3 D, float t_min, float &t_max, int &sphere) const
+{
+    sphere = -1;
+    auto hit = [&](int i, float &closest) {
+        float t1, t2;
+        IntersectRaySphere(O, D, &spheres[i], t1, t2);
+        if (t1 >= t_min && t1 <= closest) {
+            closest = t1;
+            sphere = i;
+        }
+        if (t2 >= t_min && t2 <= closest) {
+            closest = t2;
+            sphere = i;
+        }
+    };
+    if (layout == wide)
+        wideBvh.Traverse(O, D, t_min, t_max, hit);
+    else
+        bvh.Traverse(O, D, t_min, t_max, hit);
+    return sphere >= 0;
+}
+
+int SceneGraph::AddNode(const Matrix4 &local, int parent)
+{
+    parents.push_back(parent);
+    locals.push_back(local);
+    worlds.push_back(parent >= 0 ? worlds[parent] * local : local);
+    inverses.push_back(worlds.back().AffineInverse());
+    dirty.push_back(0);
+    anyDirty = true;
+    return static_cast<int>(parents.size()) - 1;
+}
+
+void SceneGraph::SetLocal(int node, const Matrix4 &local)
+{
+    locals[node] = local;
+    dirty[node] = 1;
+    anyDirty = true;
+}
+
+bool SceneGraph::UpdateTransforms()
+{
+    if (!anyDirty)
+        return false;
+
+    // Parents come before their children, so one pass in order sees every parent settled.
+    for (size_t i = 0; i < parents.size(); i++) {
+        const int parent = parents[i];
+        if (parent >= 0 && dirty[parent])
+            dirty[i] = 1;
+        if (dirty[i]) {
+            worlds[i] = parent >= 0 ? worlds[parent] * locals[i] : locals[i];
+            inverses[i] = worlds[i].AffineInverse();
+        }
+    }
+    for (size_t i = 0; i < dirty.size(); i++) {
+        dirty[i] = 0;
+    }
+    anyDirty = false;
+    return true;
+}
+
+int InstancedScene::AddSphereSet(const SphereSet &set)
+{
+    sphereSets.push_back(set);
+    return static_cast<int>(sphereSets.size()) - 1;
+}
+
+int InstancedScene::AddMesh(const Mesh &mesh)
+{
+    Aabb box;
+    for (const Vector3 &v : mesh.vertices) {
+        box.Grow(v);
+    }
+    MeshEntry entry;
+    entry.mesh = &mesh;
+    entry.center = box.Center();
+    entry.radius = 0;
+    for (const Vector3 &v : mesh.vertices) {
+        entry.radius = SDL_max(entry.radius, (v - entry.center).Length());
+    }
+    meshes.push_back(entry);
+    return static_cast<int>(meshes.size()) - 1;
+}
+
+int InstancedScene::AddInstance(Instance::Kind kind, int geometry, int node)
+{
+    Instance instance;
+    instance.kind = kind;
+    instance.geometry = geometry;
+    instance.node = node;
+    instances.push_back(instance);
+    instancesChanged = true;
+    return static_cast<int>(instances.size()) - 1;
+}
+
+void InstancedScene::Update()
+{
+    const bool moved = graph.UpdateTransforms();
+    if (!moved && !instancesChanged)
+        return;
+    const bool added = instancesChanged;
+    instancesChanged = false;
+
+    // Only sphere instances can be hit by rays; the top level indexes into traceable.
+    traceable.clear();
+    instanceBounds.clear();
+    for (size_t i = 0; i < instances.size(); i++) {
+        if (instances[i].kind != Instance::sphereSet)
+            continue;
+        traceable.push_back(static_cast<int>(i));
+        instanceBounds.push_back(sphereSets[instances[i].geometry].bounds.Transformed(graph.World(instances[i].node)));
+    }
+    if (added)
+        topLevel.Build(instanceBounds.data(), static_cast<int>(instanceBounds.size()));
+    else
+        topLevel.Update(instanceBounds.data(), static_cast<int>(instanceBounds.size()));
+}
+
+bool InstancedScene::ClosestIntersection(Vector3 O, Vector3 D, float t_min, float t_max, SceneHit &hit) const
+{
+    hit.instance = -1;
+    topLevel.Traverse(O, D, t_min, t_max, [&](int item, float &closest) {
+        const int index = traceable[item];
+        const Instance &instance = instances[index];
+        // Affine maps keep the ray parameter, so object-space hits compare directly.
+        const Matrix4 &toObject = graph.WorldInverse(instance.node);
+        int sphere;
+        if (sphereSets[instance.geometry].ClosestIntersection(toObject.TransformPoint(O), toObject.TransformDirection(D), t_min, closest, sphere)) {
+            hit.t = closest;
+            hit.instance = index;
+            hit.sphere = sphere;
+        }
+    });
+    if (hit.instance < 0)
+        return false;
+
+    const Instance &instance = instances[hit.instance];
+    const Sphere &sphere = sphereSets[instance.geometry].spheres[hit.sphere];
+    const Vector3 P = graph.WorldInverse(instance.node).TransformPoint(O + D * hit.t);
+    hit.normal = graph.World(instance.node).TransformDirection(P - sphere.center);
+    hit.normal *= 1.f / hit.normal.Length();
+    return true;
+}
+
+// Shadow rays against the instances instead of the global spheres.
+class InstancedShadowRays : public LightVisibility
+{
+  public:
+    explicit InstancedShadowRays(const InstancedScene &s) : scene(s) {}
+
+    float Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const override
+    {
+        const float t_max = light.type == Light::Type::point ? 1.f : FLT_MAX;
+        SceneHit hit;
+        return scene.ClosestIntersection(P, L, 0.001f, t_max, hit) ? 0.f : 1.f;
+    }
+
+  private:
+    const InstancedScene &scene;
+};
+
+PackedColor InstancedScene::ShadeHit(const Vector3 &P, const Vector3 &D, const SceneHit &hit, float &reflective) const
+{
+    const Sphere &sphere = sphereSets[instances[hit.instance].geometry].spheres[hit.sphere];
+    const InstancedShadowRays shadows(*this);
+    float l = ComputeLighting(P, hit.normal, D * -1, sphere.specular, shadows);
+    l = SDL_clamp(l, 0, 1);
+    reflective = sphere.reflective;
+    return sphere.color.Scaled(l);
+}
+
+PackedColor InstancedScene::TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth) const
+{
+    SceneHit hit;
+    if (!ClosestIntersection(O, D, t_min, t_max, hit))
+        return BACKGROUND;
+
+    const Vector3 P = O + D * hit.t;
+    float r;
+    const PackedColor color = ShadeHit(P, D, hit, r);
+    if (recursion_depth <= 0 || r <= 0)
+        return color;
+
+    const PackedColor reflectedColor = TraceRay(P, ReflectRay(D * -1.f, hit.normal), 0.001f, FLT_MAX, recursion_depth - 1);
+    return color.Lerp(reflectedColor, r);
+}
+
+void InstancedScene::RayTrace(Renderer &renderer, const RayCamera &camera, float t_min, float t_max, int recursion_depth) const
+{
+    const int w = renderer.Width(), h = renderer.Height();
+    const ArenaScope scope(FrameArena::ForThread());
+    PackedColor *row = FrameArena::ForThread().Allocate<PackedColor>(w);
+    // By framebuffer row, top first: canvas y runs from h / 2 down to 1 - h / 2.
+    for (int sy = 0; sy < h; sy++) {
+        const int y = h / 2 - sy;
+        for (int i = 0; i < w; i++) {
+            const Vector3 D = camera.Direction(static_cast<float>(i - w / 2), static_cast<float>(y), w, h);
+            row[i] = TraceRay(camera.origin, D, t_min, t_max, recursion_depth);
+        }
+        renderer.DrawSpan(-w / 2, y, row, w);
+    }
+}
+
+// Rays of one bounce of a wavefront batch, with what each found: its colour before reflections, the
+// surface's reflectivity, and the index of the reflection ray it queued in the next bounce, or -1.
+class RayWave
+{
+  public:
+    class Ray
+    {
+      public:
+        Vector3 origin, direction;
+    };
+
+    Ray *rays;
+    PackedColor *colors;
+    float *reflective;
+    int *reflection;
+    int count;
+};
+
+void InstancedScene::RayTraceWavefront(Renderer &renderer, const RayCamera &camera, float t_min, float t_max, int recursion_depth, bool sortRays) const
+{
+    const int w = renderer.Width(), h = renderer.Height();
+    const int depth = SDL_max(recursion_depth, 0);
+    const int batchRows = SDL_max(WAVEFRONT_RAYS / w, 1);
+    const Aabb bounds = topLevel.Nodes().empty() ? Aabb() : topLevel.Nodes()[0].bounds;
+    FrameArena &arena = FrameArena::ForThread();
+
+    // Batches of framebuffer rows, top first; row sy is canvas y = h / 2 - sy.
+    for (int sy0 = 0; sy0 < h; sy0 += batchRows) {
+        const int rows = SDL_min(batchRows, h - sy0);
+        const int pixels = rows * w;
+        const ArenaScope scope(arena);
+        // Every bounce has at most one ray per pixel.
+        RayWave *waves = arena.Allocate<RayWave>(depth + 1);
+        for (int level = 0; level <= depth; level++) {
+            waves[level].rays = arena.Allocate<RayWave::Ray>(pixels);
+            waves[level].colors = arena.Allocate<PackedColor>(pixels);
+            waves[level].reflective = arena.Allocate<float>(pixels);
+            waves[level].reflection = arena.Allocate<int>(pixels);
+            waves[level].count = 0;
+        }
+        int *order = arena.Allocate<int>(pixels);
+        Uint32 *keys = arena.Allocate<Uint32>(pixels);
+
+        for (int i = 0; i < pixels; i++) {
+            RayWave::Ray &ray = waves[0].rays[i];
+            ray.origin = camera.origin;
+            ray.direction = camera.Direction(static_cast<float>(i % w - w / 2), static_cast<float>(h / 2 - sy0 - i / w), w, h);
+        }
+        waves[0].count = pixels;
+
+        for (int level = 0; level <= depth; level++) {
+            RayWave &wave = waves[level];
+            if (level > 0 && sortRays) {
+                for (int i = 0; i < wave.count; i++) {
+                    keys[i] = RaySortKey(wave.rays[i].origin, wave.rays[i].direction, bounds);
+                }
+                SortByKey(keys, wave.count, order, arena);
+            } else {
+                for (int i = 0; i < wave.count; i++) {
+                    order[i] = i;
+                }
+            }
+
+            for (int j = 0; j < wave.count; j++) {
+                const int i = order[j];
+                const RayWave::Ray &ray = wave.rays[i];
+                wave.reflection[i] = -1;
+                SceneHit hit;
+                if (!ClosestIntersection(ray.origin, ray.direction, level == 0 ? t_min : 0.001f, level == 0 ? t_max : FLT_MAX, hit)) {
+                    wave.colors[i] = BACKGROUND;
+                    continue;
+                }
+                const Vector3 P = ray.origin + ray.direction * hit.t;
+                wave.colors[i] = ShadeHit(P, ray.direction, hit, wave.reflective[i]);
+                if (level < depth && wave.reflective[i] > 0) {
+                    RayWave &next = waves[level + 1];
+                    wave.reflection[i] = next.count;
+                    next.rays[next.count].origin = P;
+                    next.rays[next.count++].direction = ReflectRay(ray.direction * -1.f, hit.normal);
+                }
+            }
+        }
+
+        // Blend each bounce into the one that queued it, deepest first, as TraceRay's recursion does.
+        for (int level = depth - 1; level >= 0; level--) {
+            RayWave &wave = waves[level];
+            for (int i = 0; i < wave.count; i++) {
+                if (wave.reflection[i] >= 0)
+                    wave.colors[i] = wave.colors[i].Lerp(waves[level + 1].colors[wave.reflection[i]], wave.reflective[i]);
+            }
+        }
+        for (int row = 0; row < rows; row++) {
+            renderer.DrawSpan(-w / 2, h / 2 - sy0 - row, &waves[0].colors[row * w], w);
+        }
+    }
+}
+
+int InstancedScene::Rasterize(Renderer &renderer, const RayCamera &camera, const Matrix4 &cameraToCanvas) const
+{
+    // Side planes of the view pyramid through the viewport edges, as inward-facing unit normals.
+    const float hx = camera.viewportWidth * 0.5f, hy = camera.viewportHeight * 0.5f, d = camera.viewportDist;
+    const float nx = 1.f / sqrtf(d * d + hx * hx), ny = 1.f / sqrtf(d * d + hy * hy);
+    const Vector3 planes[] = { Vector3(d * nx, 0, hx * nx), Vector3(-d * nx, 0, hx * nx), Vector3(0, d * ny, hy * ny), Vector3(0, -d * ny, hy * ny) };
+
+    int culled = 0;
+    for (const Instance &instance : instances) {
+        if (instance.kind != Instance::mesh)
+            continue;
+        const MeshEntry &entry = meshes[instance.geometry];
+        const Matrix4 &world = graph.World(instance.node);
+        const Vector3 center = world.TransformPoint(entry.center) - camera.origin;
+        const float radius = entry.radius * world.TransformDirection(Vector3(1, 0, 0)).Length();
+
+        // Triangles reaching behind the camera are dropped anyway, so z = 0 acts as the near plane.
+        bool visible = center.z + radius > 0;
+        for (int p = 0; p < 4 && visible; p++) {
+            visible = planes[p].Dot(center) > -radius;
+        }
+        if (!visible) {
+            culled++;
+            continue;
+        }
+        renderer.DrawMesh(*entry.mesh, cameraToCanvas * Matrix4::Translation(camera.origin * -1.f) * world);
+    }
+    return culled;
+}
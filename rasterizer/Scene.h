@@ -0,0 +1,153 @@
+#pragma once
+
+#include "Bvh.h"
+#include "Mesh.h"
+#include "Raytracer.h"
+#include "Renderer.h"
+#include "WideBvh.h"
+
+#include <vector>
+
+// Spheres sharing one bottom-level BVH, authored in their own object space. Instances place
+// copies of the whole set; the spheres themselves are stored once.
+//
+// With the wide layout, rays walk an eight-wide quantized BVH collapsed from the binary one, which
+// is kept for refitting.
+class SphereSet
+{
+  public:
+    enum Layout {binary, wide};
+
+    SphereSet() : layout(binary) {}
+
+    // Call after filling spheres or changing layout.
+    void Build();
+    // Call after moving or resizing spheres: refits the BVH, or rebuilds it once refitting has let
+    // it degrade.
+    const BvhUpdateStats &Update();
+
+    // Nearest sphere hit by the object-space ray O + t D within [t_min, t_max].
+    bool ClosestIntersection(Vector3 O, Vector3 D, float t_min, float &t_max, int &sphere) const;
+
+    // Bytes of nodes and item indices that rays walk through.
+    size_t BvhBytes() const { return layout == wide ? wideBvh.MemoryBytes() : bvh.MemoryBytes(); }
+
+    std::vector<Sphere> spheres;
+    Aabb bounds;
+    Layout layout;
+
+  private:
+    void ComputeBounds();
+
+    Bvh bvh;
+    WideBvh wideBvh;
+    std::vector<Aabb> sphereBounds;
+};
+
+// Hierarchy of transforms. Nodes are created parents first and cache their world transform and
+// its inverse; SetLocal only marks a node dirty and UpdateTransforms recomputes the dirty nodes
+// and everything below them.
+class SceneGraph
+{
+  public:
+    SceneGraph() : anyDirty(false) {}
+
+    int AddNode(const Matrix4 &local, int parent = -1);
+    void SetLocal(int node, const Matrix4 &local);
+
+    // Returns false when nothing has moved since the last call.
+    bool UpdateTransforms();
+
+    const Matrix4 &World(int node) const { return worlds[node]; }
+    const Matrix4 &WorldInverse(int node) const { return inverses[node]; }
+    int NodeCount() const { return static_cast<int>(parents.size()); }
+
+  private:
+    std::vector<int> parents;
+    std::vector<Matrix4> locals, worlds, inverses;
+    std::vector<char> dirty;
+    bool anyDirty;
+};
+
+// A sphere set or mesh placed by a scene graph node.
+class Instance
+{
+  public:
+    enum Kind {sphereSet, mesh};
+
+    Kind kind;
+    int geometry;
+    int node;
+};
+
+class SceneHit
+{
+  public:
+    float t;
+    int instance;
+    int sphere;
+    Vector3 normal;
+};
+
+// Instanced geometry over a scene graph. The ray tracer walks a top-level BVH over the instances'
+// world boxes into each sphere set's own BVH; the rasterizer culls mesh instances against the view
+// frustum before drawing them. Transforms are expected to be rotations, translations and uniform
+// scales, so spheres stay spheres. Everything lives in camera space, like the global scene.
+class InstancedScene
+{
+  public:
+    InstancedScene() : instancesChanged(true) {}
+
+    int AddSphereSet(const SphereSet &set);
+    // The mesh is referenced, not copied, and must outlive the scene.
+    int AddMesh(const Mesh &mesh);
+    int AddInstance(Instance::Kind kind, int geometry, int node);
+
+    // Picks up moved nodes: recomputes world transforms and instance boxes, then refits the
+    // top-level BVH, or rebuilds it when instances were added or refitting has let it degrade.
+    void Update();
+    const BvhUpdateStats &TopLevelStats() const { return topLevel.LastUpdate(); }
+
+    bool ClosestIntersection(Vector3 O, Vector3 D, float t_min, float t_max, SceneHit &hit) const;
+
+    // TraceRay over the instances: lit by the global lights, with shadow and reflection rays
+    // against this scene.
+    PackedColor TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth) const;
+    void RayTrace(Renderer &renderer, const RayCamera &camera, float t_min, float t_max, int recursion_depth) const;
+
+    // Draws the same frame as RayTrace, but breadth first: WAVEFRONT_RAYS pixels' primary rays are
+    // traced together, then all their reflection rays, and so on down to recursion_depth. With
+    // sortRays each bounce's rays are first ordered by RaySortKey, so that consecutive rays start
+    // near each other heading the same way and walk the same BVH nodes while they are in cache.
+    void RayTraceWavefront(Renderer &renderer, const RayCamera &camera, float t_min, float t_max, int recursion_depth, bool sortRays) const;
+
+    // Draws the mesh instances whose bounding spheres reach into the camera's view, returning how
+    // many were culled.
+    int Rasterize(Renderer &renderer, const RayCamera &camera, const Matrix4 &cameraToCanvas) const;
+
+    SceneGraph graph;
+
+  private:
+    static const int WAVEFRONT_RAYS = 65536;
+
+    // The colour of hit before reflections, lit with shadow rays against the scene. P is the hit
+    // point and D the direction of the ray that found it.
+    PackedColor ShadeHit(const Vector3 &P, const Vector3 &D, const SceneHit &hit, float &reflective) const;
+
+    // Mesh plus the bounding sphere of its vertices.
+    class MeshEntry
+    {
+      public:
+        const Mesh *mesh;
+        Vector3 center;
+        float radius;
+    };
+
+    std::vector<SphereSet> sphereSets;
+    std::vector<MeshEntry> meshes;
+    std::vector<Instance> instances;
+    std::vector<Aabb> instanceBounds;
+    std::vector<int> traceable;
+    Bvh topLevel;
+    bool instancesChanged;
+};
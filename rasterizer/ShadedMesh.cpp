@@ -0,0 +1,55 @@
+#include "ShadedMesh.h"
+
+// The camera sits at the origin, so the view vector of a camera-space point P is -P.
+static float ShadePoint(const Vector3 &P, const Vector3 &N, float specular, const LightVisibility *visibility = nullptr)
+{
+    const float i = visibility ? ComputeLighting(P, N, P * -1.f, specular, *visibility) : ComputeLighting(P, N, P * -1.f, specular);
+    return SDL_clamp(i, 0.f, 1.f);
+}
+
+void LightingShader::Shade(const Vector3 *points, const Vector3 *normals, int count, float *intensities)
+{
+    // Neither the material nor the lights change within a span, so its kernel is looked up once.
+    const LightVisibility &shadows = visibility ? *visibility : ShadowRays();
+    const LightSet &set = CurrentLightSet();
+    const LightingKernel kernel = set.Kernel(specular);
+    for (int i = 0; i < count; i++) {
+        const float intensity = kernel(set, points[i], normals[i], points[i] * -1.f, specular, shadows);
+        intensities[i] = SDL_clamp(intensity, 0.f, 1.f);
+    }
+}
+
+const float *VertexLightingCache::Update(const Mesh &m, const Matrix4 &modelToCamera, float s)
+{
+    if (mesh == &m && meshRevision == m.revision && transform == modelToCamera && specular == s && cachedLights == lights && cachedSpheres == spheres)
+        return intensities.data();
+
+    mesh = &m;
+    meshRevision = m.revision;
+    transform = modelToCamera;
+    specular = s;
+    cachedLights = lights;
+    cachedSpheres = spheres;
+
+    const int n = static_cast<int>(m.vertices.size());
+    intensities.resize(n);
+    for (int i = 0; i < n; i++) {
+        Vector3 N = modelToCamera.TransformDirection(m.normals[i]);
+        N *= 1.f / N.Length();
+        intensities[i] = ShadePoint(modelToCamera.TransformPoint(m.vertices[i]), N, s);
+    }
+    evaluations++;
+    return intensities.data();
+}
+
+void DrawGouraudShadedMesh(Renderer &renderer, const Mesh &mesh, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas, float specular, VertexLightingCache &cache)
+{
+    renderer.DrawGouraudMesh(mesh, cameraToCanvas * modelToCamera, cache.Update(mesh, modelToCamera, specular));
+}
+
+void DrawPhongShadedMesh(Renderer &renderer, const Mesh &mesh, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas, float specular,
+                         const LightVisibility *visibility)
+{
+    LightingShader shader(specular, visibility);
+    renderer.DrawPhongMesh(mesh, modelToCamera, cameraToCanvas, shader);
+}
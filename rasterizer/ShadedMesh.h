@@ -0,0 +1,51 @@
+#pragma once
+
+#include "Mesh.h"
+#include "Raytracer.h"
+#include "Renderer.h"
+
+#include <vector>
+
+// Evaluates the ray tracer's ComputeLighting for every pixel the rasterizer hands over.
+class LightingShader : public SpanShader
+{
+  public:
+    // visibility replaces the shadow rays when given, e.g. with shadow map lookups.
+    explicit LightingShader(float s, const LightVisibility *visibility = nullptr) : specular(s), visibility(visibility) {}
+
+    void Shade(const Vector3 *points, const Vector3 *normals, int count, float *intensities) override;
+
+  private:
+    float specular;
+    const LightVisibility *visibility;
+};
+
+// Per-vertex ComputeLighting results for one mesh. They are recomputed only when the mesh, its
+// placement, its specular exponent or the scene's lights and spheres change.
+class VertexLightingCache
+{
+  public:
+    VertexLightingCache() : mesh(nullptr), meshRevision(-1), specular(0), evaluations(0) {}
+
+    const float *Update(const Mesh &m, const Matrix4 &modelToCamera, float s);
+
+    // How many times the lighting has actually been evaluated.
+    int Evaluations() const { return evaluations; }
+
+  private:
+    const Mesh *mesh;
+    int meshRevision;
+    Matrix4 transform;
+    float specular;
+    std::vector<Light> cachedLights;
+    std::vector<Sphere> cachedSpheres;
+    std::vector<float> intensities;
+    int evaluations;
+};
+
+// Camera-space meshes lit by the global lights, with shadows cast by the global spheres.
+// Gouraud evaluates the lighting per vertex (through cache), Phong per pixel; Phong can take its
+// shadows from a LightVisibility such as ShadowMapVisibility instead.
+void DrawGouraudShadedMesh(Renderer &renderer, const Mesh &mesh, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas, float specular, VertexLightingCache &cache);
+void DrawPhongShadedMesh(Renderer &renderer, const Mesh &mesh, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas, float specular,
+                         const LightVisibility *visibility = nullptr);
@@ -0,0 +1,220 @@
+#include "ShadowMap.h"
+
+#include <cfloat>
+#include <math.h>
+
+// Point-light faces clip casters against this distance from the light.
+static const float SHADOW_NEAR = 0.01f;
+
+// Depth tolerance in texels, so surfaces do not shadow themselves. The filter reads up to 1.5
+// texels from P, over which a sloped surface's depth changes by slope texels per texel.
+static const float SHADOW_BIAS_TEXELS = 0.5f;
+static const float SHADOW_FILTER_REACH = 2.f;
+static const float SHADOW_MAX_SLOPE = 8.f;
+
+void ShadowMap::Render(const Light &light, const ShadowCaster *casters, int count)
+{
+    if (light.type == Light::Type::point) {
+        static const Vector3 axes[6][3] = {
+            { { 1, 0, 0 }, { 0, 0, -1 }, { 0, 1, 0 } },  { { -1, 0, 0 }, { 0, 0, 1 }, { 0, 1, 0 } },
+            { { 0, 1, 0 }, { 1, 0, 0 }, { 0, 0, -1 } },  { { 0, -1, 0 }, { 1, 0, 0 }, { 0, 0, 1 } },
+            { { 0, 0, 1 }, { 1, 0, 0 }, { 0, 1, 0 } },   { { 0, 0, -1 }, { -1, 0, 0 }, { 0, 1, 0 } },
+        };
+        perspective = true;
+        origin = light.position;
+        faceCount = 6;
+        // A 90 degree frustum spans [-1, 1] after the divide by depth.
+        scale = static_cast<float>(resolution) * 0.5f;
+        offsetU = offsetV = static_cast<float>(resolution) * 0.5f;
+        for (int f = 0; f < 6; f++) {
+            faces[f].forward = axes[f][0];
+            faces[f].right = axes[f][1];
+            faces[f].up = axes[f][2];
+        }
+    } else {
+        // The light shines along -direction; fit an orthographic box around every caster vertex.
+        Face &face = faces[0];
+        face.forward = light.direction * (-1.f / light.direction.Length());
+        const Vector3 helper = fabsf(face.forward.y) < 0.99f ? Vector3(0, 1, 0) : Vector3(1, 0, 0);
+        face.right = helper.Cross(face.forward);
+        face.right *= 1.f / face.right.Length();
+        face.up = face.forward.Cross(face.right);
+        perspective = false;
+        origin = Vector3(0, 0, 0);
+        faceCount = 1;
+
+        float minU = FLT_MAX, maxU = -FLT_MAX, minV = FLT_MAX, maxV = -FLT_MAX;
+        for (int c = 0; c < count; c++) {
+            for (const Vector3 &vertex : casters[c].mesh->vertices) {
+                const Vector3 p = casters[c].modelToCamera.TransformPoint(vertex);
+                minU = SDL_min(minU, p.Dot(face.right));
+                maxU = SDL_max(maxU, p.Dot(face.right));
+                minV = SDL_min(minV, p.Dot(face.up));
+                maxV = SDL_max(maxV, p.Dot(face.up));
+            }
+        }
+        const float extent = SDL_max(SDL_max(maxU - minU, maxV - minV), 1e-6f);
+        // Keep a texel of margin on each side so the filter never reads past the casters.
+        scale = static_cast<float>(resolution - 2) / extent;
+        offsetU = 1.f - minU * scale;
+        offsetV = 1.f - minV * scale;
+    }
+
+    for (int f = 0; f < faceCount; f++) {
+        RenderFace(faces[f], casters, count);
+    }
+}
+
+void ShadowMap::RenderFace(Face &face, const ShadowCaster *casters, int count)
+{
+    face.depth.assign(resolution * resolution, FLT_MAX);
+
+    for (int c = 0; c < count; c++) {
+        const Mesh &mesh = *casters[c].mesh;
+        points.resize(mesh.vertices.size());
+        for (size_t i = 0; i < mesh.vertices.size(); i++) {
+            const Vector3 q = casters[c].modelToCamera.TransformPoint(mesh.vertices[i]) - origin;
+            points[i] = Vector3(q.Dot(face.right), q.Dot(face.up), q.Dot(face.forward));
+        }
+
+        for (const Triangle &triangle : mesh.triangles) {
+            Vector3 polygon[4];
+            int n = 0;
+            const Vector3 corners[] = { points[triangle.v0], points[triangle.v1], points[triangle.v2] };
+
+            if (!perspective) {
+                for (int k = 0; k < 3; k++) {
+                    polygon[n++] = Vector3(corners[k].x * scale + offsetU, corners[k].y * scale + offsetV, corners[k].z);
+                }
+            } else {
+                // Clip against the near plane (a triangle gains at most one corner), then project,
+                // carrying 1/z since that is what varies linearly across the face.
+                for (int k = 0; k < 3; k++) {
+                    const Vector3 &a = corners[k];
+                    const Vector3 &b = corners[(k + 1) % 3];
+                    if (a.z >= SHADOW_NEAR)
+                        polygon[n++] = a;
+                    if ((a.z >= SHADOW_NEAR) != (b.z >= SHADOW_NEAR))
+                        polygon[n++] = a + (b - a) * ((SHADOW_NEAR - a.z) / (b.z - a.z));
+                }
+                for (int k = 0; k < n; k++) {
+                    const float invZ = 1.f / polygon[k].z;
+                    polygon[k] = Vector3(polygon[k].x * invZ * scale + offsetU, polygon[k].y * invZ * scale + offsetV, invZ);
+                }
+            }
+
+            for (int k = 2; k < n; k++) {
+                RasterizeTriangle(face, polygon[0], polygon[k - 1], polygon[k]);
+            }
+        }
+    }
+}
+
+// Keeps the nearest depth at every texel centre the triangle covers. Corners are (u, v, w) with w
+// the depth, or 1/depth on perspective faces.
+void ShadowMap::RasterizeTriangle(Face &face, const Vector3 &a, const Vector3 &b, const Vector3 &c)
+{
+    const float area = (b.x - a.x) * (c.y - a.y) - (c.x - a.x) * (b.y - a.y);
+    if (area == 0.f)
+        return;
+    const float invArea = 1.f / area;
+
+    const int x0 = SDL_max(static_cast<int>(floorf(SDL_min(SDL_min(a.x, b.x), c.x))), 0);
+    const int x1 = SDL_min(static_cast<int>(ceilf(SDL_max(SDL_max(a.x, b.x), c.x))), resolution - 1);
+    const int y0 = SDL_max(static_cast<int>(floorf(SDL_min(SDL_min(a.y, b.y), c.y))), 0);
+    const int y1 = SDL_min(static_cast<int>(ceilf(SDL_max(SDL_max(a.y, b.y), c.y))), resolution - 1);
+
+    for (int y = y0; y <= y1; y++) {
+        const float py = static_cast<float>(y) + 0.5f;
+        float *row = &face.depth[y * resolution];
+        for (int x = x0; x <= x1; x++) {
+            const float px = static_cast<float>(x) + 0.5f;
+            // Barycentric weights of b and c; negative when outside, whichever way the triangle winds.
+            const float wb = ((px - a.x) * (c.y - a.y) - (c.x - a.x) * (py - a.y)) * invArea;
+            const float wc = ((b.x - a.x) * (py - a.y) - (px - a.x) * (b.y - a.y)) * invArea;
+            if (wb < 0 || wc < 0 || wb + wc > 1)
+                continue;
+            const float w = a.z + (b.z - a.z) * wb + (c.z - a.z) * wc;
+            const float d = perspective ? 1.f / w : w;
+            row[x] = SDL_min(row[x], d);
+        }
+    }
+}
+
+bool ShadowMap::ToFace(const Face &face, const Vector3 &P, float &u, float &v, float &z) const
+{
+    const Vector3 q = P - origin;
+    z = q.Dot(face.forward);
+    if (perspective) {
+        if (z < SHADOW_NEAR)
+            return false;
+        u = q.Dot(face.right) / z * scale + offsetU;
+        v = q.Dot(face.up) / z * scale + offsetV;
+    } else {
+        u = q.Dot(face.right) * scale + offsetU;
+        v = q.Dot(face.up) * scale + offsetV;
+    }
+    return true;
+}
+
+const ShadowMap::Face &ShadowMap::FaceFor(const Vector3 &P) const
+{
+    if (!perspective)
+        return faces[0];
+
+    // The cube face is picked by the largest component of the direction from the light.
+    const Vector3 q = P - origin;
+    const float ax = fabsf(q.x), ay = fabsf(q.y), az = fabsf(q.z);
+    if (ax >= ay && ax >= az)
+        return faces[q.x >= 0 ? 0 : 1];
+    if (ay >= az)
+        return faces[q.y >= 0 ? 2 : 3];
+    return faces[q.z >= 0 ? 4 : 5];
+}
+
+float ShadowMap::Visibility(const Vector3 &P, float slope) const
+{
+    if (faceCount == 0)
+        return 1.f;
+
+    const Face &face = FaceFor(P);
+    float u, v, z;
+    if (!ToFace(face, P, u, v, z))
+        return 1.f;
+    const float size = static_cast<float>(resolution);
+    if (u < 0 || v < 0 || u >= size || v >= size)
+        return 1.f;
+
+    // One texel covers 1/scale units on an orthographic map, z/scale at depth z on a cube face.
+    const float texel = perspective ? z / scale : 1.f / scale;
+    const float reference = z - (SHADOW_BIAS_TEXELS + SHADOW_FILTER_REACH * SDL_min(slope, SHADOW_MAX_SLOPE)) * texel;
+
+    const int tx = static_cast<int>(u), ty = static_cast<int>(v);
+    int lit = 0;
+    for (int dy = -1; dy <= 1; dy++) {
+        const int y = SDL_clamp(ty + dy, 0, resolution - 1);
+        for (int dx = -1; dx <= 1; dx++) {
+            const int x = SDL_clamp(tx + dx, 0, resolution - 1);
+            lit += face.depth[y * resolution + x] >= reference;
+        }
+    }
+    return static_cast<float>(lit) / 9.f;
+}
+
+void ShadowMapVisibility::Update(const ShadowCaster *casters, int count)
+{
+    maps.resize(lights.size(), ShadowMap(resolution));
+    for (size_t i = 0; i < lights.size(); i++) {
+        if (lights[i].type != Light::Type::ambient)
+            maps[i].Render(lights[i], casters, count);
+    }
+}
+
+float ShadowMapVisibility::Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const
+{
+    if (lightIndex >= static_cast<int>(maps.size()))
+        return 1.f;
+    const float cosine = N.Dot(L) / (N.Length() * L.Length());
+    const float slope = cosine > 0 ? sqrtf(1.f - cosine * cosine) / cosine : SHADOW_MAX_SLOPE;
+    return maps[lightIndex].Visibility(P, slope);
+}
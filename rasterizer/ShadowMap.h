@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Mesh.h"
+#include "Raytracer.h"
+#include "Vector.h"
+
+#include <vector>
+
+// A mesh placed in the same (camera) space the lights are given in.
+class ShadowCaster
+{
+  public:
+    ShadowCaster(const Mesh &m, const Matrix4 &transform) : mesh(&m), modelToCamera(transform) {}
+
+    const Mesh *mesh;
+    Matrix4 modelToCamera;
+};
+
+// Depth of the casters as seen from one light. Directional lights get a single orthographic
+// map fitted around the casters; point lights get a cube map, one 90 degree face per axis.
+class ShadowMap
+{
+  public:
+    explicit ShadowMap(int resolution = 512)
+        : resolution(resolution), perspective(false), scale(1), offsetU(0), offsetV(0), faceCount(0)
+    {
+    }
+
+    void Render(const Light &light, const ShadowCaster *casters, int count);
+
+    // Fraction of the light reaching P, from a 3x3 percentage-closer filter around P's texel.
+    // Points outside the map are lit. slope is the tangent of the angle between the surface normal
+    // and the light, which widens the depth tolerance on surfaces the light grazes.
+    float Visibility(const Vector3 &P, float slope = 1.f) const;
+
+  private:
+    // One depth image looking down forward. Orthographic faces map right/up distances to texels
+    // through scale and offset; perspective faces divide by the depth first. Depths are stored as
+    // linear distance along forward, cleared to FLT_MAX.
+    class Face
+    {
+      public:
+        Vector3 right, up, forward;
+        std::vector<float> depth;
+    };
+
+    bool ToFace(const Face &face, const Vector3 &P, float &u, float &v, float &z) const;
+    const Face &FaceFor(const Vector3 &P) const;
+    void RasterizeTriangle(Face &face, const Vector3 &a, const Vector3 &b, const Vector3 &c);
+    void RenderFace(Face &face, const ShadowCaster *casters, int count);
+
+    int resolution;
+    bool perspective;
+    Vector3 origin;
+    float scale, offsetU, offsetV;
+    Face faces[6];
+    int faceCount;
+    std::vector<Vector3> points;
+};
+
+// Shadow-mapped replacement for the ray tracer's shadow rays: one map per point or directional
+// light, indexed like the global lights.
+class ShadowMapVisibility : public LightVisibility
+{
+  public:
+    explicit ShadowMapVisibility(int resolution = 512) : resolution(resolution) {}
+
+    // Re-renders every light's map; call whenever the lights or the casters move.
+    void Update(const ShadowCaster *casters, int count);
+
+    float Visibility(const Light &light, int lightIndex, const Vector3 &P, const Vector3 &N, const Vector3 &L) const override;
+
+  private:
+    int resolution;
+    std::vector<ShadowMap> maps;
+};
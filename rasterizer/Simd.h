@@ -0,0 +1,12 @@
+#pragma once
+
+// Picks the widest vector instruction set the compiler was told it may use.
+// MSVC only defines __AVX__/__AVX2__ under /arch:AVX(2); SSE2 is always present on x64.
+#if defined(__AVX__)
+#define RENDER_AVX 1
+#define RENDER_SSE2 1
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RENDER_SSE2 1
+#include <emmintrin.h>
+#endif
@@ -0,0 +1,187 @@
+#include "Socket.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#include <ws2tcpip.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "ws2_32.lib")
+#endif
+typedef SOCKET NativeSocket;
+typedef int SocketLength;
+static void CloseNative(NativeSocket s) { closesocket(s); }
+static const int SHUTDOWN_BOTH = SD_BOTH;
+#else
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+typedef int NativeSocket;
+typedef socklen_t SocketLength;
+static void CloseNative(NativeSocket s) { close(s); }
+static const int SHUTDOWN_BOTH = SHUT_RDWR;
+#endif
+
+// Writes to a peer that has gone away must fail, not raise SIGPIPE.
+#ifdef MSG_NOSIGNAL
+static const int SEND_FLAGS = MSG_NOSIGNAL;
+#else
+static const int SEND_FLAGS = 0;
+#endif
+
+static NativeSocket Native(uintptr_t handle)
+{
+    return static_cast<NativeSocket>(handle);
+}
+
+Socket &Socket::operator=(Socket &&other)
+{
+    if (this != &other) {
+        Close();
+        handle = other.handle;
+        other.handle = INVALID;
+    }
+    return *this;
+}
+
+bool Socket::Startup()
+{
+#ifdef _WIN32
+    WSADATA data;
+    return WSAStartup(MAKEWORD(2, 2), &data) == 0;
+#else
+    return true;
+#endif
+}
+
+bool Socket::Connect(const char *host, int port)
+{
+    Close();
+
+    char service[16];
+    snprintf(service, sizeof(service), "%d", port);
+    addrinfo hints;
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *addresses = nullptr;
+    if (getaddrinfo(host, service, &hints, &addresses) != 0)
+        return false;
+
+    for (addrinfo *a = addresses; a && !IsValid(); a = a->ai_next) {
+        const NativeSocket s = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (static_cast<uintptr_t>(s) == INVALID)
+            continue;
+        if (connect(s, a->ai_addr, static_cast<SocketLength>(a->ai_addrlen)) != 0) {
+            CloseNative(s);
+            continue;
+        }
+        // Requests and results are single messages; do not hold them back waiting for more.
+        int on = 1;
+        setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&on), sizeof(on));
+        handle = static_cast<uintptr_t>(s);
+    }
+    freeaddrinfo(addresses);
+    return IsValid();
+}
+
+bool Socket::Listen(int port)
+{
+    Close();
+
+    const NativeSocket s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (static_cast<uintptr_t>(s) == INVALID)
+        return false;
+    int on = 1;
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, reinterpret_cast<const char *>(&on), sizeof(on));
+
+    sockaddr_in address;
+    memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(static_cast<unsigned short>(port));
+    if (bind(s, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 || listen(s, SOMAXCONN) != 0) {
+        CloseNative(s);
+        return false;
+    }
+    handle = static_cast<uintptr_t>(s);
+    return true;
+}
+
+int Socket::Port() const
+{
+    sockaddr_in address;
+    SocketLength length = sizeof(address);
+    if (!IsValid() || getsockname(Native(handle), reinterpret_cast<sockaddr *>(&address), &length) != 0)
+        return -1;
+    return ntohs(address.sin_port);
+}
+
+Socket Socket::Accept(int timeoutMs)
+{
+    if (!IsValid())
+        return Socket();
+
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(Native(handle), &readable);
+    timeval timeout;
+    timeout.tv_sec = timeoutMs / 1000;
+    timeout.tv_usec = (timeoutMs % 1000) * 1000;
+    if (select(static_cast<int>(Native(handle)) + 1, &readable, nullptr, nullptr, &timeout) <= 0)
+        return Socket();
+
+    const NativeSocket s = accept(Native(handle), nullptr, nullptr);
+    if (static_cast<uintptr_t>(s) == INVALID)
+        return Socket();
+    int on = 1;
+    setsockopt(s, IPPROTO_TCP, TCP_NODELAY, reinterpret_cast<const char *>(&on), sizeof(on));
+    return Socket(static_cast<uintptr_t>(s));
+}
+
+bool Socket::SendAll(const void *data, size_t size)
+{
+    const char *p = static_cast<const char *>(data);
+    while (size > 0) {
+        const int chunk = static_cast<int>(size < (1u << 30) ? size : (1u << 30));
+        const int sent = static_cast<int>(send(Native(handle), p, chunk, SEND_FLAGS));
+        if (sent <= 0)
+            return false;
+        p += sent;
+        size -= sent;
+    }
+    return true;
+}
+
+bool Socket::ReceiveAll(void *data, size_t size)
+{
+    char *p = static_cast<char *>(data);
+    while (size > 0) {
+        const int chunk = static_cast<int>(size < (1u << 30) ? size : (1u << 30));
+        const int received = static_cast<int>(recv(Native(handle), p, chunk, 0));
+        if (received <= 0)
+            return false;
+        p += received;
+        size -= received;
+    }
+    return true;
+}
+
+void Socket::Shutdown()
+{
+    if (IsValid())
+        shutdown(Native(handle), SHUTDOWN_BOTH);
+}
+
+void Socket::Close()
+{
+    if (IsValid()) {
+        CloseNative(Native(handle));
+        handle = INVALID;
+    }
+}
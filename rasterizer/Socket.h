@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Blocking TCP socket over Winsock or BSD sockets. Owns its handle: movable, not copyable.
+class Socket
+{
+  public:
+    Socket() : handle(INVALID) {}
+    ~Socket() { Close(); }
+    Socket(Socket &&other) : handle(other.handle) { other.handle = INVALID; }
+    Socket &operator=(Socket &&other);
+    Socket(const Socket &) = delete;
+    Socket &operator=(const Socket &) = delete;
+
+    // Once per process before any other call; Winsock needs it, elsewhere it does nothing.
+    static bool Startup();
+
+    bool Connect(const char *host, int port);
+    // Listens on every interface; port 0 picks a free one, which Port() then reports.
+    bool Listen(int port);
+    int Port() const;
+    // Waits at most timeoutMs for a connection. The result is invalid on timeout or error.
+    Socket Accept(int timeoutMs);
+
+    bool SendAll(const void *data, size_t size);
+    bool ReceiveAll(void *data, size_t size);
+
+    // Makes blocked sends and receives on this socket fail, from any thread.
+    void Shutdown();
+    void Close();
+    bool IsValid() const { return handle != INVALID; }
+
+  private:
+    explicit Socket(uintptr_t h) : handle(h) {}
+
+    static const uintptr_t INVALID = ~static_cast<uintptr_t>(0);
+    uintptr_t handle;
+};
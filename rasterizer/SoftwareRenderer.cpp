@@ -0,0 +1,474 @@
+#include "SoftwareRenderer.h"
+#include "ColorSpan.h"
+#include "FrameArena.h"
+#include "FrameRecorder.h"
+#include "LineRaster.h"
+#include "TriangleRaster.h"
+#include "VertexBatch.h"
+
+#include <algorithm>
+#include <math.h>
+
+// Calls span(y, first, last) for the rows of the triangle v[0..2] that fall on a width x height
+// framebuffer, with the covered pixels first..last inclusive and already clipped.
+template <typename V, typename Span>
+static void ScanTriangle(const V *v, int width, int height, Span &&span)
+{
+    RasterizeTriangle(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y, -width / 2, height / 2 - (height - 1), width - 1 - width / 2, height / 2, span);
+}
+
+// Screen-space gradients of a value that varies linearly across a triangle (1/z, or anything
+// divided by z), evaluated relative to the triangle's first vertex.
+class PlaneGradients
+{
+  public:
+    PlaneGradients(float x0, float y0, float x1, float y1, float x2, float y2)
+        : ox(x0), oy(y0), x10(x1 - x0), y10(y1 - y0), x20(x2 - x0), y20(y2 - y0)
+    {
+        const float area = x10 * y20 - x20 * y10;
+        invArea = area != 0.f ? 1.f / area : 0.f;
+    }
+
+    bool Degenerate() const { return invArea == 0.f; }
+
+    void Gradient(float a0, float a1, float a2, float &dx, float &dy) const
+    {
+        dx = ((a1 - a0) * y20 - (a2 - a0) * y10) * invArea;
+        dy = ((a2 - a0) * x10 - (a1 - a0) * x20) * invArea;
+    }
+
+    float At(float a0, float dx, float dy, float x, float y) const
+    {
+        return a0 + dx * (x - ox) + dy * (y - oy);
+    }
+
+  private:
+    float ox, oy;
+    float x10, y10, x20, y20;
+    float invArea;
+};
+
+SoftwareRenderer::SoftwareRenderer(int w, int h)
+    : Renderer(w, h), layout(rowMajor), tilesX((w + SWIZZLE_TILE - 1) / SWIZZLE_TILE), pixels(w * h), depth(w * h), rowScratch(w), recorder(nullptr)
+{
+}
+
+void SoftwareRenderer::SetLayout(Layout l)
+{
+    if (l == layout)
+        return;
+    std::vector<Uint32> frame(Pixels(), Pixels() + width * height);
+    layout = l;
+    if (layout == rowMajor) {
+        pixels.swap(frame);
+        pixels.resize(width * height);
+        return;
+    }
+    pixels.assign(SwizzledSize(width, height), 0);
+    for (int sy = 0; sy < height; sy++) {
+        for (int sx = 0; sx < width; sx++) {
+            pixels[PixelIndex(sx, sy)] = frame[sy * width + sx];
+        }
+    }
+}
+
+const Uint32 *SoftwareRenderer::Pixels() const
+{
+    if (layout == rowMajor)
+        return pixels.data();
+    deswizzled.resize(width * height);
+    Deswizzle(pixels.data(), width, height, deswizzled.data());
+    return deswizzled.data();
+}
+
+Uint32 *SoftwareRenderer::LoadRow(int sy, int sx0, int sx1)
+{
+    if (layout == rowMajor)
+        return &pixels[sy * width];
+    for (int sx = sx0; sx <= sx1; sx++) {
+        rowScratch[sx] = pixels[SwizzledOffset(sx, sy, tilesX)];
+    }
+    return rowScratch.data();
+}
+
+void SoftwareRenderer::StoreRow(int sy, int sx0, int sx1)
+{
+    if (layout == rowMajor)
+        return;
+    for (int sx = sx0; sx <= sx1; sx++) {
+        pixels[SwizzledOffset(sx, sy, tilesX)] = rowScratch[sx];
+    }
+}
+
+void SoftwareRenderer::FinishFrame()
+{
+    if (recorder)
+        recorder->Submit(Pixels());
+    FrameArena::ForThread().Reset();
+}
+
+void SoftwareRenderer::Clear(const Color &color)
+{
+    const Uint32 pixel = PackColor(color);
+    std::fill(pixels.begin(), pixels.end(), pixel);
+    std::fill(depth.begin(), depth.end(), 0.f);
+}
+
+void SoftwareRenderer::DrawPixel(int x, int y, PackedColor color)
+{
+    const int sx = ScreenX(x);
+    const int sy = ScreenY(y);
+    if (sx < 0 || sx >= width || sy < 0 || sy >= height)
+        return;
+    pixels[PixelIndex(sx, sy)] = PackColor(color);
+}
+
+void SoftwareRenderer::DrawSpan(int x, int y, const PackedColor *colors, int count)
+{
+    const int sy = ScreenY(y);
+    if (sy < 0 || sy >= height)
+        return;
+    int sx = ScreenX(x);
+    int first = 0;
+    if (sx < 0) {
+        first = -sx;
+        sx = 0;
+    }
+    const int last = SDL_min(count, width - ScreenX(x));
+    if (last <= first)
+        return;
+    const int sx0 = sx;
+    Uint32 *row = LoadRow(sy, sx0, sx0 + last - first - 1);
+    for (int i = first; i < last; i++) {
+        row[sx++] = PackColor(colors[i]);
+    }
+    StoreRow(sy, sx0, sx - 1);
+}
+
+// Fills canvas row y from x0 to x1 inclusive, clipped to the framebuffer.
+void SoftwareRenderer::FillRow(int y, int x0, int x1, Uint32 pixel)
+{
+    const int sy = ScreenY(y);
+    if (sy < 0 || sy >= height)
+        return;
+    const int sx0 = SDL_max(ScreenX(x0), 0);
+    const int sx1 = SDL_min(ScreenX(x1), width - 1);
+    Uint32 *row = LoadRow(sy, sx0, sx1);
+    for (int sx = sx0; sx <= sx1; sx++) {
+        row[sx] = pixel;
+    }
+    StoreRow(sy, sx0, sx1);
+}
+
+void SoftwareRenderer::DrawLines(const Vector2 *p0, const Vector2 *p1, int count, const Color &color)
+{
+    const Uint32 pixel = PackColor(color);
+    const float cx = static_cast<float>(width / 2);
+    const float cy = static_cast<float>(height / 2);
+    for (int i = 0; i < count; i++) {
+        RasterizeClippedLine(cx + p0[i].x, cy - p0[i].y, cx + p1[i].x, cy - p1[i].y, 0, 0, width - 1, height - 1, [&](int x, int y) {
+            pixels[PixelIndex(x, y)] = pixel;
+        });
+    }
+}
+
+void SoftwareRenderer::DrawFilledTriangles(const Vector3 *vertices, int triangleCount, const Color &color)
+{
+    const Uint32 pixel = PackColor(color);
+    for (int t = 0; t < triangleCount; t++) {
+        ScanTriangle(&vertices[3 * t], width, height, [&](int y, int first, int last) {
+            FillRow(y, first, last, pixel);
+        });
+    }
+}
+
+void SoftwareRenderer::DrawBlendedTriangles(const Vector3 *vertices, const PackedColor *colors, int triangleCount)
+{
+    for (int t = 0; t < triangleCount; t++) {
+        const PackedColor color = colors[t];
+        const float alpha = static_cast<float>(color.A()) / 255.f;
+        // The fill rule touches pixels on edges shared by neighbours once, so nothing blends twice.
+        ScanTriangle(&vertices[3 * t], width, height, [&](int y, int first, int last) {
+            const int sy = ScreenY(y);
+            Uint32 *row = LoadRow(sy, ScreenX(first), ScreenX(last));
+            for (int x = first; x <= last; x++) {
+                Uint32 &pixel = row[ScreenX(x)];
+                pixel = PackColor(PackedColor(pixel).Lerp(color, alpha));
+            }
+            StoreRow(sy, ScreenX(first), ScreenX(last));
+        });
+    }
+}
+
+void SoftwareRenderer::DrawShadedTriangles(const Vertex *vertices, int triangleCount, const Color &color)
+{
+    const PackedColor packed(color);
+    for (int t = 0; t < triangleCount; t++) {
+        const Vertex *v = &vertices[3 * t];
+        const PlaneGradients plane(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y);
+        if (plane.Degenerate())
+            continue;
+        float dhdx, dhdy;
+        plane.Gradient(v[0].h, v[1].h, v[2].h, dhdx, dhdy);
+
+        ScanTriangle(v, width, height, [&](int y, int first, int last) {
+            FrameArena &arena = FrameArena::ForThread();
+            const ArenaScope scope(arena);
+            const int count = last - first + 1;
+            float *h_segment = arena.Allocate<float>(count);
+            float h = plane.At(v[0].h, dhdx, dhdy, static_cast<float>(first), static_cast<float>(y));
+            for (int i = 0; i < count; i++, h += dhdx) {
+                h_segment[i] = h;
+            }
+            const int sy = ScreenY(y);
+            Uint32 *row = LoadRow(sy, ScreenX(first), ScreenX(last));
+            ScaleSpan(packed, h_segment, &row[ScreenX(first)], count);
+            StoreRow(sy, ScreenX(first), ScreenX(last));
+        });
+    }
+}
+
+void SoftwareRenderer::DrawTexturedTriangles(const TexturedVertex *vertices, int triangleCount, const Texture &texture)
+{
+    for (int t = 0; t < triangleCount; t++) {
+        DrawTexturedTriangle(&vertices[3 * t], texture);
+    }
+}
+
+void SoftwareRenderer::DrawTexturedTriangle(const TexturedVertex *v, const Texture &texture)
+{
+    // u/z, v/z and 1/z are linear in screen space, so each is a plane with constant gradients.
+    const PlaneGradients plane(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y);
+    if (plane.Degenerate())
+        return;
+
+    const float a0 = v[0].u * v[0].invZ, b0 = v[0].v * v[0].invZ, q0 = v[0].invZ;
+    float dadx, dady, dbdx, dbdy, dqdx, dqdy;
+    plane.Gradient(a0, v[1].u * v[1].invZ, v[2].u * v[2].invZ, dadx, dady);
+    plane.Gradient(b0, v[1].v * v[1].invZ, v[2].v * v[2].invZ, dbdx, dbdy);
+    plane.Gradient(q0, v[1].invZ, v[2].invZ, dqdx, dqdy);
+
+    const float texW = static_cast<float>(texture.Width());
+    const float texH = static_cast<float>(texture.Height());
+
+    ScanTriangle(v, width, height, [&](int y, int first, int last) {
+        const int sy = ScreenY(y);
+        const float fx = static_cast<float>(first), fy = static_cast<float>(y);
+        float a = plane.At(a0, dadx, dady, fx, fy);
+        float b = plane.At(b0, dbdx, dbdy, fx, fy);
+        float q = plane.At(q0, dqdx, dqdy, fx, fy);
+        Uint32 *row = LoadRow(sy, ScreenX(first), ScreenX(last));
+        float *depthRow = &depth[sy * width];
+        for (int x = first; x <= last; x++, a += dadx, b += dbdx, q += dqdx) {
+            const int sx = ScreenX(x);
+            if (q <= depthRow[sx])
+                continue;
+            const float z = 1.f / q;
+            const float u = a * z, tv = b * z;
+            // Derivatives of u = a/q and v = b/q give the pixel's footprint in texels.
+            const float dudx = (dadx - u * dqdx) * z * texW, dvdx = (dbdx - tv * dqdx) * z * texH;
+            const float dudy = (dady - u * dqdy) * z * texW, dvdy = (dbdy - tv * dqdy) * z * texH;
+            const float rho = SDL_max(dudx * dudx + dvdx * dvdx, dudy * dudy + dvdy * dvdy);
+            row[sx] = texture.Sample(u, tv, texture.LevelOfDetail(rho));
+            depthRow[sx] = q;
+        }
+        StoreRow(sy, ScreenX(first), ScreenX(last));
+    });
+}
+
+void SoftwareRenderer::ProjectMesh(const Mesh &mesh, const Matrix4 &modelToCanvas)
+{
+    const int n = static_cast<int>(mesh.vertices.size());
+    meshX.resize(n);
+    meshY.resize(n);
+    meshZ.resize(n);
+    projectedX.resize(n);
+    projectedY.resize(n);
+    projectedInvZ.resize(n);
+    for (int i = 0; i < n; i++) {
+        meshX[i] = mesh.vertices[i].x;
+        meshY[i] = mesh.vertices[i].y;
+        meshZ[i] = mesh.vertices[i].z;
+    }
+    TransformProjectVertices(modelToCanvas, ViewportMapping(), meshX.data(), meshY.data(), meshZ.data(), n,
+                             projectedX.data(), projectedY.data(), projectedInvZ.data());
+}
+
+bool SoftwareRenderer::ProjectedTriangle(const Triangle &triangle, Vertex *v) const
+{
+    const int idx[] = { triangle.v0, triangle.v1, triangle.v2 };
+    bool behind = false;
+    for (int k = 0; k < 3; k++) {
+        behind |= projectedInvZ[idx[k]] <= 0;
+        v[k] = Vertex(projectedX[idx[k]], projectedY[idx[k]], projectedInvZ[idx[k]]);
+    }
+    // No near-plane clipping yet: triangles reaching behind the camera are dropped.
+    return !behind;
+}
+
+void SoftwareRenderer::DrawMesh(const Mesh &mesh, const Matrix4 &modelToCanvas)
+{
+    ProjectMesh(mesh, modelToCanvas);
+
+    for (const Triangle &triangle : mesh.triangles) {
+        Vertex v[3];
+        if (!ProjectedTriangle(triangle, v))
+            continue;
+
+        if (mesh.texture) {
+            const size_t t = &triangle - mesh.triangles.data();
+            TexturedVertex tv[3];
+            for (int k = 0; k < 3; k++) {
+                const Vector2 &uv = mesh.uvs[3 * t + k];
+                tv[k] = TexturedVertex(v[k].x, v[k].y, v[k].h, uv.x, uv.y);
+            }
+            DrawTexturedTriangle(tv, *mesh.texture);
+            continue;
+        }
+
+        const PlaneGradients plane(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y);
+        if (plane.Degenerate())
+            continue;
+        float dqdx, dqdy;
+        plane.Gradient(v[0].h, v[1].h, v[2].h, dqdx, dqdy);
+
+        const Uint32 pixel = PackColor(triangle.color);
+        ScanTriangle(v, width, height, [&](int y, int first, int last) {
+            const int sy = ScreenY(y);
+            float invZ = plane.At(v[0].h, dqdx, dqdy, static_cast<float>(first), static_cast<float>(y));
+            Uint32 *row = LoadRow(sy, ScreenX(first), ScreenX(last));
+            float *depthRow = &depth[sy * width];
+            for (int x = first; x <= last; x++, invZ += dqdx) {
+                const int sx = ScreenX(x);
+                // Larger 1/z is closer; the buffer is cleared to 0, i.e. infinitely far away.
+                if (invZ > depthRow[sx]) {
+                    depthRow[sx] = invZ;
+                    row[sx] = pixel;
+                }
+            }
+            StoreRow(sy, ScreenX(first), ScreenX(last));
+        });
+    }
+}
+
+void SoftwareRenderer::DrawGouraudMesh(const Mesh &mesh, const Matrix4 &modelToCanvas, const float *vertexIntensities)
+{
+    ProjectMesh(mesh, modelToCanvas);
+
+    for (const Triangle &triangle : mesh.triangles) {
+        Vertex v[3];
+        if (!ProjectedTriangle(triangle, v))
+            continue;
+
+        const PlaneGradients plane(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y);
+        if (plane.Degenerate())
+            continue;
+        float dqdx, dqdy, dhdx, dhdy;
+        const float h0 = vertexIntensities[triangle.v0];
+        plane.Gradient(v[0].h, v[1].h, v[2].h, dqdx, dqdy);
+        plane.Gradient(h0, vertexIntensities[triangle.v1], vertexIntensities[triangle.v2], dhdx, dhdy);
+        const PackedColor color(triangle.color);
+
+        ScanTriangle(v, width, height, [&](int y, int first, int last) {
+            const int sy = ScreenY(y);
+            const float fx = static_cast<float>(first), fy = static_cast<float>(y);
+            float q = plane.At(v[0].h, dqdx, dqdy, fx, fy);
+            float h = plane.At(h0, dhdx, dhdy, fx, fy);
+            Uint32 *row = LoadRow(sy, ScreenX(first), ScreenX(last));
+            float *depthRow = &depth[sy * width];
+            for (int x = first; x <= last; x++, q += dqdx, h += dhdx) {
+                const int sx = ScreenX(x);
+                if (q > depthRow[sx]) {
+                    depthRow[sx] = q;
+                    row[sx] = PackColor(color.Scaled(h));
+                }
+            }
+            StoreRow(sy, ScreenX(first), ScreenX(last));
+        });
+    }
+}
+
+void SoftwareRenderer::DrawPhongMesh(const Mesh &mesh, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas, SpanShader &shader)
+{
+    ProjectMesh(mesh, cameraToCanvas * modelToCamera);
+
+    const int n = static_cast<int>(mesh.vertices.size());
+    cameraPoints.resize(n);
+    cameraNormals.resize(n);
+    for (int i = 0; i < n; i++) {
+        cameraPoints[i] = modelToCamera.TransformPoint(mesh.vertices[i]);
+        cameraNormals[i] = modelToCamera.TransformDirection(mesh.normals[i]);
+    }
+    spanPoints.resize(width);
+    spanNormals.resize(width);
+    spanIntensities.resize(width);
+    spanColors.resize(width);
+    spanPixels.resize(width);
+
+    for (const Triangle &triangle : mesh.triangles) {
+        Vertex v[3];
+        if (!ProjectedTriangle(triangle, v))
+            continue;
+
+        const PlaneGradients plane(v[0].x, v[0].y, v[1].x, v[1].y, v[2].x, v[2].y);
+        if (plane.Degenerate())
+            continue;
+
+        const PackedColor color(triangle.color);
+
+        // Perspective-correct interpolation of position and normal: interpolate attr/z and 1/z.
+        const int idx[] = { triangle.v0, triangle.v1, triangle.v2 };
+        float attr0[7], dadx[7], dady[7];
+        for (int c = 0; c < 7; c++) {
+            float a[3];
+            for (int k = 0; k < 3; k++) {
+                const Vector3 &p = cameraPoints[idx[k]];
+                const Vector3 &nrm = cameraNormals[idx[k]];
+                const float values[] = { p.x, p.y, p.z, nrm.x, nrm.y, nrm.z, 1.f };
+                a[k] = values[c] * v[k].h;
+            }
+            attr0[c] = a[0];
+            plane.Gradient(a[0], a[1], a[2], dadx[c], dady[c]);
+        }
+
+        ScanTriangle(v, width, height, [&](int y, int first, int last) {
+            const int sy = ScreenY(y);
+            const float fx = static_cast<float>(first), fy = static_cast<float>(y);
+            float a[7];
+            for (int c = 0; c < 7; c++) {
+                a[c] = plane.At(attr0[c], dadx[c], dady[c], fx, fy);
+            }
+
+            // Gather the pixels that pass the depth test, shade them in one call, then write them.
+            float *depthRow = &depth[sy * width];
+            int count = 0;
+            for (int x = first; x <= last; x++) {
+                const int sx = ScreenX(x);
+                const float q = a[6];
+                if (q > depthRow[sx]) {
+                    depthRow[sx] = q;
+                    const float z = 1.f / q;
+                    spanPoints[count] = Vector3(a[0] * z, a[1] * z, a[2] * z);
+                    Vector3 normal(a[3] * z, a[4] * z, a[5] * z);
+                    normal *= 1.f / normal.Length();
+                    spanNormals[count] = normal;
+                    spanPixels[count] = sx;
+                    count++;
+                }
+                for (int c = 0; c < 7; c++) {
+                    a[c] += dadx[c];
+                }
+            }
+            if (count == 0)
+                return;
+
+            shader.Shade(spanPoints.data(), spanNormals.data(), count, spanIntensities.data());
+            ScaleSpan(color, spanIntensities.data(), spanColors.data(), count);
+            Uint32 *row = LoadRow(sy, ScreenX(first), ScreenX(last));
+            for (int i = 0; i < count; i++) {
+                row[spanPixels[i]] = spanColors[i];
+            }
+            StoreRow(sy, ScreenX(first), ScreenX(last));
+        });
+    }
+}
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "Renderer.h"
+#include "TileOrder.h"
+
+#include <SDL_stdinc.h>
+#include <vector>
+
+class FrameRecorder;
+
+// Rasterizes into a CPU framebuffer of PackedColor pixels plus a 1/z depth buffer.
+// Backends derive from this and only decide what Present() does with the finished frame.
+class SoftwareRenderer : public Renderer
+{
+  public:
+    // How the framebuffer is stored. swizzled keeps SWIZZLE_TILE squares of pixels together (see
+    // TileOrder.h), for drawing that wanders in two dimensions. The rasterizer works a row at a
+    // time, so there every span is gathered into scratch and scattered back; the depth buffer
+    // always stays in rows.
+    enum Layout {rowMajor, swizzled};
+
+    SoftwareRenderer(int w, int h);
+
+    // Switches layouts, keeping the frame drawn so far.
+    void SetLayout(Layout l);
+
+    void Clear(const Color &color) override;
+    void DrawPixel(int x, int y, PackedColor color) override;
+    void DrawSpan(int x, int y, const PackedColor *colors, int count) override;
+    void DrawLines(const Vector2 *p0, const Vector2 *p1, int count, const Color &color) override;
+    void DrawFilledTriangles(const Vector3 *vertices, int triangleCount, const Color &color) override;
+    void DrawBlendedTriangles(const Vector3 *vertices, const PackedColor *colors, int triangleCount) override;
+    void DrawShadedTriangles(const Vertex *vertices, int triangleCount, const Color &color) override;
+    void DrawTexturedTriangles(const TexturedVertex *vertices, int triangleCount, const Texture &texture) override;
+    void DrawMesh(const Mesh &mesh, const Matrix4 &modelToCanvas) override;
+    void DrawGouraudMesh(const Mesh &mesh, const Matrix4 &modelToCanvas, const float *vertexIntensities) override;
+    void DrawPhongMesh(const Mesh &mesh, const Matrix4 &modelToCamera, const Matrix4 &cameraToCanvas, SpanShader &shader) override;
+
+    // The frame as rows, top row first. A swizzled frame is deswizzled into a copy on every call,
+    // which backends do once per Present().
+    const Uint32 *Pixels() const;
+    int Pitch() const { return width * static_cast<int>(sizeof(Uint32)); }
+
+    // Every presented frame is also handed to recorder, until this is called with nullptr.
+    void SetRecorder(FrameRecorder *r) { recorder = r; }
+
+    // Framebuffer pixels are always opaque.
+    static Uint32 PackColor(PackedColor color)
+    {
+        return color.value | 0xff000000u;
+    }
+
+  protected:
+    // Backends call this from Present() once they are done with the frame's pixels.
+    void FinishFrame();
+
+    // Canvas to framebuffer coordinates.
+    int ScreenX(int x) const { return width / 2 + x; }
+    int ScreenY(int y) const { return height / 2 - y; }
+
+    // Index of framebuffer pixel (sx, sy) in pixels.
+    size_t PixelIndex(int sx, int sy) const { return layout == rowMajor ? static_cast<size_t>(sy) * width + sx : SwizzledOffset(sx, sy, tilesX); }
+    // Framebuffer row sy, indexed by sx and valid from sx0 to sx1 inclusive. A swizzled frame
+    // gathers those pixels into scratch; StoreRow then writes them back.
+    Uint32 *LoadRow(int sy, int sx0, int sx1);
+    void StoreRow(int sy, int sx0, int sx1);
+
+    void FillRow(int y, int x0, int x1, Uint32 pixel);
+    void DrawTexturedTriangle(const TexturedVertex *v, const Texture &texture);
+    // Fills the projected* arrays for every vertex of mesh.
+    void ProjectMesh(const Mesh &mesh, const Matrix4 &modelToCanvas);
+    // Returns false when the triangle reaches behind the camera.
+    bool ProjectedTriangle(const Triangle &triangle, Vertex *v) const;
+
+    Layout layout;
+    int tilesX; // squares per row of a swizzled frame
+    std::vector<Uint32> pixels;
+    std::vector<float> depth;
+    std::vector<Uint32> rowScratch;
+    mutable std::vector<Uint32> deswizzled;
+
+    // Scratch for the mesh paths, kept between calls so steady-state frames do not reallocate.
+    std::vector<float> meshX, meshY, meshZ;
+    std::vector<float> projectedX, projectedY, projectedInvZ;
+    std::vector<Vector3> cameraPoints, cameraNormals;
+    std::vector<Vector3> spanPoints, spanNormals;
+    std::vector<float> spanIntensities;
+    std::vector<Uint32> spanColors;
+    std::vector<int> spanPixels;
+
+    FrameRecorder *recorder;
+};
@@ -0,0 +1,52 @@
+#include "SphereTileBins.h"
+#include "FrameArena.h"
+#include "HybridRaytracer.h"
+
+#include <string.h>
+
+void SphereTileBins::Build(const std::vector<Sphere> &spheres, const RayCamera &camera, int canvasWidth, int canvasHeight)
+{
+    width = canvasWidth;
+    height = canvasHeight;
+    tilesX = (canvasWidth + tileSize - 1) / tileSize;
+    tilesY = (canvasHeight + tileSize - 1) / tileSize;
+    starts.assign(tilesX * tilesY + 1, 0);
+    rects.assign(4 * spheres.size(), -1);
+
+    // Count each tile's spheres, then place them with a prefix sum over the counts.
+    const int count = static_cast<int>(spheres.size());
+    for (int s = 0; s < count; s++) {
+        int x0, y0, x1, y1;
+        if (!SphereCanvasBounds(spheres[s], camera, canvasWidth, canvasHeight, x0, y0, x1, y1))
+            continue;
+        int *rect = &rects[4 * s];
+        rect[0] = (x0 + canvasWidth / 2) / tileSize;
+        rect[1] = (y0 + canvasHeight / 2) / tileSize;
+        rect[2] = (x1 + canvasWidth / 2) / tileSize;
+        rect[3] = (y1 + canvasHeight / 2) / tileSize;
+        for (int row = rect[1]; row <= rect[3]; row++) {
+            for (int col = rect[0]; col <= rect[2]; col++) {
+                starts[row * tilesX + col + 1]++;
+            }
+        }
+    }
+    for (int t = 0; t < tilesX * tilesY; t++) {
+        starts[t + 1] += starts[t];
+    }
+
+    indices.resize(starts[tilesX * tilesY]);
+    FrameArena &arena = FrameArena::ForThread();
+    const ArenaScope scope(arena);
+    int *next = arena.Allocate<int>(tilesX * tilesY);
+    memcpy(next, starts.data(), tilesX * tilesY * sizeof(int));
+    for (int s = 0; s < count; s++) {
+        const int *rect = &rects[4 * s];
+        if (rect[0] < 0)
+            continue;
+        for (int row = rect[1]; row <= rect[3]; row++) {
+            for (int col = rect[0]; col <= rect[2]; col++) {
+                indices[next[row * tilesX + col]++] = s;
+            }
+        }
+    }
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "Raytracer.h"
+
+#include <math.h>
+#include <vector>
+
+// For each square tile of the canvas, the spheres whose projection may reach it, from their
+// SphereCanvasBounds. A primary ray then only tests its tile's list instead of every sphere. Lists
+// keep the spheres in order, so TraceRay over them finds the same hit, ties included, and since the
+// bounds are padded by a pixel, rays jittered within their pixel are covered too.
+class SphereTileBins
+{
+  public:
+    explicit SphereTileBins(int size = 16) : tileSize(size), width(0), height(0), tilesX(0), tilesY(0) {}
+
+    // Bins spheres as camera sees them. Call again whenever either changes.
+    void Build(const std::vector<Sphere> &spheres, const RayCamera &camera, int canvasWidth, int canvasHeight);
+
+    // The spheres a primary ray through canvas point (x, y) (origin at the centre, y up) can hit.
+    // Points just off the canvas use the nearest tile.
+    const int *Candidates(float x, float y, int &count) const
+    {
+        const int col = SDL_clamp(static_cast<int>(floorf(x + static_cast<float>(width / 2))) / tileSize, 0, tilesX - 1);
+        const int row = SDL_clamp(static_cast<int>(floorf(y + static_cast<float>(height / 2))) / tileSize, 0, tilesY - 1);
+        const int tile = row * tilesX + col;
+        count = starts[tile + 1] - starts[tile];
+        return indices.data() + starts[tile];
+    }
+
+    // Mean list length over the tiles; without binning every ray tests every sphere.
+    float AverageCandidates() const { return tilesX * tilesY > 0 ? static_cast<float>(indices.size()) / static_cast<float>(tilesX * tilesY) : 0.f; }
+
+  private:
+    int tileSize;
+    int width, height;
+    int tilesX, tilesY; // tile rows count up from the bottom of the canvas
+    std::vector<int> starts; // tile t's spheres are indices[starts[t] .. starts[t + 1])
+    std::vector<int> indices;
+    std::vector<int> rects; // x0, y0, x1, y1 in tiles per sphere, or -1s when off the canvas
+};
@@ -0,0 +1,133 @@
+#include "Texture.h"
+
+#include <math.h>
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "raylib-master/src/external/stb_image.h"
+
+static int NextPowerOfTwo(int n)
+{
+    int p = 1;
+    while (p < n) {
+        p <<= 1;
+    }
+    return p;
+}
+
+static Uint32 Channel(Uint32 texel, int shift)
+{
+    return (texel >> shift) & 0xff;
+}
+
+Texture::Level Texture::MakeLevel(int w, int h)
+{
+    Level level;
+    level.width = w;
+    level.height = h;
+    // Levels smaller than a tile still occupy one whole tile.
+    level.tilesPerRow = (w + 3) / 4;
+    level.texels.resize(level.tilesPerRow * ((h + 3) / 4) * 16);
+    return level;
+}
+
+bool Texture::Load(const char *path)
+{
+    int w, h, channels;
+    stbi_uc *data = stbi_load(path, &w, &h, &channels, 4);
+    if (!data)
+        return false;
+
+    std::vector<Uint32> texels(w * h);
+    for (int i = 0; i < w * h; i++) {
+        const stbi_uc *p = &data[4 * i];
+        texels[i] = static_cast<Uint32>(p[0]) | (static_cast<Uint32>(p[1]) << 8) | (static_cast<Uint32>(p[2]) << 16) | (static_cast<Uint32>(p[3]) << 24);
+    }
+    stbi_image_free(data);
+
+    SetPixels(w, h, texels.data());
+    return true;
+}
+
+void Texture::SetPixels(int w, int h, const Uint32 *texels)
+{
+    levels.clear();
+
+    const int pw = NextPowerOfTwo(w);
+    const int ph = NextPowerOfTwo(h);
+    Level base = MakeLevel(pw, ph);
+    for (int y = 0; y < ph; y++) {
+        for (int x = 0; x < pw; x++) {
+            base.SetTexel(x, y, texels[(y * h / ph) * w + (x * w / pw)]);
+        }
+    }
+    levels.push_back(base);
+
+    // 2x2 box filter down to 1x1.
+    while (levels.back().width > 1 || levels.back().height > 1) {
+        const Level &src = levels.back();
+        Level dst = MakeLevel(SDL_max(src.width / 2, 1), SDL_max(src.height / 2, 1));
+        for (int y = 0; y < dst.height; y++) {
+            for (int x = 0; x < dst.width; x++) {
+                const Uint32 t[] = { src.Texel(2 * x, 2 * y), src.Texel(2 * x + 1, 2 * y), src.Texel(2 * x, 2 * y + 1), src.Texel(2 * x + 1, 2 * y + 1) };
+                Uint32 texel = 0;
+                for (int shift = 0; shift < 32; shift += 8) {
+                    const Uint32 sum = Channel(t[0], shift) + Channel(t[1], shift) + Channel(t[2], shift) + Channel(t[3], shift);
+                    texel |= ((sum + 2) / 4) << shift;
+                }
+                dst.SetTexel(x, y, texel);
+            }
+        }
+        levels.push_back(dst);
+    }
+}
+
+Texture Texture::Checkerboard(int size, int squares, const Color &a, const Color &b)
+{
+    const Uint32 ta = static_cast<Uint32>(a.r) | (static_cast<Uint32>(a.g) << 8) | (static_cast<Uint32>(a.b) << 16) | 0xff000000u;
+    const Uint32 tb = static_cast<Uint32>(b.r) | (static_cast<Uint32>(b.g) << 8) | (static_cast<Uint32>(b.b) << 16) | 0xff000000u;
+    const int square = SDL_max(size / squares, 1);
+    std::vector<Uint32> texels(size * size);
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            texels[y * size + x] = ((x / square + y / square) & 1) ? tb : ta;
+        }
+    }
+
+    Texture texture;
+    texture.SetPixels(size, size, texels.data());
+    return texture;
+}
+
+int Texture::LevelOfDetail(float rhoSquared) const
+{
+    if (rhoSquared <= 1.f)
+        return 0;
+    // floor(log2(rho)) = floor(log2(rho^2) / 2), read off the float exponent.
+    int exponent;
+    frexpf(rhoSquared, &exponent);
+    return SDL_min((exponent - 1) / 2, Levels() - 1);
+}
+
+Uint32 Texture::Sample(float u, float v, int level) const
+{
+    const Level &l = levels[level];
+    const float fx = u * static_cast<float>(l.width) - 0.5f;
+    const float fy = v * static_cast<float>(l.height) - 0.5f;
+    const float x0f = floorf(fx);
+    const float y0f = floorf(fy);
+    const int x0 = static_cast<int>(x0f);
+    const int y0 = static_cast<int>(y0f);
+    // 8-bit blend weights keep the filter in integer arithmetic.
+    const Uint32 wx = static_cast<Uint32>((fx - x0f) * 256.f);
+    const Uint32 wy = static_cast<Uint32>((fy - y0f) * 256.f);
+
+    const Uint32 t00 = l.Texel(x0, y0), t10 = l.Texel(x0 + 1, y0);
+    const Uint32 t01 = l.Texel(x0, y0 + 1), t11 = l.Texel(x0 + 1, y0 + 1);
+    Uint32 texel = 0;
+    for (int shift = 0; shift < 32; shift += 8) {
+        const Uint32 top = Channel(t00, shift) * (256 - wx) + Channel(t10, shift) * wx;
+        const Uint32 bottom = Channel(t01, shift) * (256 - wx) + Channel(t11, shift) * wx;
+        texel |= (((top * (256 - wy) + bottom * wy) >> 16) & 0xff) << shift;
+    }
+    return texel;
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Color.h"
+
+#include <SDL_stdinc.h>
+#include <vector>
+
+// Mipmapped texture with power-of-two levels. Each level is stored in 4x4 texel tiles (64 bytes,
+// one cache line) so a bilinear footprint, or a walk across a rotated surface, touches at most a
+// couple of lines instead of one line per texel row.
+class Texture
+{
+  public:
+    Texture() {}
+
+    // Loads an image through stb_image. Returns false if the file cannot be decoded.
+    bool Load(const char *path);
+    // Builds the mip chain from w*h packed ABGR8888 texels; non power-of-two sizes are resampled up.
+    void SetPixels(int w, int h, const Uint32 *texels);
+
+    static Texture Checkerboard(int size, int squares, const Color &a, const Color &b);
+
+    int Width() const { return levels.empty() ? 0 : levels[0].width; }
+    int Height() const { return levels.empty() ? 0 : levels[0].height; }
+    int Levels() const { return static_cast<int>(levels.size()); }
+
+    // Picks the mip level for a footprint of rhoSquared texels^2 per pixel.
+    int LevelOfDetail(float rhoSquared) const;
+    // Bilinear lookup with wrap-around addressing at the given level.
+    Uint32 Sample(float u, float v, int level) const;
+
+  private:
+    class Level
+    {
+      public:
+        Uint32 Texel(int x, int y) const
+        {
+            x &= width - 1;
+            y &= height - 1;
+            return texels[((y >> 2) * tilesPerRow + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3)];
+        }
+
+        void SetTexel(int x, int y, Uint32 texel)
+        {
+            texels[((y >> 2) * tilesPerRow + (x >> 2)) * 16 + (y & 3) * 4 + (x & 3)] = texel;
+        }
+
+        int width, height;
+        int tilesPerRow;
+        std::vector<Uint32> texels;
+    };
+
+    static Level MakeLevel(int w, int h);
+
+    std::vector<Level> levels;
+};
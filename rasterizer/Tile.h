@@ -0,0 +1,8 @@
+#pragma once
+
+// Rectangle of the framebuffer, x right and y down from its top-left corner.
+class Tile
+{
+  public:
+    int x, y, w, h;
+};
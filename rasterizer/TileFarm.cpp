@@ -0,0 +1,313 @@
+#include "TileFarm.h"
+
+#include <SDL_endian.h>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string>
+
+// A tile is never out with more than this many workers at once, counting stolen copies.
+static const int MAX_TILE_COPIES = 3;
+
+// Every message is a header followed by size bytes of payload, all words little-endian.
+//   tileRequest  coordinator -> worker: id, x, y, w, h, canvas width, canvas height
+//   tileResult   worker -> coordinator: id, then the tile's w * h pixels
+//   frameDone    coordinator -> worker: no payload; the worker exits
+enum MessageType {tileRequest = 1, tileResult = 2, frameDone = 3};
+static const int TILE_REQUEST_WORDS = 7;
+
+static Uint64 NowMs()
+{
+    return static_cast<Uint64>(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+// Sends type with words as its payload.
+static bool SendMessage(Socket &socket, Uint32 type, const Uint32 *words, int count)
+{
+    std::vector<Uint32> message(2 + count);
+    message[0] = SDL_SwapLE32(type);
+    message[1] = SDL_SwapLE32(static_cast<Uint32>(count * sizeof(Uint32)));
+    for (int i = 0; i < count; i++) {
+        message[2 + i] = SDL_SwapLE32(words[i]);
+    }
+    return socket.SendAll(message.data(), message.size() * sizeof(Uint32));
+}
+
+// Receives a message whose payload is whole words, up to maxWords of them.
+static bool ReceiveMessage(Socket &socket, Uint32 &type, std::vector<Uint32> &words, size_t maxWords)
+{
+    Uint32 header[2];
+    if (!socket.ReceiveAll(header, sizeof(header)))
+        return false;
+    type = SDL_SwapLE32(header[0]);
+    const Uint32 size = SDL_SwapLE32(header[1]);
+    if (size % sizeof(Uint32) != 0 || size / sizeof(Uint32) > maxWords)
+        return false;
+    words.resize(size / sizeof(Uint32));
+    if (!words.empty() && !socket.ReceiveAll(words.data(), size))
+        return false;
+    for (Uint32 &w : words) {
+        w = SDL_SwapLE32(w);
+    }
+    return true;
+}
+
+TileFarm::TileFarm(int canvasWidth, int canvasHeight, int tileSize)
+    : width(canvasWidth), height(canvasHeight), remaining(0), canvas(nullptr), finished(false), liveWorkers(0),
+      tileTimeout(0), dispatched(0), stolen(0), retried(0), workersSeen(0)
+{
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            TileState state;
+            state.tile.x = x;
+            state.tile.y = y;
+            state.tile.w = SDL_min(tileSize, width - x);
+            state.tile.h = SDL_min(tileSize, height - y);
+            state.done = false;
+            state.copies = 0;
+            state.started = 0;
+            tiles.push_back(state);
+        }
+    }
+}
+
+TileFarm::~TileFarm()
+{
+    // Workers still waiting to be accepted see their connection reset and exit.
+    listener.Close();
+    for (std::thread &t : spawned) {
+        t.join();
+    }
+}
+
+bool TileFarm::Listen(int port)
+{
+    static const bool started = Socket::Startup();
+    return started && listener.Listen(port);
+}
+
+int TileFarm::SpawnLocalWorkers(const char *exe, int count)
+{
+    std::string command = "\"" + std::string(exe) + "\" --worker 127.0.0.1 " + std::to_string(Port());
+#ifdef _WIN32
+    // cmd.exe strips the outer quotes when the line starts with one.
+    command = "\"" + command + "\"";
+#endif
+    for (int i = 0; i < count; i++) {
+        // Each thread only waits for its worker process to exit.
+        spawned.emplace_back([command] { system(command.c_str()); });
+    }
+    return count;
+}
+
+bool TileFarm::Render(PackedColor *output, int workerTimeoutMs, int tileTimeoutMs)
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        canvas = output;
+        tileTimeout = tileTimeoutMs;
+        finished = false;
+        remaining = static_cast<int>(tiles.size());
+        pending.clear();
+        // Handed out from the back, so the frame fills in from the top.
+        for (int i = static_cast<int>(tiles.size()) - 1; i >= 0; i--) {
+            tiles[i].done = false;
+            tiles[i].copies = 0;
+            pending.push_back(i);
+        }
+        dispatched = stolen = retried = 0;
+    }
+
+    std::thread acceptor(&TileFarm::AcceptWorkers, this);
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        Uint64 lastWorkerSeen = NowMs();
+        while (remaining > 0) {
+            changed.wait_for(lock, std::chrono::milliseconds(100));
+            // A hung worker would otherwise keep its tile, and count as live, forever. Cutting its
+            // connection makes ServeWorker requeue the tile and drop the worker.
+            const Uint64 now = NowMs();
+            for (Worker *worker : workers) {
+                if (worker->tile >= 0 && now > worker->deadline) {
+                    worker->socket.Shutdown();
+                    worker->tile = -1;
+                }
+            }
+            if (liveWorkers > 0)
+                lastWorkerSeen = NowMs();
+            else if (NowMs() - lastWorkerSeen > static_cast<Uint64>(workerTimeoutMs))
+                break;
+        }
+        finished = true;
+        // Cuts off workers still busy with a stolen copy. Idle ones are sent frameDone, though a
+        // worker treats a closed connection the same way.
+        for (Worker *worker : workers) {
+            worker->socket.Shutdown();
+        }
+    }
+    changed.notify_all();
+
+    acceptor.join();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+    threads.clear();
+    return remaining == 0;
+}
+
+void TileFarm::AcceptWorkers()
+{
+    while (true) {
+        Socket socket = listener.Accept(100);
+        std::lock_guard<std::mutex> lock(mutex);
+        if (finished)
+            break;
+        if (!socket.IsValid())
+            continue;
+        Worker *worker = new Worker(std::move(socket));
+        workers.push_back(worker);
+        liveWorkers++;
+        workersSeen++;
+        threads.emplace_back(&TileFarm::ServeWorker, this, worker);
+        changed.notify_all();
+    }
+}
+
+int TileFarm::NextTile(Worker &worker)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        if (finished || remaining == 0)
+            return -1;
+
+        int next = -1;
+        while (!pending.empty() && next < 0) {
+            next = pending.back();
+            pending.pop_back();
+            if (tiles[next].done)
+                next = -1;
+        }
+
+        // Nothing queued: back up the tile that has been out longest with the fewest copies.
+        if (next < 0) {
+            for (int i = 0; i < static_cast<int>(tiles.size()); i++) {
+                const TileState &t = tiles[i];
+                if (t.done || t.copies == 0 || t.copies >= MAX_TILE_COPIES)
+                    continue;
+                if (next < 0 || t.copies < tiles[next].copies || (t.copies == tiles[next].copies && t.started < tiles[next].started))
+                    next = i;
+            }
+            if (next >= 0)
+                stolen++;
+        }
+
+        if (next >= 0) {
+            if (tiles[next].copies == 0)
+                tiles[next].started = NowMs();
+            tiles[next].copies++;
+            dispatched++;
+            worker.tile = next;
+            worker.deadline = NowMs() + static_cast<Uint64>(tileTimeout);
+            return next;
+        }
+        changed.wait(lock);
+    }
+}
+
+void TileFarm::ServeWorker(Worker *worker)
+{
+    Socket *socket = &worker->socket;
+    std::vector<Uint32> result;
+    while (true) {
+        const int id = NextTile(*worker);
+        if (id < 0) {
+            SendMessage(*socket, frameDone, nullptr, 0);
+            break;
+        }
+
+        const Tile tile = tiles[id].tile;
+        const Uint32 request[TILE_REQUEST_WORDS] = { static_cast<Uint32>(id), static_cast<Uint32>(tile.x), static_cast<Uint32>(tile.y),
+                                                     static_cast<Uint32>(tile.w), static_cast<Uint32>(tile.h),
+                                                     static_cast<Uint32>(width), static_cast<Uint32>(height) };
+        const size_t pixelCount = static_cast<size_t>(tile.w) * tile.h;
+        Uint32 type = 0;
+        const bool ok = SendMessage(*socket, tileRequest, request, TILE_REQUEST_WORDS) &&
+                        ReceiveMessage(*socket, type, result, 1 + pixelCount) && type == tileResult &&
+                        result.size() == 1 + pixelCount && result[0] == static_cast<Uint32>(id);
+
+        std::lock_guard<std::mutex> lock(mutex);
+        TileState &state = tiles[id];
+        state.copies--;
+        worker->tile = -1;
+        if (ok && !state.done) {
+            for (int row = 0; row < tile.h; row++) {
+                PackedColor *out = &canvas[(tile.y + row) * width + tile.x];
+                for (int i = 0; i < tile.w; i++) {
+                    out[i] = PackedColor(result[1 + row * tile.w + i]);
+                }
+            }
+            state.done = true;
+            remaining--;
+        }
+        changed.notify_all();
+        if (!ok) {
+            // Unless another worker still has a copy, the tile goes back in line.
+            if (!state.done && state.copies == 0 && !finished) {
+                pending.push_back(id);
+                retried++;
+            }
+            break;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < workers.size(); i++) {
+        if (workers[i] == worker) {
+            workers.erase(workers.begin() + i);
+            break;
+        }
+    }
+    liveWorkers--;
+    delete worker;
+    changed.notify_all();
+}
+
+int RunTileWorker(const char *host, int port, TileFunction render)
+{
+    Socket socket;
+    if (!Socket::Startup() || !socket.Connect(host, port)) {
+        printf("Worker: could not connect to %s:%d\n", host, port);
+        return 1;
+    }
+
+    std::vector<Uint32> request, result;
+    std::vector<PackedColor> pixels;
+    int rendered = 0;
+    while (true) {
+        Uint32 type = 0;
+        // A closed connection means the coordinator finished without us.
+        if (!ReceiveMessage(socket, type, request, TILE_REQUEST_WORDS) || type != tileRequest)
+            break;
+        if (request.size() != TILE_REQUEST_WORDS)
+            break;
+
+        Tile tile;
+        tile.x = static_cast<int>(request[1]);
+        tile.y = static_cast<int>(request[2]);
+        tile.w = static_cast<int>(request[3]);
+        tile.h = static_cast<int>(request[4]);
+        pixels.resize(static_cast<size_t>(tile.w) * tile.h);
+        render(tile, static_cast<int>(request[5]), static_cast<int>(request[6]), pixels.data());
+
+        result.resize(1 + pixels.size());
+        result[0] = request[0];
+        for (size_t i = 0; i < pixels.size(); i++) {
+            result[1 + i] = pixels[i].value;
+        }
+        if (!SendMessage(socket, tileResult, result.data(), static_cast<int>(result.size())))
+            break;
+        rendered++;
+    }
+    printf("Worker: rendered %d tiles\n", rendered);
+    return 0;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include "Color.h"
+#include "Socket.h"
+#include "Tile.h"
+
+#include <SDL_stdinc.h>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fills out with tile's w * h pixels, row by row from the top, for a canvasWidth x canvasHeight frame.
+typedef void (*TileFunction)(const Tile &tile, int canvasWidth, int canvasHeight, PackedColor *out);
+
+// Coordinator of a render farm. The canvas is cut into tiles that are handed to worker processes
+// over TCP, one at a time per worker, and the results are assembled as they come back. Workers may
+// connect at any time, from any machine, or be spawned on this one.
+//
+// A worker that disconnects or fails gives its tile back to the queue, and so does one that has had
+// a tile for longer than the tile timeout: its connection is cut. Once the queue is empty, idle
+// workers steal copies of the tiles that have been out longest; the first copy back wins, so one slow
+// or hung worker cannot hold up the frame.
+class TileFarm
+{
+  public:
+    TileFarm(int canvasWidth, int canvasHeight, int tileSize = 64);
+    ~TileFarm();
+
+    // port 0 picks a free port; Port() reports it.
+    bool Listen(int port);
+    int Port() const { return listener.Port(); }
+
+    // Starts count workers on this machine by running exe --worker 127.0.0.1 <port>.
+    int SpawnLocalWorkers(const char *exe, int count);
+
+    // Renders the frame into canvas (canvasWidth * canvasHeight pixels, top row first) and tells the
+    // workers to exit. A worker that takes longer than tileTimeoutMs over one tile is dropped. Fails
+    // when no worker has been connected for workerTimeoutMs.
+    bool Render(PackedColor *canvas, int workerTimeoutMs = 10000, int tileTimeoutMs = 60000);
+
+    int TilesDispatched() const { return dispatched; }
+    int TilesStolen() const { return stolen; }
+    int TilesRetried() const { return retried; }
+    int WorkersSeen() const { return workersSeen; }
+
+  private:
+    class TileState
+    {
+      public:
+        Tile tile;
+        bool done;
+        int copies;     // workers currently rendering it
+        Uint64 started; // when the oldest of those copies went out
+    };
+
+    class Worker
+    {
+      public:
+        explicit Worker(Socket &&s) : socket(std::move(s)), tile(-1), deadline(0) {}
+
+        Socket socket;
+        int tile;        // the tile it is rendering, or -1
+        Uint64 deadline; // when Render cuts it off unless that tile is back
+    };
+
+    void AcceptWorkers();
+    void ServeWorker(Worker *worker);
+    // Blocks until there is a tile for an idle worker and gives it to worker; -1 once the frame is
+    // finished.
+    int NextTile(Worker &worker);
+
+    int width, height;
+    std::vector<TileState> tiles;
+    std::vector<int> pending;
+    int remaining;
+    PackedColor *canvas;
+    bool finished;
+    int liveWorkers;
+    int tileTimeout; // ms
+    int dispatched, stolen, retried, workersSeen;
+
+    Socket listener;
+    std::vector<Worker *> workers;
+    std::vector<std::thread> threads;
+    std::vector<std::thread> spawned;
+    std::mutex mutex;
+    std::condition_variable changed;
+};
+
+// Worker side: connects to the coordinator at host:port and renders tiles with render until the
+// coordinator says the frame is done. Returns a process exit code.
+int RunTileWorker(const char *host, int port, TileFunction render);
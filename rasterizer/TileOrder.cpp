@@ -0,0 +1,79 @@
+#include "TileOrder.h"
+
+#include <algorithm>
+
+Uint32 HilbertIndex(Uint32 side, Uint32 x, Uint32 y)
+{
+    // Walks down from the largest quadrants, turning the cell into each quadrant's orientation.
+    Uint32 d = 0;
+    for (Uint32 s = side / 2; s > 0; s /= 2) {
+        const Uint32 rx = (x & s) ? 1 : 0;
+        const Uint32 ry = (y & s) ? 1 : 0;
+        d += s * s * ((3 * rx) ^ ry);
+        if (ry == 0) {
+            if (rx == 1) {
+                x = side - 1 - x;
+                y = side - 1 - y;
+            }
+            const Uint32 t = x;
+            x = y;
+            y = t;
+        }
+    }
+    return d;
+}
+
+std::vector<Tile> TilesInOrder(int width, int height, int tileSize, TileCurve curve)
+{
+    const int tilesX = (width + tileSize - 1) / tileSize, tilesY = (height + tileSize - 1) / tileSize;
+    Uint32 side = 1;
+    while (side < static_cast<Uint32>(SDL_max(tilesX, tilesY))) {
+        side *= 2;
+    }
+
+    std::vector<std::pair<Uint32, Tile>> keyed;
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            Tile tile;
+            tile.x = tx * tileSize;
+            tile.y = ty * tileSize;
+            tile.w = SDL_min(tileSize, width - tile.x);
+            tile.h = SDL_min(tileSize, height - tile.y);
+            const Uint32 key = curve == mortonTiles    ? MortonIndex(tx, ty)
+                               : curve == hilbertTiles ? HilbertIndex(side, tx, ty)
+                                                       : static_cast<Uint32>(ty * tilesX + tx);
+            keyed.push_back(std::make_pair(key, tile));
+        }
+    }
+    std::sort(keyed.begin(), keyed.end(), [](const std::pair<Uint32, Tile> &a, const std::pair<Uint32, Tile> &b) { return a.first < b.first; });
+
+    std::vector<Tile> tiles;
+    for (const auto &k : keyed) {
+        tiles.push_back(k.second);
+    }
+    return tiles;
+}
+
+void Deswizzle(const Uint32 *swizzled, int width, int height, Uint32 *out)
+{
+    Uint32 columnBits[SWIZZLE_TILE];
+    for (int x = 0; x < SWIZZLE_TILE; x++) {
+        columnBits[x] = MortonIndex(static_cast<Uint32>(x), 0);
+    }
+
+    // A square at a time, so each is read once, in order, while its rows are written out.
+    const int tilesX = (width + SWIZZLE_TILE - 1) / SWIZZLE_TILE;
+    for (int ty = 0; ty < height; ty += SWIZZLE_TILE) {
+        for (int tx = 0; tx < width; tx += SWIZZLE_TILE) {
+            const Uint32 *tile = swizzled + static_cast<size_t>((ty / SWIZZLE_TILE) * tilesX + tx / SWIZZLE_TILE) * (SWIZZLE_TILE * SWIZZLE_TILE);
+            const int w = SDL_min(SWIZZLE_TILE, width - tx), h = SDL_min(SWIZZLE_TILE, height - ty);
+            for (int y = 0; y < h; y++) {
+                Uint32 *row = out + static_cast<size_t>(ty + y) * width + tx;
+                const Uint32 rowBits = MortonIndex(0, static_cast<Uint32>(y));
+                for (int x = 0; x < w; x++) {
+                    row[x] = tile[rowBits | columnBits[x]];
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "Tile.h"
+
+#include <SDL_stdinc.h>
+#include <vector>
+
+// Interleaves the low 16 bits of x and y, with x in the even bits.
+inline Uint32 MortonIndex(Uint32 x, Uint32 y)
+{
+    Uint32 bits[2] = { x & 0xffff, y & 0xffff };
+    for (Uint32 &v : bits) {
+        v = (v | (v << 8)) & 0x00ff00ff;
+        v = (v | (v << 4)) & 0x0f0f0f0f;
+        v = (v | (v << 2)) & 0x33333333;
+        v = (v | (v << 1)) & 0x55555555;
+    }
+    return bits[0] | (bits[1] << 1);
+}
+
+// Distance of cell (x, y) along a Hilbert curve over a side x side grid; side is a power of two.
+Uint32 HilbertIndex(Uint32 side, Uint32 x, Uint32 y);
+
+// Orders in which to walk a frame's tiles. Along either curve, consecutive tiles are neighbours
+// (for Hilbert always, for Morton mostly), so the scene data and framebuffer lines they touch are
+// still in cache when the next tile starts, unlike at the end of a row of tiles.
+enum TileCurve {rowMajorTiles, mortonTiles, hilbertTiles};
+
+// The width x height frame cut into tileSize squares (smaller at the right and bottom edges), in
+// curve order.
+std::vector<Tile> TilesInOrder(int width, int height, int tileSize, TileCurve curve);
+
+// Side of the squares a swizzled framebuffer is stored as. Each square is contiguous and in Morton
+// order inside, so that a pixel's neighbours in either direction are usually in the same cache line
+// or the next.
+static const int SWIZZLE_TILE = 32;
+
+// Pixels a swizzled width x height frame takes, padded out to whole squares.
+inline size_t SwizzledSize(int width, int height)
+{
+    return static_cast<size_t>((width + SWIZZLE_TILE - 1) / SWIZZLE_TILE) * ((height + SWIZZLE_TILE - 1) / SWIZZLE_TILE) * SWIZZLE_TILE * SWIZZLE_TILE;
+}
+
+// Where pixel (x, y), x right and y down from the top-left corner, lies in a swizzled frame that is
+// tilesX squares wide.
+inline size_t SwizzledOffset(int x, int y, int tilesX)
+{
+    return static_cast<size_t>((y / SWIZZLE_TILE) * tilesX + x / SWIZZLE_TILE) * (SWIZZLE_TILE * SWIZZLE_TILE) +
+           MortonIndex(static_cast<Uint32>(x % SWIZZLE_TILE), static_cast<Uint32>(y % SWIZZLE_TILE));
+}
+
+// Copies a swizzled width x height frame into out as rows, top row first.
+void Deswizzle(const Uint32 *swizzled, int width, int height, Uint32 *out);
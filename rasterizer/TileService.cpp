@@ -0,0 +1,124 @@
+#include "TileService.h"
+
+#include <SDL_stdinc.h>
+#include <string.h>
+
+TileService::TileService(int canvasWidth, int canvasHeight, int tileSize, int threadCount)
+    : width(canvasWidth), height(canvasHeight), pixels(canvasWidth * canvasHeight), source(nullptr), generation(0), nextTile(0),
+      busy(0), collected(0), started(0), abandoned(0), quit(false)
+{
+    for (int y = 0; y < height; y += tileSize) {
+        for (int x = 0; x < width; x += tileSize) {
+            Tile tile;
+            tile.x = x;
+            tile.y = y;
+            tile.w = SDL_min(tileSize, width - x);
+            tile.h = SDL_min(tileSize, height - y);
+            tiles.push_back(tile);
+        }
+    }
+
+    if (threadCount <= 0)
+        threadCount = SDL_max(static_cast<int>(std::thread::hardware_concurrency()), 1);
+    for (int i = 0; i < threadCount; i++) {
+        threads.emplace_back(&TileService::Work, this);
+    }
+}
+
+TileService::~TileService()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        quit = true;
+        generation++;
+    }
+    wake.notify_all();
+    for (std::thread &t : threads) {
+        t.join();
+    }
+}
+
+void TileService::Start(const FrameSource *s)
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    // With no source, workers take no new tiles; those mid-tile see the new generation at their
+    // next row and leave.
+    source = nullptr;
+    generation++;
+    idle.wait(lock, [this] { return busy == 0; });
+
+    source = s;
+    nextTile = 0;
+    finished.clear();
+    collected = 0;
+    if (s)
+        started++;
+    lock.unlock();
+    wake.notify_all();
+}
+
+int TileService::CollectTiles(PackedColor *canvas)
+{
+    // Finished tiles stay untouched until the next Start, which only the caller can make.
+    std::vector<int> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        ready.swap(finished);
+        collected += static_cast<int>(ready.size());
+    }
+    for (int id : ready) {
+        const Tile &tile = tiles[id];
+        for (int row = 0; row < tile.h; row++) {
+            const int offset = (tile.y + row) * width + tile.x;
+            memcpy(&canvas[offset], &pixels[offset], tile.w * sizeof(PackedColor));
+        }
+    }
+    return static_cast<int>(ready.size());
+}
+
+bool TileService::FrameDone() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return source != nullptr && collected == static_cast<int>(tiles.size());
+}
+
+int TileService::TilesAbandoned() const
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return abandoned;
+}
+
+void TileService::Work()
+{
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        wake.wait(lock, [this] { return quit || (source && nextTile < static_cast<int>(tiles.size())); });
+        if (quit)
+            break;
+
+        const int id = nextTile++;
+        const int frame = generation;
+        const FrameSource *frameSource = source;
+        busy++;
+        lock.unlock();
+
+        const Tile &tile = tiles[id];
+        bool complete = true;
+        for (int row = 0; row < tile.h; row++) {
+            if (generation.load(std::memory_order_relaxed) != frame) {
+                complete = false;
+                break;
+            }
+            frameSource->RenderSpan(tile.x, tile.y + row, tile.w, width, height, &pixels[(tile.y + row) * width + tile.x]);
+        }
+
+        lock.lock();
+        busy--;
+        if (complete && generation == frame)
+            finished.push_back(id);
+        else
+            abandoned++;
+        if (busy == 0)
+            idle.notify_all();
+    }
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Color.h"
+#include "Tile.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// One frame for a TileService to render, holding whatever the frame depends on, such as the camera.
+// RenderSpan is called from the service's threads, several at once.
+class FrameSource
+{
+  public:
+    virtual ~FrameSource() {}
+    // Fills out with count pixels of framebuffer row y from column x, for a canvasWidth x canvasHeight
+    // frame (x right and y down from the top-left corner).
+    virtual void RenderSpan(int x, int y, int count, int canvasWidth, int canvasHeight, PackedColor *out) const = 0;
+};
+
+// Renders frames in the background, tile by tile on a pool of threads, for viewers that must keep
+// responding to input. Only one frame is ever in flight: starting another cancels it, and workers
+// drop its queued tiles and abandon the ones they are on at the next row, so a camera move is never
+// stuck behind the rest of a stale frame.
+//
+// The caller picks up finished tiles with CollectTiles, which lets it show a frame as it fills in.
+class TileService
+{
+  public:
+    // threadCount 0 uses every hardware thread.
+    TileService(int canvasWidth, int canvasHeight, int tileSize = 32, int threadCount = 0);
+    ~TileService();
+
+    // Cancels the frame in flight and starts rendering source, which must outlive the frame. The old
+    // frame's source is no longer in use once this returns; that waits at most for each worker to
+    // finish the row it is on.
+    void Start(const FrameSource *source);
+    void Cancel() { Start(nullptr); }
+
+    // Copies the current frame's tiles that have finished since the last call into canvas
+    // (canvasWidth * canvasHeight pixels, top row first). Returns how many there were.
+    int CollectTiles(PackedColor *canvas);
+
+    // Whether every tile of the current frame has been collected.
+    bool FrameDone() const;
+
+    int FramesStarted() const { return started; }
+    // Tiles a cancellation cut off part way through.
+    int TilesAbandoned() const;
+
+  private:
+    void Work();
+
+    int width, height;
+    std::vector<Tile> tiles;
+    std::vector<PackedColor> pixels;
+
+    const FrameSource *source;
+    std::atomic<int> generation; // bumped by Start; workers compare it between rows
+    int nextTile;
+    int busy; // workers inside RenderSpan
+    std::vector<int> finished;
+    int collected;
+    int started, abandoned;
+    bool quit;
+
+    mutable std::mutex mutex;
+    std::condition_variable wake, idle;
+    std::vector<std::thread> threads;
+};
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <SDL_stdinc.h>
+#include <math.h>
+
+// Vertices are snapped to 28.4 fixed point: 1/16 pixel precision. Triangles reaching further than
+// SUBPIXEL_LIMIT pixels from the canvas centre are rejected, which keeps the 64-bit edge setup
+// from overflowing.
+static const int SUBPIXEL_BITS = 4;
+static const float SUBPIXEL_LIMIT = static_cast<float>(1 << 24);
+
+inline Sint64 FloorDiv(Sint64 n, Sint64 d)
+{
+    const Sint64 q = n / d;
+    return q * d != n && (n < 0) != (d < 0) ? q - 1 : q;
+}
+
+// Edge a->b of a counter-clockwise (y up) triangle, as A x + B y + C, in 28.4 units scaled so that
+// stepping one pixel in x adds A. Sample points with a value >= 0 are covered; edges that do not
+// own the points on them are biased by -1, which for integers turns >= into >.
+class FixedEdge
+{
+  public:
+    FixedEdge(Sint64 xa, Sint64 ya, Sint64 xb, Sint64 yb)
+    {
+        const Sint64 one = 1 << SUBPIXEL_BITS;
+        A = (ya - yb) * one;
+        B = (xb - xa) * one;
+        C = (yb - ya) * xa - (xb - xa) * ya;
+        // Top-left rule: points exactly on an edge belong to the triangle that lies to the edge's
+        // right (a left edge) or below it (a top edge). Two triangles sharing an edge see it
+        // reversed, so exactly one of them owns the points on it.
+        const bool topLeft = A > 0 || (A == 0 && B < 0);
+        if (!topLeft)
+            C -= 1;
+    }
+
+    Sint64 A, B, C;
+};
+
+// Calls span(y, first, last) for every canvas row y in [minY, maxY] the triangle covers, with the
+// covered pixels first..last inclusive and clipped to [minX, maxX]. A pixel is covered when its
+// integer canvas coordinates lie inside the triangle after snapping, with ties broken by the
+// top-left rule, so the triangles of a mesh touch every pixel along their shared edges once.
+// Either winding is accepted; degenerate triangles draw nothing.
+template <typename Span>
+void RasterizeTriangle(float x0, float y0, float x1, float y1, float x2, float y2, int minX, int minY, int maxX, int maxY, Span &&span)
+{
+    const float coords[] = { x0, y0, x1, y1, x2, y2 };
+    Sint64 fixed[6];
+    for (int k = 0; k < 6; k++) {
+        if (!(fabsf(coords[k]) < SUBPIXEL_LIMIT))
+            return;
+        fixed[k] = static_cast<Sint64>(floorf(coords[k] * (1 << SUBPIXEL_BITS) + 0.5f));
+    }
+    Sint64 ax = fixed[0], ay = fixed[1], bx = fixed[2], by = fixed[3], cx = fixed[4], cy = fixed[5];
+    const Sint64 area = (bx - ax) * (cy - ay) - (by - ay) * (cx - ax);
+    if (area == 0)
+        return;
+    if (area < 0) {
+        Sint64 t = bx;
+        bx = cx;
+        cx = t;
+        t = by;
+        by = cy;
+        cy = t;
+    }
+    const FixedEdge edges[] = { FixedEdge(ax, ay, bx, by), FixedEdge(bx, by, cx, cy), FixedEdge(cx, cy, ax, ay) };
+
+    const Sint64 one = 1 << SUBPIXEL_BITS;
+    const Sint64 lowY = SDL_min(ay, SDL_min(by, cy)), highY = SDL_max(ay, SDL_max(by, cy));
+    const int firstRow = static_cast<int>(SDL_max(-FloorDiv(-lowY, one), static_cast<Sint64>(minY)));
+    const int lastRow = static_cast<int>(SDL_min(FloorDiv(highY, one), static_cast<Sint64>(maxY)));
+    for (int y = firstRow; y <= lastRow; y++) {
+        Sint64 first = minX, last = maxX;
+        for (const FixedEdge &e : edges) {
+            // Covered where A x + r >= 0 along this row.
+            const Sint64 r = e.B * y + e.C;
+            if (e.A > 0) {
+                first = SDL_max(first, -FloorDiv(r, e.A));
+            } else if (e.A < 0) {
+                last = SDL_min(last, FloorDiv(r, -e.A));
+            } else if (r < 0) {
+                first = last + 1;
+            }
+        }
+        if (first <= last)
+            span(y, static_cast<int>(first), static_cast<int>(last));
+    }
+}
@@ -52,11 +52,21 @@ class Vector3
         return (x * v.x) + (y * v.y) + (z * v.z);
     }
 
+    Vector3 Cross(const Vector3 &v) const
+    {
+        return Vector3(y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x);
+    }
+
     float Length() const
     {
         return sqrtf(x * x + y * y + z * z);
     }
 
+    bool operator==(const Vector3 &v) const
+    {
+        return x == v.x && y == v.y && z == v.z;
+    }
+
     float x, y, z;
 };
 
@@ -114,3 +124,105 @@ class Vector2
 
     float x, y;
 };
+
+class Matrix4
+{
+  public:
+    Matrix4() : Matrix4(1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1) {}
+    Matrix4(float m00, float m01, float m02, float m03,
+            float m10, float m11, float m12, float m13,
+            float m20, float m21, float m22, float m23,
+            float m30, float m31, float m32, float m33)
+        : m{ { m00, m01, m02, m03 }, { m10, m11, m12, m13 }, { m20, m21, m22, m23 }, { m30, m31, m32, m33 } }
+    {
+    }
+
+    static Matrix4 Translation(const Vector3 &t)
+    {
+        return { 1, 0, 0, t.x, 0, 1, 0, t.y, 0, 0, 1, t.z, 0, 0, 0, 1 };
+    }
+
+    static Matrix4 Scale(float s)
+    {
+        return { s, 0, 0, 0, 0, s, 0, 0, 0, 0, s, 0, 0, 0, 0, 1 };
+    }
+
+    // Rotation around the vertical axis, in degrees like the rest of the book.
+    static Matrix4 RotationY(float degrees)
+    {
+        const float rad = degrees * 3.14159265f / 180.f;
+        const float c = cosf(rad), s = sinf(rad);
+        return { c, 0, -s, 0, 0, 1, 0, 0, s, 0, c, 0, 0, 0, 0, 1 };
+    }
+
+    // Projection onto the viewport plane at distance d; w ends up as the camera-space z.
+    static Matrix4 Perspective(float d)
+    {
+        return { d, 0, 0, 0, 0, d, 0, 0, 0, 0, 1, 0, 0, 0, 1, 0 };
+    }
+
+    Matrix4 operator*(const Matrix4 &o) const
+    {
+        Matrix4 r;
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                r.m[i][j] = m[i][0] * o.m[0][j] + m[i][1] * o.m[1][j] + m[i][2] * o.m[2][j] + m[i][3] * o.m[3][j];
+            }
+        }
+        return r;
+    }
+
+    // Treats v as a direction (w = 0): only the upper 3x3 applies.
+    Vector3 TransformDirection(const Vector3 &v) const
+    {
+        return { m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                 m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                 m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z };
+    }
+
+    // Inverse of a matrix whose last row is 0 0 0 1 (any mix of translations, rotations and scales).
+    Matrix4 AffineInverse() const
+    {
+        const float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        const float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        const float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        const float invDet = 1.f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+
+        Matrix4 r;
+        r.m[0][0] = c00 * invDet;
+        r.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * invDet;
+        r.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * invDet;
+        r.m[1][0] = c01 * invDet;
+        r.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * invDet;
+        r.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * invDet;
+        r.m[2][0] = c02 * invDet;
+        r.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * invDet;
+        r.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * invDet;
+        const Vector3 t = r.TransformDirection(Vector3(m[0][3], m[1][3], m[2][3]));
+        r.m[0][3] = -t.x;
+        r.m[1][3] = -t.y;
+        r.m[2][3] = -t.z;
+        return r;
+    }
+
+    bool operator==(const Matrix4 &o) const
+    {
+        for (int i = 0; i < 4; i++) {
+            for (int j = 0; j < 4; j++) {
+                if (m[i][j] != o.m[i][j])
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Treats v as a point (w = 1) and drops the resulting w.
+    Vector3 TransformPoint(const Vector3 &v) const
+    {
+        return { m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z + m[0][3],
+                 m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z + m[1][3],
+                 m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z + m[2][3] };
+    }
+
+    float m[4][4];
+};
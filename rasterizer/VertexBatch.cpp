@@ -0,0 +1,68 @@
+#include "VertexBatch.h"
+#include "Simd.h"
+
+static void TransformProjectScalar(const Matrix4 &m, const ViewportMapping &viewport,
+                                   const float *xs, const float *ys, const float *zs, int begin, int end,
+                                   float *outX, float *outY, float *outInvW)
+{
+    for (int i = begin; i < end; i++) {
+        const float x = xs[i], y = ys[i], z = zs[i];
+        const float px = m.m[0][0] * x + m.m[0][1] * y + m.m[0][2] * z + m.m[0][3];
+        const float py = m.m[1][0] * x + m.m[1][1] * y + m.m[1][2] * z + m.m[1][3];
+        const float pw = m.m[3][0] * x + m.m[3][1] * y + m.m[3][2] * z + m.m[3][3];
+        const float invW = 1.f / pw;
+        outX[i] = px * invW * viewport.scaleX + viewport.offsetX;
+        outY[i] = py * invW * viewport.scaleY + viewport.offsetY;
+        outInvW[i] = invW;
+    }
+}
+
+void TransformProjectVertices(const Matrix4 &m, const ViewportMapping &viewport,
+                              const float *xs, const float *ys, const float *zs, int count,
+                              float *outX, float *outY, float *outInvW)
+{
+    int i = 0;
+
+#if defined(RENDER_AVX)
+    {
+        // Row 2 (z) is not needed for the canvas position, so only three rows are evaluated.
+        const __m256 m00 = _mm256_set1_ps(m.m[0][0]), m01 = _mm256_set1_ps(m.m[0][1]), m02 = _mm256_set1_ps(m.m[0][2]), m03 = _mm256_set1_ps(m.m[0][3]);
+        const __m256 m10 = _mm256_set1_ps(m.m[1][0]), m11 = _mm256_set1_ps(m.m[1][1]), m12 = _mm256_set1_ps(m.m[1][2]), m13 = _mm256_set1_ps(m.m[1][3]);
+        const __m256 m30 = _mm256_set1_ps(m.m[3][0]), m31 = _mm256_set1_ps(m.m[3][1]), m32 = _mm256_set1_ps(m.m[3][2]), m33 = _mm256_set1_ps(m.m[3][3]);
+        const __m256 sx = _mm256_set1_ps(viewport.scaleX), sy = _mm256_set1_ps(viewport.scaleY);
+        const __m256 ox = _mm256_set1_ps(viewport.offsetX), oy = _mm256_set1_ps(viewport.offsetY);
+        const __m256 one = _mm256_set1_ps(1.f);
+        for (; i + 8 <= count; i += 8) {
+            const __m256 x = _mm256_loadu_ps(xs + i), y = _mm256_loadu_ps(ys + i), z = _mm256_loadu_ps(zs + i);
+            const __m256 px = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m00, x), _mm256_mul_ps(m01, y)), _mm256_add_ps(_mm256_mul_ps(m02, z), m03));
+            const __m256 py = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m10, x), _mm256_mul_ps(m11, y)), _mm256_add_ps(_mm256_mul_ps(m12, z), m13));
+            const __m256 pw = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(m30, x), _mm256_mul_ps(m31, y)), _mm256_add_ps(_mm256_mul_ps(m32, z), m33));
+            const __m256 invW = _mm256_div_ps(one, pw);
+            _mm256_storeu_ps(outX + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(px, invW), sx), ox));
+            _mm256_storeu_ps(outY + i, _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(py, invW), sy), oy));
+            _mm256_storeu_ps(outInvW + i, invW);
+        }
+    }
+#elif defined(RENDER_SSE2)
+    {
+        const __m128 m00 = _mm_set1_ps(m.m[0][0]), m01 = _mm_set1_ps(m.m[0][1]), m02 = _mm_set1_ps(m.m[0][2]), m03 = _mm_set1_ps(m.m[0][3]);
+        const __m128 m10 = _mm_set1_ps(m.m[1][0]), m11 = _mm_set1_ps(m.m[1][1]), m12 = _mm_set1_ps(m.m[1][2]), m13 = _mm_set1_ps(m.m[1][3]);
+        const __m128 m30 = _mm_set1_ps(m.m[3][0]), m31 = _mm_set1_ps(m.m[3][1]), m32 = _mm_set1_ps(m.m[3][2]), m33 = _mm_set1_ps(m.m[3][3]);
+        const __m128 sx = _mm_set1_ps(viewport.scaleX), sy = _mm_set1_ps(viewport.scaleY);
+        const __m128 ox = _mm_set1_ps(viewport.offsetX), oy = _mm_set1_ps(viewport.offsetY);
+        const __m128 one = _mm_set1_ps(1.f);
+        for (; i + 4 <= count; i += 4) {
+            const __m128 x = _mm_loadu_ps(xs + i), y = _mm_loadu_ps(ys + i), z = _mm_loadu_ps(zs + i);
+            const __m128 px = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m01, y)), _mm_add_ps(_mm_mul_ps(m02, z), m03));
+            const __m128 py = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m10, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m12, z), m13));
+            const __m128 pw = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m30, x), _mm_mul_ps(m31, y)), _mm_add_ps(_mm_mul_ps(m32, z), m33));
+            const __m128 invW = _mm_div_ps(one, pw);
+            _mm_storeu_ps(outX + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(px, invW), sx), ox));
+            _mm_storeu_ps(outY + i, _mm_add_ps(_mm_mul_ps(_mm_mul_ps(py, invW), sy), oy));
+            _mm_storeu_ps(outInvW + i, invW);
+        }
+    }
+#endif
+
+    TransformProjectScalar(m, viewport, xs, ys, zs, i, count, outX, outY, outInvW);
+}
@@ -0,0 +1,21 @@
+#pragma once
+
+#include "Vector.h"
+
+// Maps projected viewport coordinates to canvas coordinates: out = in * scale + offset.
+class ViewportMapping
+{
+  public:
+    ViewportMapping(float sx, float sy, float ox, float oy) : scaleX(sx), scaleY(sy), offsetX(ox), offsetY(oy) {}
+    ViewportMapping() : ViewportMapping(1, 1, 0, 0) {}
+
+    float scaleX, scaleY;
+    float offsetX, offsetY;
+};
+
+// Transforms count vertices, given as separate x/y/z arrays, by m, divides by the resulting w and
+// applies the viewport mapping, all in one pass. outInvW receives 1/w so callers can depth test and
+// interpolate perspective-correctly without redoing the divide. Arrays need not be aligned.
+void TransformProjectVertices(const Matrix4 &m, const ViewportMapping &viewport,
+                              const float *xs, const float *ys, const float *zs, int count,
+                              float *outX, float *outY, float *outInvW);
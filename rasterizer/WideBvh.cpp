@@ -0,0 +1,196 @@
+#include "WideBvh.h"
+#include "Simd.h"
+
+#include <math.h>
+#include <string.h>
+
+// Tolerance on the far side of each slab, so that rounding in the grid-space slab test cannot cull a
+// ray that only grazes a box.
+static const float FAR_SLACK = 1.0000004f;
+
+static float Axis(const Vector3 &v, int axis)
+{
+    return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Smallest power-of-two step, as an exponent, for which 255 steps from lo reach hi.
+static int GridExponent(float lo, float hi)
+{
+    int exponent = -100;
+    if (hi > lo)
+        frexpf((hi - lo) / 255.f, &exponent);
+    exponent = SDL_max(exponent, -100);
+    while (exponent < 127 && lo + 255.f * ldexpf(1.f, exponent) < hi) {
+        exponent++;
+    }
+    return exponent;
+}
+
+static Uint8 QuantizeLow(float v, float origin, float step)
+{
+    int q = SDL_clamp(static_cast<int>(floorf((v - origin) / step)), 0, 255);
+    while (q > 0 && origin + static_cast<float>(q) * step > v) {
+        q--;
+    }
+    return static_cast<Uint8>(q);
+}
+
+static Uint8 QuantizeHigh(float v, float origin, float step)
+{
+    int q = SDL_clamp(static_cast<int>(ceilf((v - origin) / step)), 0, 255);
+    while (q < 255 && origin + static_cast<float>(q) * step < v) {
+        q++;
+    }
+    return static_cast<Uint8>(q);
+}
+
+void WideBvh::Build(const Bvh &binary)
+{
+    nodes.clear();
+    items = binary.Items();
+    if (binary.Nodes().empty())
+        return;
+    nodes.reserve(binary.Nodes().size() / 4 + 1);
+    Collapse(binary.Nodes(), 0);
+}
+
+Uint32 WideBvh::Collapse(const std::vector<BvhNode> &binary, int index)
+{
+    // Open up the binary subtree under index, always splitting the interior node with the largest
+    // box, until there are eight subtrees or only leaves are left.
+    int open[8], count = 0;
+    if (binary[index].count > 0) {
+        open[count++] = index;
+    } else {
+        open[count++] = binary[index].first;
+        open[count++] = binary[index].first + 1;
+    }
+    while (count < 8) {
+        int largest = -1;
+        float largestArea = -1;
+        for (int i = 0; i < count; i++) {
+            const BvhNode &node = binary[open[i]];
+            if (node.count == 0 && node.bounds.SurfaceArea() > largestArea) {
+                largest = i;
+                largestArea = node.bounds.SurfaceArea();
+            }
+        }
+        if (largest < 0)
+            break;
+        const int split = open[largest];
+        open[largest] = binary[split].first;
+        open[count++] = binary[split].first + 1;
+    }
+
+    const Uint32 slot = static_cast<Uint32>(nodes.size());
+    nodes.emplace_back();
+    WideBvhNode node;
+    memset(&node, 0, sizeof(node));
+    node.childCount = static_cast<Uint8>(count);
+
+    Aabb bounds;
+    for (int i = 0; i < count; i++) {
+        bounds.Grow(binary[open[i]].bounds);
+    }
+    float *origins[3] = { &node.originX, &node.originY, &node.originZ };
+    Sint8 *exponents[3] = { &node.exponentX, &node.exponentY, &node.exponentZ };
+    Uint8 *los[3] = { node.loX, node.loY, node.loZ };
+    Uint8 *his[3] = { node.hiX, node.hiY, node.hiZ };
+    for (int axis = 0; axis < 3; axis++) {
+        const float origin = Axis(bounds.min, axis);
+        const int exponent = GridExponent(origin, Axis(bounds.max, axis));
+        const float step = ldexpf(1.f, exponent);
+        *origins[axis] = origin;
+        *exponents[axis] = static_cast<Sint8>(exponent);
+        for (int i = 0; i < count; i++) {
+            los[axis][i] = QuantizeLow(Axis(binary[open[i]].bounds.min, axis), origin, step);
+            his[axis][i] = QuantizeHigh(Axis(binary[open[i]].bounds.max, axis), origin, step);
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        const BvhNode &child = binary[open[i]];
+        // Binary leaves hold at most a handful of items, well within the four bits a leaf has.
+        if (child.count > 0)
+            node.children[i] = LEAF | static_cast<Uint32>(child.first) << 4 | static_cast<Uint32>(child.count);
+        else
+            node.children[i] = Collapse(binary, open[i]);
+    }
+    nodes[slot] = node;
+    return slot;
+}
+
+#if defined(RENDER_SSE2)
+// Widens four bytes to four floats.
+static inline __m128 BytesToFloats(const Uint8 *bytes)
+{
+    Sint32 packed;
+    memcpy(&packed, bytes, sizeof(packed));
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i words = _mm_unpacklo_epi8(_mm_cvtsi32_si128(packed), zero);
+    return _mm_cvtepi32_ps(_mm_unpacklo_epi16(words, zero));
+}
+#endif
+
+int WideBvh::IntersectChildren(const WideBvhNode &node, const Vector3 &O, const Vector3 &invD, float tmin, float tmax, float *tNear)
+{
+    // In grid steps, side q of a box is crossed at t = q * scale + offset along each axis.
+    const float scaleX = ldexpf(1.f, node.exponentX) * invD.x, offsetX = (node.originX - O.x) * invD.x;
+    const float scaleY = ldexpf(1.f, node.exponentY) * invD.y, offsetY = (node.originY - O.y) * invD.y;
+    const float scaleZ = ldexpf(1.f, node.exponentZ) * invD.z, offsetZ = (node.originZ - O.z) * invD.z;
+    int mask = 0;
+
+#if defined(RENDER_AVX)
+    {
+        auto load = [](const Uint8 *bytes) {
+            return _mm256_insertf128_ps(_mm256_castps128_ps256(BytesToFloats(bytes)), BytesToFloats(bytes + 4), 1);
+        };
+        auto slab = [&](const Uint8 *lo, const Uint8 *hi, float scale, float offset, __m256 &nearT, __m256 &farT) {
+            const __m256 s = _mm256_set1_ps(scale), o = _mm256_set1_ps(offset);
+            const __m256 t0 = _mm256_add_ps(_mm256_mul_ps(load(lo), s), o);
+            const __m256 t1 = _mm256_add_ps(_mm256_mul_ps(load(hi), s), o);
+            nearT = _mm256_max_ps(nearT, _mm256_min_ps(t0, t1));
+            farT = _mm256_min_ps(farT, _mm256_max_ps(t0, t1));
+        };
+        __m256 nearT = _mm256_set1_ps(tmin), farT = _mm256_set1_ps(tmax);
+        slab(node.loX, node.hiX, scaleX, offsetX, nearT, farT);
+        slab(node.loY, node.hiY, scaleY, offsetY, nearT, farT);
+        slab(node.loZ, node.hiZ, scaleZ, offsetZ, nearT, farT);
+        _mm256_storeu_ps(tNear, nearT);
+        mask = _mm256_movemask_ps(_mm256_cmp_ps(nearT, _mm256_mul_ps(farT, _mm256_set1_ps(FAR_SLACK)), _CMP_LE_OQ));
+    }
+#elif defined(RENDER_SSE2)
+    for (int half = 0; half < 8; half += 4) {
+        auto slab = [&](const Uint8 *lo, const Uint8 *hi, float scale, float offset, __m128 &nearT, __m128 &farT) {
+            const __m128 s = _mm_set1_ps(scale), o = _mm_set1_ps(offset);
+            const __m128 t0 = _mm_add_ps(_mm_mul_ps(BytesToFloats(lo + half), s), o);
+            const __m128 t1 = _mm_add_ps(_mm_mul_ps(BytesToFloats(hi + half), s), o);
+            nearT = _mm_max_ps(nearT, _mm_min_ps(t0, t1));
+            farT = _mm_min_ps(farT, _mm_max_ps(t0, t1));
+        };
+        __m128 nearT = _mm_set1_ps(tmin), farT = _mm_set1_ps(tmax);
+        slab(node.loX, node.hiX, scaleX, offsetX, nearT, farT);
+        slab(node.loY, node.hiY, scaleY, offsetY, nearT, farT);
+        slab(node.loZ, node.hiZ, scaleZ, offsetZ, nearT, farT);
+        _mm_storeu_ps(tNear + half, nearT);
+        mask |= _mm_movemask_ps(_mm_cmple_ps(nearT, _mm_mul_ps(farT, _mm_set1_ps(FAR_SLACK)))) << half;
+    }
+#else
+    for (int i = 0; i < 8; i++) {
+        auto slab = [&](const Uint8 *lo, const Uint8 *hi, float scale, float offset, float &nearT, float &farT) {
+            const float t0 = static_cast<float>(lo[i]) * scale + offset, t1 = static_cast<float>(hi[i]) * scale + offset;
+            nearT = SDL_max(nearT, SDL_min(t0, t1));
+            farT = SDL_min(farT, SDL_max(t0, t1));
+        };
+        float nearT = tmin, farT = tmax;
+        slab(node.loX, node.hiX, scaleX, offsetX, nearT, farT);
+        slab(node.loY, node.hiY, scaleY, offsetY, nearT, farT);
+        slab(node.loZ, node.hiZ, scaleZ, offsetZ, nearT, farT);
+        tNear[i] = nearT;
+        mask |= (nearT <= farT * FAR_SLACK) << i;
+    }
+#endif
+
+    // Empty slots hold zero-sized boxes at the origin, which a ray can still touch.
+    return mask & ((1 << node.childCount) - 1);
+}
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "Bvh.h"
+
+#include <SDL_stdinc.h>
+#include <vector>
+
+// Up to eight children's boxes, each side stored as an 8-bit step count on a per-node grid: a side q
+// lies at origin + q * 2^exponent along its axis. Rounding is outward, so a child's quantized box
+// always contains its real one.
+class WideBvhNode
+{
+  public:
+    float originX, originY, originZ;
+    Sint8 exponentX, exponentY, exponentZ;
+    Uint8 childCount; // children fill slots 0 .. childCount - 1
+    Uint8 loX[8], loY[8], loZ[8];
+    Uint8 hiX[8], hiY[8], hiZ[8];
+    // An interior child's node index, or for a leaf WideBvh::LEAF | first << 4 | count, owning
+    // items[first .. first + count).
+    Uint32 children[8];
+};
+
+// Eight-wide BVH with quantized child boxes, collapsed from a binary Bvh. A node is 96 bytes for up
+// to eight children against 32 bytes per child in the binary tree, so the nodes take about half the
+// memory even though leaves leave many slots empty, and a ray tests several boxes per node fetch
+// instead of two; with AVX it tests all eight at once.
+//
+// It has no refit of its own: after the binary tree changes, build the wide one again from it,
+// which is cheap next to building the binary tree.
+class WideBvh
+{
+  public:
+    static const Uint32 LEAF = 0x80000000u;
+
+    void Build(const Bvh &binary);
+
+    // Same contract as Bvh::Traverse, and visits the same leaves.
+    template <typename Hit>
+    void Traverse(const Vector3 &O, const Vector3 &D, float tmin, float &tmax, Hit &&hit) const
+    {
+        if (nodes.empty())
+            return;
+        const Vector3 invD(SafeInverse(D.x), SafeInverse(D.y), SafeInverse(D.z));
+        // Each node adds at most seven entries beyond the one it replaces, and collapsing never
+        // makes the tree deeper than the binary one.
+        StackEntry stack[7 * Bvh::MAX_DEPTH + 1];
+        int top = 0;
+        stack[top].child = 0;
+        stack[top++].tNear = tmin;
+        while (top > 0) {
+            const StackEntry entry = stack[--top];
+            if (entry.tNear > tmax)
+                continue;
+            if (entry.child & LEAF) {
+                const int first = static_cast<int>((entry.child & ~LEAF) >> 4), count = static_cast<int>(entry.child & 15);
+                for (int i = first; i < first + count; i++) {
+                    hit(items[i], tmax);
+                }
+                continue;
+            }
+
+            const WideBvhNode &node = nodes[entry.child];
+            float tNear[8];
+            int mask = IntersectChildren(node, O, invD, tmin, tmax, tNear);
+            // Push the hit children farthest first, so the nearest is visited next.
+            int order[8], hits = 0;
+            for (; mask; mask &= mask - 1) {
+                int slot = 0;
+                while (!(mask & (1 << slot))) {
+                    slot++;
+                }
+                int j = hits++;
+                for (; j > 0 && tNear[order[j - 1]] < tNear[slot]; j--) {
+                    order[j] = order[j - 1];
+                }
+                order[j] = slot;
+            }
+            for (int i = 0; i < hits; i++) {
+                stack[top].child = node.children[order[i]];
+                stack[top++].tNear = tNear[order[i]];
+            }
+        }
+    }
+
+    size_t MemoryBytes() const { return nodes.size() * sizeof(WideBvhNode) + items.size() * sizeof(int); }
+    const std::vector<WideBvhNode> &Nodes() const { return nodes; }
+
+  private:
+    class StackEntry
+    {
+      public:
+        Uint32 child;
+        float tNear;
+    };
+
+    // 1 / d, but finite for d == 0 so that the slab test never multiplies zero by infinity.
+    static float SafeInverse(float d) { return d > 1e-20f || d < -1e-20f ? 1.f / d : d < 0 ? -1e20f : 1e20f; }
+
+    // Slab tests the ray against the node's children. Returns a bit per child hit within
+    // [tmin, tmax] and sets tNear for those children.
+    static int IntersectChildren(const WideBvhNode &node, const Vector3 &O, const Vector3 &invD, float tmin, float tmax, float *tNear);
+
+    Uint32 Collapse(const std::vector<BvhNode> &binary, int index);
+
+    std::vector<WideBvhNode> nodes;
+    std::vector<int> items;
+};
@@ -1,51 +1,39 @@
 #include "Vector.h"
 #include "Color.h"
-
-
+#include "VertexBatch.h"
+#include "Renderer.h"
+#include "SDLRenderer.h"
+#include "MemoryRenderer.h"
+#include "FrameRecorder.h"
+#include "TileFarm.h"
+#include "TileService.h"
+#include "RenderJob.h"
+#include "Denoiser.h"
+#include "Raytracer.h"
+#include "ShadedMesh.h"
+#include "ShadowMap.h"
+#include "HybridRaytracer.h"
+#include "SphereTileBins.h"
+#include "TileOrder.h"
+#include "Scene.h"
+#include "BspTree.h"
+#include "Benchmark.h"
+#include "Random.h"
+
+
+#include <cfloat>
 #include <cstdlib>
 #include <stdio.h>
+#include <string.h>
 #include <vector>
 #include <SDL_test_common.h>
 #include <SDL_main.h>
 
 #define MAX_SPHERES 100
 
-class Sphere
-{
-public:
-    Sphere() : radius(0), center(0,0,0), color(0,0,0,0), specular(-1), reflective(0) {}
-    Sphere(Vector3 ctr, float rad, Color clr, float s=-1, float r=0) : radius(rad), center(ctr), color(clr), specular(s), reflective(r) {}
-
-    float radius;
-    Vector3 center;
-    Color color;
-    float specular;
-    float reflective;
-};
-
-class Vertex
-{
-  public:
-    Vertex(float x0, float y0, float h0) : x(x0), y(y0), h(h0) {}
-    float x, y;
-    float h;
-};
-
-class Light
-{
-public:
-    enum Type {ambient, point, directional};
-
-    Light(Type t, float i, Vector3 pos, Vector3 dir) : type(t), intensity(i), position(pos), direction(dir) {}
-    Type type;
-    float intensity;
-    Vector3 position;
-    Vector3 direction;
-};
-
 static SDLTest_CommonState *gState;
-static SDL_Renderer *gRenderer = nullptr;
-SDL_Surface *screenSurface = nullptr;
+static Renderer *gRenderer = nullptr;
+static SDLRenderer *gScreen = nullptr; // gRenderer while a window is open
 SDL_Window *gWindow = nullptr;
 
 
@@ -54,427 +42,1078 @@ static int CANVAS_HEIGHT = 1080;
 static int VIEWPORT_WIDTH = 1;
 static int VIEWPORT_HEIGHT = 1;
 static float VIEWPORT_DIST = 1;
-static Color BACKGROUND = Color(255, 255, 255, 255);
 
-std::vector<Sphere> spheres;
-std::vector<Light> lights;
-
-void PutPixel(int x, int y, int r, int g, int b)
+Vector3 CanvasToViewport(float canvasX, float canvasY)
 {
-    int sx = CANVAS_WIDTH / 2 + x;
-    int sy = CANVAS_HEIGHT / 2 - y;
+    Vector3 v;
+    v.x = canvasX * static_cast<float>(VIEWPORT_WIDTH) / static_cast<float>(CANVAS_WIDTH);
+    v.y = canvasY * static_cast<float>(VIEWPORT_HEIGHT) / static_cast<float>(CANVAS_HEIGHT);
+    v.z = VIEWPORT_DIST;
+    return v;
+}
 
-    SDL_SetRenderDrawColor(gRenderer, r, g, b, 0xff);
-    SDL_RenderDrawPoint(gRenderer, sx, sy);
+void CreateWindow()
+{
+    gWindow = SDL_CreateWindow("SDL demo", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, CANVAS_WIDTH, CANVAS_HEIGHT, SDL_WINDOW_SHOWN);
+    gScreen = new SDLRenderer(gWindow, CANVAS_WIDTH, CANVAS_HEIGHT);
+    gRenderer = gScreen;
+    gRenderer->Clear(Color(0xff, 0xff, 0xff));
 }
 
-void PutPixel(int x, int y, Color color)
+void DestroyWindow()
 {
-    PutPixel(x, y, color.r, color.g, color.b);
+    delete gScreen;
+    gScreen = nullptr;
+    gRenderer = nullptr;
+    SDL_DestroyWindow(gWindow);
 }
 
-std::vector<float> Interpolate(int i0, float d0, int i1, float d1)
+bool CheckForEscape()
 {
-    std::vector<float> values;
-    if (i0 == i1) {
-        values.push_back(d0);
-    } else {
-        float a = (d1 - d0) / (float)(i1 - i0);
-        float d = d0;
-        for (int i=i0; i<=i1; i++) {
-            values.push_back(d);
-            d += a;
-        }
+    SDL_Event e;
+    SDL_PollEvent(&e);
+    if (e.type == SDL_KEYUP) {
+        if (e.key.keysym.sym == SDLK_ESCAPE)
+            return true;
     }
 
-    return values;
+    return false;
 }
 
-void DrawLine(const Vector2 &point0, const Vector2 &point1, const Color &color)
+
+void WaitForEscape()
 {
-    Vector2 p0 = point0, p1 = point1;
-    float dx = p1.x - p0.x;
-    float dy = p1.y - p0.y;
-    if (abs(dx) > abs(dy)) {
-    // horizontalish
-        if (p0.x > p1.x)
-            std::swap(p0, p1);
-        std::vector<float> ys = Interpolate(p0.x, p0.y, p1.x, p1.y);
-        for (int x = p0.x; x <= p1.x; x++) {
-            PutPixel(x, ys[x-p0.x], color);
-        }
-    } else {
-            // verticalish
-        if (p0.y > p1.y)
-            std::swap(p0, p1);
-        std::vector<float> xs = Interpolate(p0.y, p0.x, p1.y, p1.x);
-        for (int y = p0.y; y <= p1.y; y++) {
-            PutPixel(xs[y - p0.y], y, color);
-        }
+    while (!CheckForEscape()) {
+        // The last frame may have come within a refresh of the one before and still be pending.
+        if (gScreen)
+            gScreen->ShowPending();
     }
 }
 
-SDL_bool IntersectRaySphere(Vector3 &O, Vector3 &D, const Sphere *sphere, float &t1, float &t2)
+// Opens a window, draws one still frame with draw and keeps it up until escape is pressed.
+void ShowInWindow(void (*draw)())
+{
+    CreateWindow();
+    draw();
+    gRenderer->Present();
+    WaitForEscape();
+    DestroyWindow();
+}
+
+static void CreateSphereScene()
 {
-    float r = sphere->radius;
-    Vector3 CO = O - sphere->center;
+    spheres.clear();
+    spheres.emplace_back(Sphere(Vector3(0.f, -1.f, 3.f), 1.f, Color(255, 0, 0), 500, 0.2f));
+    spheres.emplace_back(Sphere(Vector3(2.f, 0.f, 4.f), 1.f, Color(0, 0, 255), 500, 0.3f));
+    spheres.emplace_back(Sphere(Vector3(-2.f, 0.f, 4.f), 1.f, Color(0, 255, 0), 10, 0.4f));
+    spheres.emplace_back(Sphere(Vector3(0, -5001, 0), 5000, Color(255, 255, 0), 1000, 0.5f));
+
+    lights.clear();
+    lights.emplace_back(Light(Light::ambient, 0.2f, Vector3(0, 0, 0), Vector3(0, 0, 0)));
+    lights.emplace_back(Light(Light::point, 0.6f, Vector3(2, 1, 0), Vector3(0, 0, 0)));
+    lights.emplace_back(Light(Light::directional, 0.2f, Vector3(0, 0, 0), Vector3(1, 4, 4)));
+    sceneRevision++;
+}
 
-    float a = D.Dot(D);
-    float b = 2 * CO.Dot(D);
-    float c = CO.Dot(CO) - r * r;
+void DoSpheres()
+{
+    CreateSphereScene();
 
-    const float discriminant = b * b - 4 * a * c;
-    if (discriminant < 0) {
-        t1 = t2 = -1;
-        return SDL_FALSE;
+    // Primary rays only test the spheres binned to their tile. Rows are walked top to bottom, so
+    // consecutive pixels share a tile's bins and a framebuffer line.
+    static SphereTileBins bins;
+    Vector3 O(0, 0, 0);
+    bins.Build(spheres, RayCamera(O, static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST), CANVAS_WIDTH, CANVAS_HEIGHT);
+    for (int y = CANVAS_HEIGHT / 2; y >= -CANVAS_HEIGHT / 2; y--) {
+        for (int x = -CANVAS_WIDTH / 2; x <= CANVAS_WIDTH / 2; x++) {
+            Vector3 D = CanvasToViewport(static_cast<float>(x), static_cast<float>(y));
+            int count;
+            const int *candidates = bins.Candidates(static_cast<float>(x), static_cast<float>(y), count);
+            const PackedColor color = TraceRay(O, D, 1, 1000000.f, 1, candidates, count);
+            gRenderer->DrawPixel(x, y, color);
+        }
     }
+}
 
-    float d = sqrtf(discriminant);
-    t1 = (-b + d) / (2 * a);
-    t2 = (-b - d) / (2 * a);
 
-    return SDL_TRUE;
+void DoLines()
+{
+    gRenderer->DrawLine(Vector2(-200, -100), Vector2(240, 120), Color(255, 0, 0));
+    gRenderer->DrawLine(Vector2(-50, -200), Vector2(60, 240), Color(0, 255, 0));
 }
 
-bool ClosestIntersection(Vector3 O, Vector3 D, float t_min, float t_max, Sphere **oSphere, float &oT)
+void DoSpiral()
 {
-    float closest_t = FLT_MAX;
-    Sphere *closest_sphere = nullptr;
-    for (unsigned i = 0; i < spheres.size(); i++) {
-        float t1, t2;
-        IntersectRaySphere(O, D, &spheres[i], t1, t2);
-        if (t1 >= t_min && t1 <= t_max && t1 < closest_t) {
-            closest_t = t1;
-            closest_sphere = &spheres[i];
-        }
-        if (t2 >= t_min && t2 <= t_max && t2 < closest_t) {
-            closest_t = t2;
-            closest_sphere = &spheres[i];
-        }
+    CreateWindow();
+    float angle = 0;
+    float radius = 1;
+
+    while (radius < CANVAS_WIDTH/2) {
+        float cy = radius * (float)sin(angle);
+        float cx = radius * (float)cos(angle);
+        gRenderer->DrawPixel((int)cx, (int)cy, Color(0xff, 0, 0));
+        angle += 3.14159f * .005f;
+        radius += .1f;
+        gRenderer->Present();
+        if (CheckForEscape())
+            break;
     }
 
-    oT = closest_t;
-    *oSphere = closest_sphere;
-    return closest_sphere != nullptr;
+    DestroyWindow();
 }
 
-float ComputeLighting(Vector3 P, Vector3 N, Vector3 V, float s = -1)
+Vector2 ViewportToCanvas(float x, float y)
 {
-    float i = 0;
-    Vector3 L;
+    return { x * (float)CANVAS_WIDTH / (float)VIEWPORT_WIDTH, y * (float)CANVAS_HEIGHT / (float)VIEWPORT_HEIGHT };
+}
 
-    for (Light light : lights) {
-        if (light.type == Light::Type::ambient)
-            i += light.intensity;
-        else
-        {
-            float t_max = 0;
+Vector2 ProjectVertex(Vector3 v){
+    float d = VIEWPORT_DIST;
+    return ViewportToCanvas(v.x * d / v.z, v.y * d / v.z);
+}
 
-            switch (light.type) {
-            case Light::Type::point:
-                L = light.position - P;
-                t_max = 1;
-                break;
-            case Light::Type::directional:
-                L = light.direction;
-                t_max = FLT_MAX;
-                break;
-            default:
-                break;
-            }
+void DoCube()
+{
+    // The four "front" vertices
+    Vector3 vAf = { -2, -0.5, 5 }, vBf = { -2, 0.5, 5 }, vCf = { -1, 0.5, 5 }, vDf = { -1, -0.5, 5 };
 
-            Sphere *shadow_sphere = nullptr;
-            float shadow_t;
-            if (ClosestIntersection(P, L, 0.001f, t_max, &shadow_sphere, shadow_t))
-                continue;
+        // The four "back" vertices
+    Vector3 vAb = { -2, -0.5, 6 }, vBb = { -2, 0.5, 6 }, vCb = { -1, 0.5, 6 }, vDb = { -1, -0.5, 6 };
 
-            // diffuse
-            const float n_dot_l = N.Dot(L);
-            if (n_dot_l > 0) {
-                i += light.intensity * n_dot_l / (N.Length() * L.Length());
-            }
+    auto BLUE = Color(0, 0, 255);
+    auto GREEN = Color(0, 255, 0);
+    auto RED = Color(255, 0, 0);
 
-            if (s != -1) {
-                Vector3 R = N * 2 * N.Dot(L) - L;
-                const float r_dot_v = R.Dot(V);
-                if (r_dot_v > 0) {
-                    i += light.intensity * static_cast<float>(pow((r_dot_v / (R.Length() * V.Length())), s));
-                }
-            }
-        }
-    }
+    const Vector2 af = ProjectVertex(vAf), bf = ProjectVertex(vBf), cf = ProjectVertex(vCf), df = ProjectVertex(vDf);
+    const Vector2 ab = ProjectVertex(vAb), bb = ProjectVertex(vBb), cb = ProjectVertex(vCb), db = ProjectVertex(vDb);
+
+    // The front face
+    const Vector2 front0[] = { af, bf, cf, df }, front1[] = { bf, cf, df, af };
+    gRenderer->DrawLines(front0, front1, 4, BLUE);
+
+    // The back face
+    const Vector2 back0[] = { ab, bb, cb, db }, back1[] = { bb, cb, db, ab };
+    gRenderer->DrawLines(back0, back1, 4, RED);
 
-    return i;
+    // The front-to-back edges
+    const Vector2 edge0[] = { af, bf, cf, df }, edge1[] = { ab, bb, cb, db };
+    gRenderer->DrawLines(edge0, edge1, 4, GREEN);
 }
 
-Vector3 ReflectRay(Vector3 R, Vector3 N)
+// Model space to homogeneous canvas coordinates for a camera at the origin looking down +z.
+Matrix4 CameraToCanvas()
 {
-    return (N * 2.f) * N.Dot(R) - R;
+    const Matrix4 viewportToCanvas(static_cast<float>(CANVAS_WIDTH) / static_cast<float>(VIEWPORT_WIDTH), 0, 0, 0,
+                                   0, static_cast<float>(CANVAS_HEIGHT) / static_cast<float>(VIEWPORT_HEIGHT), 0, 0,
+                                   0, 0, 1, 0,
+                                   0, 0, 0, 1);
+    return viewportToCanvas * Matrix4::Perspective(VIEWPORT_DIST);
 }
 
-Color TraceRay(Vector3 O, Vector3 D, float t_min, float t_max, int recursion_depth)
+void DoFilledCube()
 {
-    float closest_t = 100000000.f;
-    int closestSphereIndex = -1;
-    Sphere *closestSphere = nullptr;
-
-    const bool found = ClosestIntersection(O, D, t_min, t_max, &closestSphere, closest_t);
-    if (!found)
-        return BACKGROUND;
-    else {
-        Vector3 P = O + D * closest_t;
-        Vector3 N = P - closestSphere->center;
-        N = N * (1.f/N.Length());
-        float l = ComputeLighting(P, N, D * -1, closestSphere->specular);
-        l = SDL_clamp(l, 0, 1);
-        Color color = closestSphere->color * l;
-        float r = closestSphere->reflective;
-        if (recursion_depth <= 0 || r <= 0)
-            return color;
+    static const Mesh cube = Mesh::Cube();
+    gRenderer->DrawMesh(cube, CameraToCanvas() * Matrix4::Translation(Vector3(-1.5f, 0, 7)) * Matrix4::RotationY(30));
+}
 
-        Vector3 R = ReflectRay(D * -1.f, N);
-        Color reflectedColor = TraceRay(P, R, 0.001f, FLT_MAX, recursion_depth - 1);
-        return color * (1.f - r) + reflectedColor * r;
+void DoTexturedCube()
+{
+    static Texture texture;
+    if (texture.Levels() == 0 && !texture.Load("texture.png")) {
+        texture = Texture::Checkerboard(256, 8, Color(200, 60, 40), Color(240, 230, 210));
     }
+
+    // A long floor makes the mip chain visible as it recedes.
+    static Mesh floor;
+    floor.vertices = { { -4, -1, 2 }, { 4, -1, 2 }, { 4, -1, 40 }, { -4, -1, 40 } };
+    floor.triangles = { { 0, 1, 2, Color() }, { 0, 2, 3, Color() } };
+    floor.uvs = { { 0, 0 }, { 4, 0 }, { 4, 20 }, { 0, 0 }, { 4, 20 }, { 0, 20 } };
+    floor.texture = &texture;
+    gRenderer->DrawMesh(floor, CameraToCanvas());
+
+    static Mesh cube = Mesh::Cube();
+    cube.texture = &texture;
+    gRenderer->DrawMesh(cube, CameraToCanvas() * Matrix4::Translation(Vector3(-1.5f, 0.5f, 7)) * Matrix4::RotationY(30));
 }
 
-void DrawFilledTriangle(Vector3 p0, Vector3 p1, Vector3 p2, Color color)
+// The DoSpheres scene with primary visibility rasterized; only shadow and reflection rays are traced.
+void DoHybridSpheres()
 {
-    if (p1.y < p0.y) {
-        std::swap(p1, p0);
-    }
-    if (p2.y < p0.y) {
-        std::swap(p2, p0);
-    }
-    if (p2.y < p1.y) {
-        std::swap(p2, p1);
+    CreateSphereScene();
+
+    static HybridRaytracer hybrid;
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    const Uint64 start = SDL_GetPerformanceCounter();
+    hybrid.Render(*gRenderer, camera, 1, 1000000.f, 1);
+    const double ms = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / static_cast<double>(SDL_GetPerformanceFrequency());
+    printf("Hybrid: %.2f ms, %lld primary ray-sphere tests (%lld when ray traced), %d pixels fell back to a full trace\n", ms,
+           hybrid.PrimaryTests(), static_cast<long long>(spheres.size()) * CANVAS_WIDTH * CANVAS_HEIGHT, hybrid.Fallbacks());
+}
+
+// 100k trees share one sphere set; only their transforms are stored per tree.
+void DoInstancedForest()
+{
+    static InstancedScene scene;
+    static bool built = false;
+    if (!built) {
+        SphereSet tree;
+        tree.spheres.emplace_back(Sphere(Vector3(0, 0.3f, 0), 0.3f, Color(120, 80, 40), 10));
+        tree.spheres.emplace_back(Sphere(Vector3(0, 0.8f, 0), 0.25f, Color(120, 80, 40), 10));
+        tree.spheres.emplace_back(Sphere(Vector3(0, 1.6f, 0), 0.7f, Color(20, 140, 40), 10));
+        tree.spheres.emplace_back(Sphere(Vector3(0.4f, 1.3f, 0.2f), 0.45f, Color(30, 160, 50), 10));
+        tree.spheres.emplace_back(Sphere(Vector3(-0.4f, 1.35f, -0.1f), 0.45f, Color(30, 160, 50), 10));
+        tree.Build();
+        SphereSet ground;
+        ground.spheres.emplace_back(Sphere(Vector3(0, -5000, 0), 5000, Color(200, 180, 120), 1000));
+        ground.Build();
+
+        const int treeSet = scene.AddSphereSet(tree);
+        scene.AddInstance(Instance::sphereSet, scene.AddSphereSet(ground), scene.graph.AddNode(Matrix4::Translation(Vector3(0, -1, 0))));
+        const int forest = scene.graph.AddNode(Matrix4::Translation(Vector3(0, -1, 4)));
+        for (int row = 0; row < 316; row++) {
+            for (int column = 0; column < 316; column++) {
+                const float jitter = static_cast<float>((row * 7 + column * 13) % 10) * 0.1f;
+                const Matrix4 place = Matrix4::Translation(Vector3(3.f * static_cast<float>(column - 158) + jitter, 0, 3.f * static_cast<float>(row) + jitter)) *
+                                      Matrix4::RotationY(36.f * jitter) * Matrix4::Scale(0.8f + 0.4f * jitter);
+                scene.AddInstance(Instance::sphereSet, treeSet, scene.graph.AddNode(place, forest));
+            }
+        }
+        built = true;
     }
 
-    std::vector<float> x01 = Interpolate(p0.y, p0.x, p1.y, p1.x);
-    std::vector<float> x12 = Interpolate(p1.y, p1.x, p2.y, p2.x);
-    std::vector<float> x02 = Interpolate(p0.y, p0.x, p2.y, p2.x);
+    lights.clear();
+    lights.emplace_back(Light(Light::ambient, 0.3f, Vector3(0, 0, 0), Vector3(0, 0, 0)));
+    lights.emplace_back(Light(Light::directional, 0.7f, Vector3(0, 0, 0), Vector3(1, 4, -2)));
+    sceneRevision++;
 
-    x01.pop_back();
-    std::vector<float> x012 = x01;
-    for (float f : x12) {
-        x012.push_back(f);
-    }
+    scene.Update();
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    scene.RayTrace(*gRenderer, camera, 1, FLT_MAX, 0);
+}
 
-    std::vector<float> x_left, x_right;
+// A spinning field of 10k cube instances; the ones outside the view are culled before projection.
+void DoInstancedCubes()
+{
+    static const Mesh cube = Mesh::Cube();
+    InstancedScene scene;
+    const int mesh = scene.AddMesh(cube);
+    const int field = scene.graph.AddNode(Matrix4::Translation(Vector3(0, -2, 40)));
+    for (int i = 0; i < 100 * 100; i++) {
+        const Vector3 offset(4.f * static_cast<float>(i % 100 - 50), 0, 4.f * static_cast<float>(i / 100 - 50));
+        scene.AddInstance(Instance::mesh, mesh, scene.graph.AddNode(Matrix4::Translation(offset) * Matrix4::Scale(0.5f), field));
+    }
 
-    int m = floorf((float)x012.size() / 2);
-    if (x02[m] < x012[m]) {
-        x_left = x02;
-        x_right = x012;
-    } else {
-        x_left = x012;
-        x_right = x02;
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    for (int frame = 0; frame < 360 && !CheckForEscape(); frame += 2) {
+        scene.graph.SetLocal(field, Matrix4::Translation(Vector3(0, -2, 40)) * Matrix4::RotationY(static_cast<float>(frame)));
+        scene.Update();
+        gRenderer->Clear(Color(255, 255, 255));
+        const int culled = scene.Rasterize(*gRenderer, camera, CameraToCanvas());
+        gRenderer->Present();
+        if (frame == 0)
+            printf("%d of 10000 cubes culled\n", culled);
     }
+}
 
-    for (int y=p0.y; y<=p2.y; y++) {
-        for (int x = x_left[y - p0.y]; x < x_right[y-p0.y]; x++) {
-            PutPixel(x, y, color);
+// Translucent overlapping cubes over the filled cube scene, in BSP order instead of a depth sort.
+// The tree is built on the first run and loaded from overlay.bsp afterwards.
+void DoBspOverlay()
+{
+    static BspTree tree;
+    if (tree.nodes.empty() && !tree.Load("overlay.bsp")) {
+        Mesh overlay;
+        const Vector3 offsets[] = { { 0, 0, 0 }, { 0.8f, 0.5f, 0.4f }, { -0.6f, 0.7f, -0.5f } };
+        const Color colors[] = { Color(255, 0, 0, 96), Color(0, 255, 0, 96), Color(0, 0, 255, 96) };
+        for (int c = 0; c < 3; c++) {
+            const Mesh cube = Mesh::Cube();
+            const Matrix4 place = Matrix4::Translation(offsets[c]) * Matrix4::RotationY(25.f * static_cast<float>(c));
+            const int base = static_cast<int>(overlay.vertices.size());
+            for (const Vector3 &v : cube.vertices) {
+                overlay.vertices.push_back(place.TransformPoint(v));
+            }
+            for (Triangle t : cube.triangles) {
+                t.v0 += base;
+                t.v1 += base;
+                t.v2 += base;
+                t.color = colors[c];
+                overlay.triangles.push_back(t);
+            }
         }
+        tree.Build(overlay);
+        printf("BSP tree: %d triangles in, %d splits, %d nodes\n", static_cast<int>(overlay.triangles.size()), tree.Splits(), static_cast<int>(tree.nodes.size()));
+        if (!tree.Save("overlay.bsp"))
+            printf("Could not write overlay.bsp\n");
     }
+
+    DoFilledCube();
+    DrawBspTree(*gRenderer, tree, Matrix4::Translation(Vector3(1, 0.5f, 6)) * Matrix4::RotationY(-20), CameraToCanvas());
 }
 
+// Gouraud on the left, Phong on the right, lit like the sphere scene.
+void DoShadedSpheres()
+{
+    spheres.clear();
+    lights.clear();
+    lights.emplace_back(Light(Light::ambient, 0.2f, Vector3(0, 0, 0), Vector3(0, 0, 0)));
+    lights.emplace_back(Light(Light::point, 0.6f, Vector3(2, 1, 0), Vector3(0, 0, 0)));
+    lights.emplace_back(Light(Light::directional, 0.2f, Vector3(0, 0, 0), Vector3(1, 4, 4)));
+    sceneRevision++;
 
-void DrawShadedTriangle(Vertex p0, Vertex p1, Vertex p2, Color color)
+    static const Mesh sphere = Mesh::Sphere(15, Color(0, 255, 0));
+    static VertexLightingCache cache;
+    DrawGouraudShadedMesh(*gRenderer, sphere, Matrix4::Translation(Vector3(-1.2f, 0, 5)), CameraToCanvas(), 50, cache);
+    DrawPhongShadedMesh(*gRenderer, sphere, Matrix4::Translation(Vector3(1.2f, 0, 5)), CameraToCanvas(), 50);
+}
+
+void DoShadowedScene()
 {
-    if (p1.y < p0.y) {
-        std::swap(p1, p0);
+    spheres.clear();
+    lights.clear();
+    lights.emplace_back(Light(Light::ambient, 0.2f, Vector3(0, 0, 0), Vector3(0, 0, 0)));
+    lights.emplace_back(Light(Light::point, 0.6f, Vector3(2, 3, 3), Vector3(0, 0, 0)));
+    lights.emplace_back(Light(Light::directional, 0.2f, Vector3(0, 0, 0), Vector3(1, 4, 4)));
+    sceneRevision++;
+
+    static const Mesh sphere = Mesh::Sphere(15, Color(0, 255, 0));
+    static Mesh floor;
+    floor.vertices = { { -4, -1, 2 }, { 4, -1, 2 }, { 4, -1, 12 }, { -4, -1, 12 } };
+    floor.normals = { { 0, 1, 0 }, { 0, 1, 0 }, { 0, 1, 0 }, { 0, 1, 0 } };
+    floor.triangles = { { 0, 1, 2, Color(200, 200, 200) }, { 0, 2, 3, Color(200, 200, 200) } };
+
+    const ShadowCaster casters[] = {
+        ShadowCaster(floor, Matrix4()),
+        ShadowCaster(sphere, Matrix4::Translation(Vector3(0, 0, 6))),
+        ShadowCaster(sphere, Matrix4::Translation(Vector3(-1.5f, -0.5f, 5)) * Matrix4::Scale(0.5f)),
+        ShadowCaster(sphere, Matrix4::Translation(Vector3(1.5f, -0.6f, 7.5f)) * Matrix4::Scale(0.4f)),
+    };
+    const int casterCount = sizeof(casters) / sizeof(casters[0]);
+
+    // The lights and casters are static, so the maps are rendered once and every pixel then costs
+    // a few depth lookups instead of a shadow ray per light.
+    static ShadowMapVisibility shadows;
+    shadows.Update(casters, casterCount);
+    for (int i = 0; i < casterCount; i++) {
+        DrawPhongShadedMesh(*gRenderer, *casters[i].mesh, casters[i].modelToCamera, CameraToCanvas(), 50, &shadows);
     }
-    if (p2.y < p0.y) {
-        std::swap(p2, p0);
+}
+
+void DoProjectionBenchmark()
+{
+    const int count = 1 << 20;
+    std::vector<float> xs(count), ys(count), zs(count);
+    std::vector<float> outX(count), outY(count), outInvW(count);
+    std::vector<Vector2> projected(count);
+    for (int i = 0; i < count; i++) {
+        xs[i] = 4.f * static_cast<float>(rand()) / RAND_MAX - 2.f;
+        ys[i] = 4.f * static_cast<float>(rand()) / RAND_MAX - 2.f;
+        zs[i] = 4.f * static_cast<float>(rand()) / RAND_MAX - 2.f;
     }
-    if (p2.y < p1.y) {
-        std::swap(p2, p1);
+
+    const Matrix4 model = Matrix4::Translation(Vector3(0, 0, 7)) * Matrix4::RotationY(30);
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int i = 0; i < count; i++) {
+        projected[i] = ProjectVertex(model.TransformPoint(Vector3(xs[i], ys[i], zs[i])));
     }
+    const double perVertexMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
 
-    std::vector<float> x01 = Interpolate(p0.y, p0.x, p1.y, p1.x);
-    std::vector<float> h01 = Interpolate(p0.y, p0.h, p1.y, p1.h);
-    std::vector<float> x12 = Interpolate(p1.y, p1.x, p2.y, p2.x);
-    std::vector<float> h12 = Interpolate(p1.y, p1.h, p2.y, p2.h);
-    std::vector<float> x02 = Interpolate(p0.y, p0.x, p2.y, p2.x);
-    std::vector<float> h02 = Interpolate(p0.y, p0.h, p2.y, p2.h);
+    const ViewportMapping mapping((float)CANVAS_WIDTH / (float)VIEWPORT_WIDTH, (float)CANVAS_HEIGHT / (float)VIEWPORT_HEIGHT, 0, 0);
+    start = SDL_GetPerformanceCounter();
+    TransformProjectVertices(Matrix4::Perspective(VIEWPORT_DIST) * model, mapping, xs.data(), ys.data(), zs.data(), count, outX.data(), outY.data(), outInvW.data());
+    const double batchedMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
 
-    x01.pop_back();
-    std::vector<float> x012 = x01;
-    for (float f : x12) {
-        x012.push_back(f);
+    float maxError = 0;
+    for (int i = 0; i < count; i++) {
+        maxError = SDL_max(maxError, fabsf(projected[i].x - outX[i]));
+        maxError = SDL_max(maxError, fabsf(projected[i].y - outY[i]));
     }
 
-    h01.pop_back();
-    std::vector<float> h012 = h01;
-    for (float f : h12) {
-        h012.push_back(f);
+    printf("%d vertices: ProjectVertex %.2f ms, batched %.2f ms (%.1fx), max difference %g px\n",
+           count, perVertexMs, batchedMs, perVertexMs / batchedMs, maxError);
+}
+
+
+// Scripted animations for --record. Each draws frame of frameCount into gRenderer, which
+// presents it afterwards.
+static void AnimateSpiral(int frame, int frameCount)
+{
+    // The pixels DoSpiral plots before its radius reaches the canvas edge, spread over the frames.
+    const int total = static_cast<int>((CANVAS_WIDTH / 2 - 1) / .1f);
+    if (frame == 0)
+        gRenderer->Clear(Color(0xff, 0xff, 0xff));
+    for (int i = total * frame / frameCount; i < total * (frame + 1) / frameCount; i++) {
+        const float angle = 3.14159f * .005f * i;
+        const float radius = 1 + .1f * i;
+        gRenderer->DrawPixel((int)(radius * cosf(angle)), (int)(radius * sinf(angle)), Color(0xff, 0, 0));
     }
+}
 
+// The camera loops sideways and up in front of the spheres, back to where it started.
+static void AnimateSpheres(int frame, int frameCount)
+{
+    static HybridRaytracer hybrid;
+    if (frame == 0)
+        CreateSphereScene();
+    const float t = 2 * 3.14159f * frame / frameCount;
+    const Vector3 origin(0.75f * sinf(t), 0.25f * (1 - cosf(t)), 0.5f * (cosf(t) - 1));
+    const RayCamera camera(origin, static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    hybrid.Render(*gRenderer, camera, 1, 1000000.f, 1);
+}
 
-    std::vector<float> x_left, x_right, h_left, h_right;
+// DoFilledCube's cube, turning once around its vertical axis.
+static void AnimateCube(int frame, int frameCount)
+{
+    static const Mesh cube = Mesh::Cube();
+    gRenderer->Clear(Color(0xff, 0xff, 0xff));
+    const float degrees = 360.f * frame / frameCount;
+    gRenderer->DrawMesh(cube, CameraToCanvas() * Matrix4::Translation(Vector3(-1.5f, 0, 7)) * Matrix4::RotationY(degrees));
+}
 
-    int m = floorf((float)x012.size() / 2);
-    if (x02[m] < x012[m]) {
-        x_left = x02;
-        h_left = h02;
-        x_right = x012;
-        h_right = h012;
-    } else {
-        x_left = x012;
-        h_left = h012;
-        x_right = x02;
-        h_right = h02;
-    }
-
-    for (int y = p0.y; y <= p2.y; y++) {
-        int x_l = x_left[y - p0.y];
-        int x_r = x_right[y - p0.y];
-        std::vector<float> h_segment = Interpolate(x_l, h_left[y - p0.y], x_r, h_right[y - p0.y]);
-        for (int x=x_l; x<=x_r; x++) {
-            Color shaded_color = color * h_segment[x - x_l];
-            PutPixel(x, y, shaded_color);
-        }
+// Renders an animation headless and streams it to path, in the format its extension picks.
+static int RecordAnimation(const char *path, const char *name, int frameCount, int framesPerSecond)
+{
+    void (*animate)(int, int) = strcmp(name, "spiral") == 0    ? AnimateSpiral
+                                : strcmp(name, "spheres") == 0 ? AnimateSpheres
+                                : strcmp(name, "cube") == 0    ? AnimateCube
+                                                               : nullptr;
+    if (!animate) {
+        printf("Unknown animation %s; expected spiral, spheres or cube\n", name);
+        return 1;
     }
+
+    MemoryRenderer renderer(CANVAS_WIDTH, CANVAS_HEIGHT);
+    FrameRecorder recorder(CANVAS_WIDTH, CANVAS_HEIGHT);
+    if (!recorder.Open(path, framesPerSecond)) {
+        printf("Could not open %s for recording\n", path);
+        return 1;
+    }
+    renderer.SetRecorder(&recorder);
+    gRenderer = &renderer;
+
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    const Uint64 start = SDL_GetPerformanceCounter();
+    for (int frame = 0; frame < frameCount; frame++) {
+        animate(frame, frameCount);
+        renderer.Present();
+    }
+    const double renderMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+    recorder.Close();
+    const double totalMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+
+    gRenderer = nullptr;
+    // Progress goes to stderr, since the raw stream may be going to stdout.
+    fprintf(stderr, "Recorded %d frames of %s to %s: rendered in %.0f ms, encoded by %.0f ms, at most %d frames queued\n",
+            recorder.FramesEncoded(), name, path, renderMs, totalMs, recorder.PeakQueued());
+    return 0;
 }
 
-Vector3 CanvasToViewport(float canvasX, float canvasY)
+// Average Mrays/s of primary rays from the origin through a grid over the set's box.
+static double TraceSphereSetGrid(const SphereSet &set, int raysPerSide)
 {
-    Vector3 v;
-    v.x = canvasX * static_cast<float>(VIEWPORT_WIDTH) / static_cast<float>(CANVAS_WIDTH);
-    v.y = canvasY * static_cast<float>(VIEWPORT_HEIGHT) / static_cast<float>(CANVAS_HEIGHT);
-    v.z = VIEWPORT_DIST;
-    return v;
+    const Uint64 start = SDL_GetPerformanceCounter();
+    for (int y = 0; y < raysPerSide; y++) {
+        for (int x = 0; x < raysPerSide; x++) {
+            const float u = (static_cast<float>(x) + 0.5f) / static_cast<float>(raysPerSide);
+            const float v = (static_cast<float>(y) + 0.5f) / static_cast<float>(raysPerSide);
+            const Vector3 target(set.bounds.min.x + u * (set.bounds.max.x - set.bounds.min.x), set.bounds.min.y + v * (set.bounds.max.y - set.bounds.min.y), set.bounds.min.z);
+            float t = FLT_MAX;
+            int sphere;
+            set.ClosestIntersection(Vector3(0, 0, 0), target, 0.001f, t, sphere);
+        }
+    }
+    const double seconds = static_cast<double>(SDL_GetPerformanceCounter() - start) / static_cast<double>(SDL_GetPerformanceFrequency());
+    return raysPerSide * raysPerSide / seconds / 1e6;
 }
 
-void CreateWindow()
+// count small spheres drifting through a box, with the BVH refitted (or rebuilt when that has let
+// it degrade) every frame. Prints each frame's update time and trace speed, against rebuilding
+// from scratch every frame.
+static int DoDynamicBvh(int count, int frames)
 {
-    gWindow = SDL_CreateWindow("SDL demo", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, CANVAS_WIDTH, CANVAS_HEIGHT, SDL_WINDOW_SHOWN);
-    screenSurface = SDL_GetWindowSurface(gWindow); //Fill the surface white
-    gRenderer = SDL_CreateRenderer(gWindow, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
-    SDL_SetRenderDrawColor(gRenderer, 0xff, 0xff, 0xff, 0xff);
-    SDL_Rect rect;
-    rect.x = 0;
-    rect.y = 0;
-    rect.w = CANVAS_WIDTH;
-    rect.h = CANVAS_HEIGHT;
-    SDL_RenderFillRect(gRenderer, &rect);
+    SphereSet set;
+    std::vector<Vector3> velocities;
+    Random random;
+    for (int i = 0; i < count; i++) {
+        set.spheres.emplace_back(Sphere(Vector3(random.Next() * 100 - 50, random.Next() * 100 - 50, random.Next() * 100 + 50), 0.3f, Color(200, 200, 200)));
+        velocities.push_back(Vector3(random.Next() - 0.5f, random.Next() - 0.5f, random.Next() - 0.5f) * 0.6f);
+    }
+    set.Build();
+
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    double updateMs = 0, rebuildMs = 0, updatedRays = 0, rebuiltRays = 0;
+    int rebuilds = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        for (int i = 0; i < count; i++) {
+            Vector3 &c = set.spheres[i].center;
+            c = c + velocities[i];
+            // Bounce off the walls of the box.
+            if (c.x < -50 || c.x > 50)
+                velocities[i].x = -velocities[i].x;
+            if (c.y < -50 || c.y > 50)
+                velocities[i].y = -velocities[i].y;
+            if (c.z < 50 || c.z > 150)
+                velocities[i].z = -velocities[i].z;
+        }
+
+        const BvhUpdateStats &stats = set.Update();
+        updateMs += stats.refitMs + stats.buildMs;
+        rebuilds += stats.rebuilt;
+        const double updatedMrays = TraceSphereSetGrid(set, 256);
+        updatedRays += updatedMrays;
+
+        SphereSet fresh = set;
+        const Uint64 start = SDL_GetPerformanceCounter();
+        fresh.Build();
+        const double ms = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+        rebuildMs += ms;
+        const double rebuiltMrays = TraceSphereSetGrid(fresh, 256);
+        rebuiltRays += rebuiltMrays;
+
+        printf("frame %3d: refit %6.2f ms, cost x%.2f%s, %.2f Mrays/s | full rebuild %6.2f ms, %.2f Mrays/s\n", frame, stats.refitMs, stats.costRatio,
+               stats.rebuilt ? ", rebuilt" : "", updatedMrays, ms, rebuiltMrays);
+    }
+    printf("Dynamic BVH, %d spheres: %.2f ms per frame updating (%d rebuilds), %.2f Mrays/s; %.2f ms rebuilding every frame, %.2f Mrays/s\n", count,
+           updateMs / frames, rebuilds, updatedRays / frames, rebuildMs / frames, rebuiltRays / frames);
+    return 0;
 }
 
-void DestroyWindow()
+// count small spheres scattered through a box, traced through the binary BVH and then the wide
+// quantized one. Prints each layout's footprint and speed for a grid of primary rays and for rays
+// in random directions from random points, which stray across far more of the tree.
+static int DoWideBvh(int count)
 {
-    SDL_DestroyWindow(gWindow);
+    SphereSet set;
+    Random random;
+    for (int i = 0; i < count; i++) {
+        set.spheres.emplace_back(Sphere(Vector3(random.Next() * 100 - 50, random.Next() * 100 - 50, random.Next() * 100 + 50), 0.3f, Color(200, 200, 200)));
+    }
+    const int scatteredCount = 1 << 18;
+    std::vector<Vector3> origins, directions;
+    for (int i = 0; i < scatteredCount; i++) {
+        origins.push_back(Vector3(random.Next() * 100 - 50, random.Next() * 100 - 50, random.Next() * 100 + 50));
+        directions.push_back(Vector3(random.Next() - 0.5f, random.Next() - 0.5f, random.Next() - 0.5f));
+    }
+
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    const SphereSet::Layout layouts[] = { SphereSet::binary, SphereSet::wide };
+    for (SphereSet::Layout layout : layouts) {
+        set.layout = layout;
+        Uint64 start = SDL_GetPerformanceCounter();
+        set.Build();
+        const double buildMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+        const double gridMrays = TraceSphereSetGrid(set, 512);
+
+        start = SDL_GetPerformanceCounter();
+        int hits = 0;
+        for (int i = 0; i < scatteredCount; i++) {
+            float t = FLT_MAX;
+            int sphere;
+            hits += set.ClosestIntersection(origins[i], directions[i], 0.001f, t, sphere);
+        }
+        const double seconds = static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+        printf("%s BVH, %d spheres: %.1f MB, built in %.0f ms; %.2f Mrays/s primary, %.2f Mrays/s scattered (%d hits)\n",
+               layout == SphereSet::wide ? "Wide" : "Binary", count, static_cast<double>(set.BvhBytes()) / (1024.0 * 1024.0), buildMs,
+               gridMrays, scatteredCount / seconds / 1e6, hits);
+    }
+    return 0;
 }
 
-bool CheckForEscape()
+// count small spheres spread out in front of the camera under DoSpheres' lights, ray traced with
+// every primary ray testing every sphere and then with primary rays binned per tile. Prints both
+// times and checks that the two frames match.
+static int DoBinnedSpheres(int count)
 {
-    SDL_Event e;
-    SDL_PollEvent(&e);
-    if (e.type == SDL_KEYUP) {
-        if (e.key.keysym.sym == SDLK_ESCAPE)
-            return true;
+    CreateSphereScene();
+    spheres.clear();
+    Random random;
+    for (int i = 0; i < count; i++) {
+        const float z = 4 + random.Next() * 16;
+        spheres.emplace_back(Sphere(Vector3((random.Next() - 0.5f) * z, (random.Next() - 0.5f) * z, z), 0.05f + random.Next() * 0.2f,
+                                    Color(static_cast<int>(random.Next() * 255), static_cast<int>(random.Next() * 255), static_cast<int>(random.Next() * 255)), 100, 0.2f));
+    }
+    sceneRevision++;
+
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    std::vector<PackedColor> full(CANVAS_WIDTH * CANVAS_HEIGHT), binned(CANVAS_WIDTH * CANVAS_HEIGHT);
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    Uint64 start = SDL_GetPerformanceCounter();
+    for (int row = 0; row < CANVAS_HEIGHT; row++) {
+        const float y = static_cast<float>(CANVAS_HEIGHT / 2 - row);
+        for (int col = 0; col < CANVAS_WIDTH; col++) {
+            const float x = static_cast<float>(col - CANVAS_WIDTH / 2);
+            full[row * CANVAS_WIDTH + col] = TraceRay(camera.origin, camera.Direction(x, y, CANVAS_WIDTH, CANVAS_HEIGHT), 1, 1000000.f, 1);
+        }
+    }
+    const double fullMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+
+    SphereTileBins bins;
+    start = SDL_GetPerformanceCounter();
+    bins.Build(spheres, camera, CANVAS_WIDTH, CANVAS_HEIGHT);
+    const double binMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+    for (int row = 0; row < CANVAS_HEIGHT; row++) {
+        const float y = static_cast<float>(CANVAS_HEIGHT / 2 - row);
+        for (int col = 0; col < CANVAS_WIDTH; col++) {
+            const float x = static_cast<float>(col - CANVAS_WIDTH / 2);
+            int candidateCount;
+            const int *candidates = bins.Candidates(x, y, candidateCount);
+            binned[row * CANVAS_WIDTH + col] = TraceRay(camera.origin, camera.Direction(x, y, CANVAS_WIDTH, CANVAS_HEIGHT), 1, 1000000.f, 1, candidates, candidateCount);
+        }
     }
+    const double binnedMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
 
-    return false;
+    int different = 0;
+    for (size_t i = 0; i < full.size(); i++) {
+        different += !(full[i] == binned[i]);
+    }
+    printf("Binned primary rays, %d spheres: %.0f ms testing every sphere, %.0f ms binned (%.1f ms of it binning, %.1f spheres per tile), %d pixels differ\n",
+           count, fullMs, binnedMs, binMs, bins.AverageCandidates(), different);
+    return different == 0 ? 0 : 1;
 }
 
+// Pixel shaders for DoTraversalBenchmark, at canvas point (x, y). TraversalPattern costs next to
+// nothing, so the order's memory traffic shows; TraversalSpheres is DoSpheres' binned ray tracer.
+static SphereTileBins traversalBins;
 
-void WaitForEscape()
+static PackedColor TraversalPattern(int x, int y)
 {
-    while (!CheckForEscape()) {
+    return PackedColor(Color(x & 255, y & 255, (x ^ y) & 255));
+}
+
+static PackedColor TraversalSpheres(int x, int y)
+{
+    int count;
+    const int *candidates = traversalBins.Candidates(static_cast<float>(x), static_cast<float>(y), count);
+    return TraceRay(Vector3(0, 0, 0), CanvasToViewport(static_cast<float>(x), static_cast<float>(y)), 1, 1000000.f, 1, candidates, count);
+}
+
+// Draws the canvas through each shader in columns, in rows, in 16 pixel tiles along Morton and
+// Hilbert curves, and along the Morton curve into a renderer with the swizzled layout, whose frame
+// is deswizzled as it is presented. Prints the best of reps for each and checks that they all draw
+// the same frame.
+static int DoTraversalBenchmark(int reps)
+{
+    CreateSphereScene();
+    traversalBins.Build(spheres, RayCamera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST),
+                        CANVAS_WIDTH, CANVAS_HEIGHT);
+    const int left = -CANVAS_WIDTH / 2, top = CANVAS_HEIGHT / 2;
+    const std::vector<Tile> mortonOrder = TilesInOrder(CANVAS_WIDTH, CANVAS_HEIGHT, 16, mortonTiles);
+    const std::vector<Tile> hilbertOrder = TilesInOrder(CANVAS_WIDTH, CANVAS_HEIGHT, 16, hilbertTiles);
+    MemoryRenderer renderer(CANVAS_WIDTH, CANVAS_HEIGHT);
+    std::vector<Uint32> reference;
+
+    auto drawTiles = [&](const std::vector<Tile> &tiles, PackedColor (*shade)(int, int)) {
+        for (const Tile &tile : tiles) {
+            for (int row = tile.y; row < tile.y + tile.h; row++) {
+                for (int col = tile.x; col < tile.x + tile.w; col++) {
+                    renderer.DrawPixel(left + col, top - row, shade(left + col, top - row));
+                }
+            }
+        }
+    };
+
+    const char *names[] = { "columns", "rows", "Morton tiles", "Hilbert tiles", "Morton tiles, swizzled" };
+    PackedColor (*shaders[])(int, int) = { TraversalPattern, TraversalSpheres };
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    bool same = true;
+    for (int s = 0; s < 2; s++) {
+        PackedColor (*shade)(int, int) = shaders[s];
+        printf("%s:\n", s == 0 ? "Pattern" : "Ray traced spheres");
+        for (int order = 0; order < 5; order++) {
+            double best = 0;
+            renderer.SetLayout(order == 4 ? SoftwareRenderer::swizzled : SoftwareRenderer::rowMajor);
+            for (int rep = 0; rep < reps; rep++) {
+                renderer.Clear(Color(0, 0, 0));
+                const Uint64 start = SDL_GetPerformanceCounter();
+                switch (order) {
+                case 0:
+                    for (int col = 0; col < CANVAS_WIDTH; col++) {
+                        for (int row = 0; row < CANVAS_HEIGHT; row++) {
+                            renderer.DrawPixel(left + col, top - row, shade(left + col, top - row));
+                        }
+                    }
+                    break;
+                case 1:
+                    for (int row = 0; row < CANVAS_HEIGHT; row++) {
+                        for (int col = 0; col < CANVAS_WIDTH; col++) {
+                            renderer.DrawPixel(left + col, top - row, shade(left + col, top - row));
+                        }
+                    }
+                    break;
+                case 2:
+                    drawTiles(mortonOrder, shade);
+                    break;
+                case 3:
+                    drawTiles(hilbertOrder, shade);
+                    break;
+                default:
+                    drawTiles(mortonOrder, shade);
+                    // Presenting deswizzles the frame.
+                    renderer.Pixels();
+                    break;
+                }
+                const double ms = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+                best = rep == 0 ? ms : SDL_min(best, ms);
+            }
+
+            const Uint32 *pixels = renderer.Pixels();
+            if (order == 0)
+                reference.assign(pixels, pixels + CANVAS_WIDTH * CANVAS_HEIGHT);
+            const bool match = memcmp(pixels, reference.data(), reference.size() * sizeof(Uint32)) == 0;
+            same = same && match;
+            printf("  %-24s %8.2f ms%s\n", names[order], best, match ? "" : "  (frame differs)");
+        }
     }
+    return same ? 0 : 1;
 }
 
-void DoSpheres()
+// A cloud of count mirror spheres around the camera, which scatter reflection rays every which way,
+// ray traced recursively and breadth first, with and without sorting each bounce's rays. Prints
+// the three times and checks that the frames match.
+static int DoSortedReflections(int count, int depth)
 {
-    spheres.clear();
-    spheres.emplace_back(Sphere(Vector3(0.f, -1.f, 3.f), 1.f, Color(255, 0, 0), 500, 0.2f));
-    spheres.emplace_back(Sphere(Vector3(2.f, 0.f, 4.f), 1.f, Color(0, 0, 255), 500, 0.3f));
-    spheres.emplace_back(Sphere(Vector3(-2.f, 0.f, 4.f), 1.f, Color(0, 255, 0), 10, 0.4f));
-    spheres.emplace_back(Sphere(Vector3(0, -5001, 0), 5000, Color(255, 255, 0), 1000, 0.5f));
+    InstancedScene scene;
+    SphereSet cloud;
+    Random random;
+    for (int i = 0; i < count; i++) {
+        cloud.spheres.emplace_back(Sphere(Vector3(random.Next() * 40 - 20, random.Next() * 40 - 20, random.Next() * 40 + 2), 0.1f + random.Next() * 0.3f,
+                                          Color(static_cast<int>(random.Next() * 255), static_cast<int>(random.Next() * 255), static_cast<int>(random.Next() * 255)), 500, 0.8f));
+    }
+    cloud.Build();
+    scene.AddInstance(Instance::sphereSet, scene.AddSphereSet(cloud), scene.graph.AddNode(Matrix4::Translation(Vector3(0, 0, 0))));
+    scene.Update();
 
+    lights.clear();
     lights.emplace_back(Light(Light::ambient, 0.2f, Vector3(0, 0, 0), Vector3(0, 0, 0)));
     lights.emplace_back(Light(Light::point, 0.6f, Vector3(2, 1, 0), Vector3(0, 0, 0)));
     lights.emplace_back(Light(Light::directional, 0.2f, Vector3(0, 0, 0), Vector3(1, 4, 4)));
+    sceneRevision++;
+
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    MemoryRenderer renderers[3] = { MemoryRenderer(CANVAS_WIDTH, CANVAS_HEIGHT), MemoryRenderer(CANVAS_WIDTH, CANVAS_HEIGHT), MemoryRenderer(CANVAS_WIDTH, CANVAS_HEIGHT) };
+    const char *names[] = { "recursive", "breadth first", "breadth first, sorted" };
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    double ms[3];
+    for (int way = 0; way < 3; way++) {
+        const Uint64 start = SDL_GetPerformanceCounter();
+        if (way == 0)
+            scene.RayTrace(renderers[way], camera, 1, FLT_MAX, depth);
+        else
+            scene.RayTraceWavefront(renderers[way], camera, 1, FLT_MAX, depth, way == 2);
+        ms[way] = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+    }
 
+    const size_t bytes = static_cast<size_t>(CANVAS_WIDTH) * CANVAS_HEIGHT * sizeof(Uint32);
+    const bool same = memcmp(renderers[0].Pixels(), renderers[1].Pixels(), bytes) == 0 && memcmp(renderers[0].Pixels(), renderers[2].Pixels(), bytes) == 0;
+    printf("Reflections, %d mirror spheres, %d bounces:\n", count, depth);
+    for (int way = 0; way < 3; way++) {
+        printf("  %-22s %8.0f ms (%.2fx)\n", names[way], ms[way], ms[0] / ms[way]);
+    }
+    printf("  frames %s\n", same ? "match" : "differ");
+    return same ? 0 : 1;
+}
 
-    Vector3 O(0, 0, 0);
-    for (int x = -CANVAS_WIDTH / 2; x <= CANVAS_WIDTH / 2; x++) {
-        for (int y=-CANVAS_HEIGHT/2; y<=CANVAS_HEIGHT/2; y++) {
-            Vector3 D = CanvasToViewport(static_cast<float>(x), static_cast<float>(y));
-            const Color color = TraceRay(O, D, 1, 1000000.f, 1);
-            PutPixel(x, y, color);
+// One tile of DoSpheres, for the render farm. Workers build the scene on their first tile.
+static void TraceSphereTile(const Tile &tile, int canvasWidth, int canvasHeight, PackedColor *out)
+{
+    static bool sceneReady = false;
+    if (!sceneReady) {
+        CreateSphereScene();
+        sceneReady = true;
+    }
+
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    for (int row = 0; row < tile.h; row++) {
+        const float y = static_cast<float>(canvasHeight / 2 - (tile.y + row));
+        for (int i = 0; i < tile.w; i++) {
+            const float x = static_cast<float>(tile.x + i - canvasWidth / 2);
+            *out++ = TraceRay(camera.origin, camera.Direction(x, y, canvasWidth, canvasHeight), 1, 1000000.f, 1);
         }
     }
 }
 
-
-void DoLines()
+// DoSpheres seen from camera, as a frame for TileService.
+class SphereFrame : public FrameSource
 {
-    DrawLine(Vector2(-200, -100), Vector2(240, 120), Color(255, 0, 0));
-    DrawLine(Vector2(-50, -200), Vector2(60, 240), Color(0, 255, 0));
-}
+  public:
+    explicit SphereFrame(const RayCamera &c) : camera(c) {}
+
+    void RenderSpan(int x, int y, int count, int canvasWidth, int canvasHeight, PackedColor *out) const override
+    {
+        const float canvasY = static_cast<float>(canvasHeight / 2 - y);
+        for (int i = 0; i < count; i++) {
+            const float canvasX = static_cast<float>(x + i - canvasWidth / 2);
+            out[i] = TraceRay(camera.origin, camera.Direction(canvasX, canvasY, canvasWidth, canvasHeight), 1, 1000000.f, 1);
+        }
+    }
 
-void DoSpiral()
+    RayCamera camera;
+};
+
+// The spheres with a camera the arrow keys (and page up and down) move, rendered in the background.
+// A key press cancels the frame in flight and starts the next at once; the window shows each frame
+// as its tiles come in. Prints how long input took to reach the screen.
+static void DoInteractiveSpheres()
 {
+    CreateSphereScene();
     CreateWindow();
-    float angle = 0;
-    float radius = 1;
+    std::vector<PackedColor> canvas(CANVAS_WIDTH * CANVAS_HEIGHT, BACKGROUND);
+    SphereFrame frame(RayCamera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST));
+    TileService service(CANVAS_WIDTH, CANVAS_HEIGHT);
 
-    while (radius < CANVAS_WIDTH/2) {
-        float cy = radius * (float)sin(angle);
-        float cx = radius * (float)cos(angle);
-        PutPixel((int)cx, (int)cy, 0xff, 0, 0);
-        angle += 3.14159f * .005f;
-        radius += .1f;
-        SDL_RenderPresent(gRenderer);
-        if (CheckForEscape())
-            break;
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    Uint64 inputTime = SDL_GetPerformanceCounter();
+    bool waitingForFirstTile = true;
+    double worstLatencyMs = 0, totalLatencyMs = 0;
+    int moves = 0;
+    service.Start(&frame);
+
+    bool quit = false;
+    while (!quit) {
+        Vector3 move(0, 0, 0);
+        SDL_Event e;
+        while (SDL_PollEvent(&e)) {
+            if (e.type == SDL_QUIT || (e.type == SDL_KEYUP && e.key.keysym.sym == SDLK_ESCAPE))
+                quit = true;
+            if (e.type != SDL_KEYDOWN)
+                continue;
+            switch (e.key.keysym.sym) {
+            case SDLK_LEFT:
+                move.x -= 0.1f;
+                break;
+            case SDLK_RIGHT:
+                move.x += 0.1f;
+                break;
+            case SDLK_UP:
+                move.z += 0.1f;
+                break;
+            case SDLK_DOWN:
+                move.z -= 0.1f;
+                break;
+            case SDLK_PAGEUP:
+                move.y += 0.1f;
+                break;
+            case SDLK_PAGEDOWN:
+                move.y -= 0.1f;
+                break;
+            default:
+                break;
+            }
+        }
+        if (move.x != 0 || move.y != 0 || move.z != 0) {
+            inputTime = SDL_GetPerformanceCounter();
+            service.Cancel();
+            frame.camera.origin = frame.camera.origin + move;
+            service.Start(&frame);
+            waitingForFirstTile = true;
+        }
+
+        if (service.CollectTiles(canvas.data()) > 0) {
+            for (int row = 0; row < CANVAS_HEIGHT; row++) {
+                gRenderer->DrawSpan(-CANVAS_WIDTH / 2, CANVAS_HEIGHT / 2 - row, &canvas[row * CANVAS_WIDTH], CANVAS_WIDTH);
+            }
+            gRenderer->Present();
+            if (waitingForFirstTile) {
+                const double ms = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - inputTime) / freq;
+                worstLatencyMs = SDL_max(worstLatencyMs, ms);
+                totalLatencyMs += ms;
+                moves++;
+                waitingForFirstTile = false;
+            }
+        } else {
+            SDL_Delay(1);
+        }
     }
 
+    service.Cancel();
+    printf("Interactive: %d frames started, %d tiles abandoned; first tile on screen %.1f ms after input on average, %.1f ms at worst\n",
+           service.FramesStarted(), service.TilesAbandoned(), moves ? totalLatencyMs / moves : 0.0, worstLatencyMs);
     DestroyWindow();
 }
 
-Vector2 ViewportToCanvas(float x, float y)
+// Ray traces the spheres on a tile farm, with localWorkers worker processes started from exe on
+// this machine and any others that connect to port, then shows the frame.
+static int DoFarmSpheres(const char *exe, int port, int localWorkers)
 {
-    return { x * (float)CANVAS_WIDTH / (float)VIEWPORT_WIDTH, y * (float)CANVAS_HEIGHT / (float)VIEWPORT_HEIGHT };
+    TileFarm farm(CANVAS_WIDTH, CANVAS_HEIGHT);
+    if (!farm.Listen(port)) {
+        printf("Could not listen on port %d\n", port);
+        return 1;
+    }
+    printf("Farm listening on port %d; join with: render --worker <host> %d\n", farm.Port(), farm.Port());
+    farm.SpawnLocalWorkers(exe, localWorkers);
+
+    std::vector<PackedColor> canvas(CANVAS_WIDTH * CANVAS_HEIGHT);
+    const Uint64 start = SDL_GetPerformanceCounter();
+    const bool complete = farm.Render(canvas.data());
+    const double ms = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / static_cast<double>(SDL_GetPerformanceFrequency());
+    printf("Farm: %.0f ms, %d workers, %d tiles dispatched, %d stolen, %d retried\n", ms, farm.WorkersSeen(),
+           farm.TilesDispatched(), farm.TilesStolen(), farm.TilesRetried());
+    if (!complete) {
+        printf("Farm: no workers left; frame incomplete\n");
+        return 1;
+    }
+
+    CreateWindow();
+    for (int row = 0; row < CANVAS_HEIGHT; row++) {
+        gRenderer->DrawSpan(-CANVAS_WIDTH / 2, CANVAS_HEIGHT / 2 - row, &canvas[row * CANVAS_WIDTH], CANVAS_WIDTH);
+    }
+    gRenderer->Present();
+    WaitForEscape();
+    DestroyWindow();
+    return 0;
 }
 
-Vector2 ProjectVertex(Vector3 v){
-    float d = VIEWPORT_DIST;
-    return ViewportToCanvas(v.x * d / v.z, v.y * d / v.z);
+static PackedColor TraceSphereSample(float x, float y, int canvasWidth, int canvasHeight)
+{
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    return TraceRay(camera.origin, camera.Direction(x, y, canvasWidth, canvasHeight), 1, 1000000.f, 1);
 }
 
-void DoCube()
+// Supersampled DoSpheres as a resumable job checkpointed to path. Rerunning after a kill picks up
+// where the checkpoint left off. The finished frame is shown when there is a display.
+static int DoSpheresJob(const char *path, int samples)
 {
-    // The four "front" vertices
-    Vector3 vAf = { -2, -0.5, 5 }, vBf = { -2, 0.5, 5 }, vCf = { -1, 0.5, 5 }, vDf = { -1, -0.5, 5 };
+    CreateSphereScene();
+    RenderJob job(CANVAS_WIDTH, CANVAS_HEIGHT, samples);
+    const Uint64 start = SDL_GetPerformanceCounter();
+    if (!job.Run(path, TraceSphereSample)) {
+        printf("Job: could not checkpoint to %s\n", path);
+        return 1;
+    }
+    const double ms = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / static_cast<double>(SDL_GetPerformanceFrequency());
+    printf("Job: %d of %d tiles resumed from %s, the rest rendered in %.0f ms\n", job.TilesResumed(), job.TileCount(), path, ms);
 
-        // The four "back" vertices
-    Vector3 vAb = { -2, -0.5, 6 }, vBb = { -2, 0.5, 6 }, vCb = { -1, 0.5, 6 }, vDb = { -1, -0.5, 6 };
+    if (SDL_Init(SDL_INIT_VIDEO) != 0)
+        return 0;
+    std::vector<PackedColor> canvas(CANVAS_WIDTH * CANVAS_HEIGHT);
+    job.Resolve(canvas.data());
+    CreateWindow();
+    for (int row = 0; row < CANVAS_HEIGHT; row++) {
+        gRenderer->DrawSpan(-CANVAS_WIDTH / 2, CANVAS_HEIGHT / 2 - row, &canvas[row * CANVAS_WIDTH], CANVAS_WIDTH);
+    }
+    gRenderer->Present();
+    WaitForEscape();
+    DestroyWindow();
+    SDL_Quit();
+    return 0;
+}
 
-    auto BLUE = Color(0, 0, 255);
-    auto GREEN = Color(0, 255, 0);
-    auto RED = Color(255, 0, 0);
+// DoSpheres with soft shadows: the point light is a ball and the directional light a cone, with one
+// shadow ray towards each per sample, seeded by where the sample lands.
+static PackedColor SoftShadowSphereSample(float x, float y, int canvasWidth, int canvasHeight)
+{
+    Uint32 bitsX, bitsY;
+    memcpy(&bitsX, &x, sizeof(bitsX));
+    memcpy(&bitsY, &y, sizeof(bitsY));
+    Uint32 seed = bitsX * 73856093u ^ bitsY * 19349663u;
+    seed ^= seed >> 16;
+    seed *= 0x7feb352du;
+    seed ^= seed >> 15;
+
+    const AreaLightVisibility shadows(1.f, 0.3f, seed);
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    return TraceRay(camera.origin, camera.Direction(x, y, canvasWidth, canvasHeight), 1, 1000000.f, 1, shadows);
+}
 
-        // The front face
-    DrawLine(ProjectVertex(vAf), ProjectVertex(vBf), BLUE);
-    DrawLine(ProjectVertex(vBf), ProjectVertex(vCf), BLUE);
-    DrawLine(ProjectVertex(vCf), ProjectVertex(vDf), BLUE);
-    DrawLine(ProjectVertex(vDf), ProjectVertex(vAf), BLUE);
+// The denoiser's guides for the spheres, from a ray through each pixel's centre.
+static void FillSphereGuides(GBuffer &guides)
+{
+    const RayCamera camera(Vector3(0, 0, 0), static_cast<float>(VIEWPORT_WIDTH), static_cast<float>(VIEWPORT_HEIGHT), VIEWPORT_DIST);
+    for (int row = 0; row < guides.height; row++) {
+        for (int col = 0; col < guides.width; col++) {
+            const int i = row * guides.width + col;
+            const Vector3 D = camera.Direction(static_cast<float>(col - guides.width / 2), static_cast<float>(guides.height / 2 - row), guides.width, guides.height);
+            Sphere *sphere = nullptr;
+            float t;
+            Vector3 P, N;
+            PackedColor albedo = BACKGROUND;
+            if (ClosestIntersection(camera.origin, D, 1, 1000000.f, &sphere, t)) {
+                P = camera.origin + D * t;
+                N = P - sphere->center;
+                N = N * (1.f / N.Length());
+                albedo = sphere->color;
+            } else {
+                P = camera.origin + D * 1000000.f;
+            }
+            guides.normalX[i] = N.x;
+            guides.normalY[i] = N.y;
+            guides.normalZ[i] = N.z;
+            guides.positionX[i] = P.x;
+            guides.positionY[i] = P.y;
+            guides.positionZ[i] = P.z;
+            guides.albedoR[i] = static_cast<float>(albedo.R());
+            guides.albedoG[i] = static_cast<float>(albedo.G());
+            guides.albedoB[i] = static_cast<float>(albedo.B());
+        }
+    }
+}
 
-    // The back face
-    DrawLine(ProjectVertex(vAb), ProjectVertex(vBb), RED);
-    DrawLine(ProjectVertex(vBb), ProjectVertex(vCb), RED);
-    DrawLine(ProjectVertex(vCb), ProjectVertex(vDb), RED);
-    DrawLine(ProjectVertex(vDb), ProjectVertex(vAb), RED);
+// Over the pixels whose primary ray hit something, by guides; the background is exact at any
+// sample count and would only dilute the error.
+static double RmsError(const HdrImage &a, const HdrImage &b, const GBuffer &guides)
+{
+    double sum = 0;
+    int hits = 0;
+    for (size_t i = 0; i < a.red.size(); i++) {
+        if (guides.normalX[i] == 0 && guides.normalY[i] == 0 && guides.normalZ[i] == 0)
+            continue;
+        const double dr = a.red[i] - b.red[i], dg = a.green[i] - b.green[i], db = a.blue[i] - b.blue[i];
+        sum += dr * dr + dg * dg + db * db;
+        hits++;
+    }
+    return hits > 0 ? sqrt(sum / (3.0 * hits)) : 0.0;
+}
 
-    // The front-to-back edges
-    DrawLine(ProjectVertex(vAf), ProjectVertex(vAb), GREEN);
-    DrawLine(ProjectVertex(vBf), ProjectVertex(vBb), GREEN);
-    DrawLine(ProjectVertex(vCf), ProjectVertex(vCb), GREEN);
-    DrawLine(ProjectVertex(vDf), ProjectVertex(vDb), GREEN);
+static PackedColor ToPackedColor(const HdrImage &image, int i)
+{
+    return PackedColor(Color(SDL_clamp(static_cast<int>(image.red[i] + 0.5f), 0, 255), SDL_clamp(static_cast<int>(image.green[i] + 0.5f), 0, 255),
+                             SDL_clamp(static_cast<int>(image.blue[i] + 0.5f), 0, 255)));
 }
 
+// Soft-shadowed spheres at a few samples per pixel, shown raw on the left and denoised on the right.
+// With referenceSamples, also renders a reference at that many samples and prints how far each is from it.
+static int DoDenoisedSpheres(int samples, int referenceSamples)
+{
+    CreateSphereScene();
+    const double freq = static_cast<double>(SDL_GetPerformanceFrequency());
+    RenderJob job(CANVAS_WIDTH, CANVAS_HEIGHT, samples);
+    Uint64 start = SDL_GetPerformanceCounter();
+    job.Run(nullptr, SoftShadowSphereSample);
+    const double renderMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+    HdrImage noisy(CANVAS_WIDTH, CANVAS_HEIGHT);
+    job.Resolve(noisy);
+
+    GBuffer guides(CANVAS_WIDTH, CANVAS_HEIGHT);
+    FillSphereGuides(guides);
+    HdrImage denoised(CANVAS_WIDTH, CANVAS_HEIGHT);
+    start = SDL_GetPerformanceCounter();
+    Denoiser().Filter(noisy, guides, denoised);
+    const double filterMs = 1000.0 * static_cast<double>(SDL_GetPerformanceCounter() - start) / freq;
+    printf("Denoise: %d samples per pixel rendered in %.0f ms, filtered in %.0f ms\n", samples, renderMs, filterMs);
+
+    if (referenceSamples > 0) {
+        RenderJob reference(CANVAS_WIDTH, CANVAS_HEIGHT, referenceSamples);
+        reference.Run(nullptr, SoftShadowSphereSample);
+        HdrImage truth(CANVAS_WIDTH, CANVAS_HEIGHT);
+        reference.Resolve(truth);
+        printf("Denoise: RMS error against %d samples per pixel: %.2f raw, %.2f denoised\n", referenceSamples,
+               RmsError(noisy, truth, guides), RmsError(denoised, truth, guides));
+    }
+
+    CreateWindow();
+    std::vector<PackedColor> row(CANVAS_WIDTH);
+    for (int y = 0; y < CANVAS_HEIGHT; y++) {
+        for (int x = 0; x < CANVAS_WIDTH; x++) {
+            row[x] = ToPackedColor(x < CANVAS_WIDTH / 2 ? noisy : denoised, y * CANVAS_WIDTH + x);
+        }
+        gRenderer->DrawSpan(-CANVAS_WIDTH / 2, CANVAS_HEIGHT / 2 - y, row.data(), CANVAS_WIDTH);
+    }
+    gRenderer->Present();
+    WaitForEscape();
+    DestroyWindow();
+    return 0;
+}
 
 #ifdef __cplusplus
 extern "C"
@@ -484,18 +1123,86 @@ int main(int argc, char *argv[])
     bool quit = false;
     bool doMenu = false;
 
+    // render --bench [baseline]       run the rasterizer benchmarks, diffing against baseline
+    // render --bench-save <baseline>  run them and record the results as the new baseline
+    if (argc >= 2 && strcmp(argv[1], "--bench") == 0)
+        return RunRasterBenchmarks(argc >= 3 ? argv[2] : "bench_baseline.txt", false);
+    if (argc >= 3 && strcmp(argv[1], "--bench-save") == 0)
+        return RunRasterBenchmarks(argv[2], true);
+
+    // render --record <path> <spiral|spheres|cube> [frames] [fps]
+    //     render an animation headless to .gif, .y4m or raw RGB (any other name, or - for stdout)
+    if (argc >= 4 && strcmp(argv[1], "--record") == 0)
+        return RecordAnimation(argv[2], argv[3], argc >= 5 ? SDL_max(atoi(argv[4]), 1) : 90, argc >= 6 ? atoi(argv[5]) : 30);
+
+    // render --worker <host> <port>  render tiles for a farm coordinator until its frame is done
+    if (argc >= 4 && strcmp(argv[1], "--worker") == 0)
+        return RunTileWorker(argv[2], atoi(argv[3]), TraceSphereTile);
+
+    // render --bvh-dynamic [spheres] [frames]  time BVH refits and rebuilds for moving spheres
+    if (argc >= 2 && strcmp(argv[1], "--bvh-dynamic") == 0)
+        return DoDynamicBvh(argc >= 3 ? SDL_max(atoi(argv[2]), 1) : 100000, argc >= 4 ? SDL_max(atoi(argv[3]), 1) : 60);
+
+    // render --bvh-wide [spheres]  compare the binary and the eight-wide quantized BVH
+    if (argc >= 2 && strcmp(argv[1], "--bvh-wide") == 0)
+        return DoWideBvh(argc >= 3 ? SDL_max(atoi(argv[2]), 1) : 1000000);
+
+    // render --binned [spheres]  time primary rays binned per screen tile against testing every sphere
+    if (argc >= 2 && strcmp(argv[1], "--binned") == 0)
+        return DoBinnedSpheres(argc >= 3 ? SDL_max(atoi(argv[2]), 1) : 200);
+
+    // render --traversal [reps]  time pixel orders and the swizzled framebuffer on the spheres
+    if (argc >= 2 && strcmp(argv[1], "--traversal") == 0)
+        return DoTraversalBenchmark(argc >= 3 ? SDL_max(atoi(argv[2]), 1) : 5);
+
+    // render --reflections [spheres] [bounces]  time sorting reflection rays in a cloud of mirror spheres
+    if (argc >= 2 && strcmp(argv[1], "--reflections") == 0)
+        return DoSortedReflections(argc >= 3 ? SDL_max(atoi(argv[2]), 1) : 100000, argc >= 4 ? SDL_max(atoi(argv[3]), 0) : 2);
+
+    // render --job <checkpoint> [samples]  supersampled spheres, resuming from checkpoint if it exists
+    if (argc >= 3 && strcmp(argv[1], "--job") == 0)
+        return DoSpheresJob(argv[2], argc >= 4 ? atoi(argv[3]) : 16);
+
     /* Enable standard application logging */
     SDL_LogSetPriority(SDL_LOG_CATEGORY_APPLICATION, SDL_LOG_PRIORITY_INFO);
     SDL_Init(SDL_INIT_VIDEO);
 
-    SDL_SetRenderDrawColor(gRenderer, 0x0A, 0x0A, 0x0A, 0xFF);
-    SDL_RenderClear(gRenderer);
+    // render --farm [port] [local workers]  ray trace the spheres on a tile farm, 4 local workers by default
+    if (argc >= 2 && strcmp(argv[1], "--farm") == 0) {
+        const int status = DoFarmSpheres(argv[0], argc >= 3 ? atoi(argv[2]) : 7341, argc >= 4 ? atoi(argv[3]) : 4);
+        SDL_Quit();
+        return status;
+    }
+
+    // render --interactive  ray traced spheres with a camera the arrow keys move
+    if (argc >= 2 && strcmp(argv[1], "--interactive") == 0) {
+        DoInteractiveSpheres();
+        SDL_Quit();
+        return 0;
+    }
+
+    // render --denoise [samples] [reference samples]  soft shadows at 4 samples per pixel, raw and denoised
+    if (argc >= 2 && strcmp(argv[1], "--denoise") == 0) {
+        const int status = DoDenoisedSpheres(argc >= 3 ? SDL_max(atoi(argv[2]), 1) : 4, argc >= 4 ? atoi(argv[3]) : 0);
+        SDL_Quit();
+        return status;
+    }
 
     if (doMenu) {
         while (quit == false) {
             printf("\n\n");
             printf("1 - Spheres\n");
             printf("2 - Spiral\n");
+            printf("3 - Projection benchmark\n");
+            printf("4 - Filled cube\n");
+            printf("5 - Textured cube\n");
+            printf("6 - Gouraud and Phong shading\n");
+            printf("7 - Shadow mapped scene\n");
+            printf("8 - Spheres, rasterized primary visibility\n");
+            printf("9 - Instanced forest\n");
+            printf("a - Instanced cubes\n");
+            printf("b - Translucent BSP overlay\n");
+            printf("c - Spheres, interactive camera\n");
             printf("q - Quit\n");
 
             int ch = getc(stdin);
@@ -504,11 +1211,41 @@ int main(int argc, char *argv[])
             } else {
                 switch (ch) {
                 case '1':
-                    DoSpheres();
+                    ShowInWindow(DoSpheres);
                     break;
                 case '2':
                     DoSpiral();
                     break;
+                case '3':
+                    DoProjectionBenchmark();
+                    break;
+                case '4':
+                    ShowInWindow(DoFilledCube);
+                    break;
+                case '5':
+                    ShowInWindow(DoTexturedCube);
+                    break;
+                case '6':
+                    ShowInWindow(DoShadedSpheres);
+                    break;
+                case '7':
+                    ShowInWindow(DoShadowedScene);
+                    break;
+                case '8':
+                    ShowInWindow(DoHybridSpheres);
+                    break;
+                case '9':
+                    ShowInWindow(DoInstancedForest);
+                    break;
+                case 'a':
+                    ShowInWindow(DoInstancedCubes);
+                    break;
+                case 'b':
+                    ShowInWindow(DoBspOverlay);
+                    break;
+                case 'c':
+                    DoInteractiveSpheres();
+                    break;
                 default:
                     break;
                 }
@@ -518,10 +1255,11 @@ int main(int argc, char *argv[])
         CreateWindow();
         //DoSpheres();
         //DoLines();
-        //DrawFilledTriangle(Vector3(-200, -250, 0), Vector3(200, 50, 0), Vector3(20, 250, 0), Color(0,255,0,255));
-        //DrawShadedTriangle(Vertex(-200, -250, 1.f), Vertex(200, 50, 0.5f), Vertex(20, 250, 0.1f), Color(0, 255, 0, 255));
+        //gRenderer->DrawFilledTriangle(Vector3(-200, -250, 0), Vector3(200, 50, 0), Vector3(20, 250, 0), Color(0,255,0,255));
+        //gRenderer->DrawShadedTriangle(Vertex(-200, -250, 1.f), Vertex(200, 50, 0.5f), Vertex(20, 250, 0.1f), Color(0, 255, 0, 255));
+        //DoFilledCube();
         DoCube();
-        SDL_RenderPresent(gRenderer);
+        gRenderer->Present();
         WaitForEscape();
         DestroyWindow();
     }